@@ -6,16 +6,30 @@ using namespace std;
 
 #include "Operation/GreedyLoad.h"
 #include <Operation/GreedyLoadMap.h>
+#include <Operation/TieredLoad.h>
+#include <Operation/IncrementalLoad.h>
+#include <Operation/OptimalLoad.h>
+#include <Operation/AdaptiveLoad.h>
+#include <Operation/TunedLoad.h>
+#include <Operation/BoundedReplay.h>
+#include <Operation/BatchEvaluator.h>
 #include <Model/Sequence/Operation.h>
 #include <Model/Sequence/IO.h>
+#include <Model/Sequence/ReplayProgram.h>
 
 #include <Base/Simulator.h>
 #include <Operation/OperationHeap.h>
 #include <Operation/BaseCompressionPolicy.h>
 #include <Operation/UbiOperationGraph.h>
 #include <Simulator/EvoSimulator.h>
+#include <Simulator/SnapshotExporter.h>
 
 #include <Model/Pathway/Operation.h>
+#include <Util/BufferPool.h>
+#include <Util/CostModel.h>
+#include <Util/MemoryMonitor.h>
+#include <Util/Numa.h>
+#include <Util/Thread.h>
 #include <Util/json/json.h>
 
 #define SUPPORTS_RUSAGE
@@ -33,9 +47,10 @@ using namespace GPPG::Model::TransReg;
 
 inline double timeToDbl(const timeval& t) { return t.tv_sec + 1.0*t.tv_usec/1e6; }
 
-void recordUsage(ostream* out, int step, int generation) {
+void recordUsage(ostream* out, int step, int generation, long merged, const TunedLoad* tuned) {
 	rusage stats;
 	getrusage( RUSAGE_SELF, &stats );
+	const BufferPool& pool = BufferPool::instance();
 	(*out) << step << "," << generation << "," << (clock()*1.0/CLOCKS_PER_SEC) << ","
 			<< timeToDbl(stats.ru_utime) << "," << timeToDbl(stats.ru_stime) << ","
 			<< stats.ru_maxrss << "," << stats.ru_ixrss << "," << stats.ru_idrss << "," << stats.ru_isrss << ","
@@ -44,43 +59,87 @@ void recordUsage(ostream* out, int step, int generation) {
 			<< stats.ru_inblock << "," << stats.ru_oublock << ","
 			<< stats.ru_msgsnd << "," << stats.ru_msgrcv << ","
 			<< stats.ru_nsignals << ","
-			<< stats.ru_nvcsw << "," << stats.ru_nivcsw << endl;
+			<< stats.ru_nvcsw << "," << stats.ru_nivcsw << ","
+			<< pool.hits() << "," << pool.misses() << "," << pool.cachedBytes() << "," << pool.usedBytes() << ","
+			<< merged;
+	if (tuned) (*out) << "," << tuned->maxUncompressed() << "," << tuned->numGenerations() << "," << tuned->numAdjustments();
+	// Resident memory on each NUMA node
+	vector<size_t> nodeBytes;
+	numaResidentBytes( nodeBytes );
+	for (int i=0; i<(int)nodeBytes.size(); i++) (*out) << "," << nodeBytes[i];
+	(*out) << endl;
 	out->flush();
 }
 
+/* The configured policy, inside the replay bound if there is one */
+ICompressionPolicy& basePolicy( EvoSimulator* sim ) {
+	ICompressionPolicy& policy = ((OperationGraph*)sim->heap())->compressionPolicy();
+	BoundedReplay* bounded = dynamic_cast<BoundedReplay*>( &policy );
+	return bounded ? bounded->policy() : policy;
+}
+
 // http://linux.die.net/man/2/getrusage
 
-void runSimulation( EvoSimulator* sim, long N, long G, int steps, ostream* out ) {
+void runSimulation( EvoSimulator* sim, long N, long G, int steps, ostream* out, SnapshotExporter* snapshots, const string& snapshotPath, int snapshotEvery ) {
 	cout << "Running Simulation [N="<<N<<", G="<<G<<"]\n";
+	// A self-tuning policy records its decisions along with the usage
+	const TunedLoad* tuned = dynamic_cast<TunedLoad*>( &basePolicy( sim ) );
 
 #ifdef SUPPORTS_RUSAGE
 	if (out) {
-		(*out) << "step,gen,wtime,utime,stime,maxrss,ixrss,idrss,isrss,minflt,majflt,nswap,inblock,oublock,msgsnd,msgrcv,nsignals,nvcsw,nivcsw\n";
+		(*out) << "step,gen,wtime,utime,stime,maxrss,ixrss,idrss,isrss,minflt,majflt,nswap,inblock,oublock,msgsnd,msgrcv,nsignals,nvcsw,nivcsw,poolhits,poolmisses,poolcached,poolused,merged";
+		if (tuned) (*out) << ",k,t,adjustments";
+		for (int i=0; i<numaNodes(); i++) (*out) << ",node" << i;
+		(*out) << "\n";
 	}
 #endif
 	for (int i=0; i<steps; i++) {
 		sim->evolve( N, G/steps );	
 		cout << "Done with " << i << " of " << steps << endl;
+		// Written while the next steps run
+		if (snapshots && (i+1) % snapshotEvery == 0) {
+			stringstream path;
+			path << snapshotPath << "." << sim->clock();
+			snapshots->capture( sim, path.str() );
+		}
 #ifdef SUPPORTS_RUSAGE
 		if (out) {
-			recordUsage( out, i, sim->clock() );
+			recordUsage( out, i, sim->clock(), sim->mergedCount(), tuned );
 		}
 #endif
 	}
 	
 }
 
+/* Writes the record of the i'th active genotype */
+class GenotypeWriter : public IBatchExporter::Sink {
+public:
+	GenotypeWriter( const vector<IGenotype*>& genotypes, ostream& out ) : _genotypes(genotypes), _out(out) {}
+	
+	void write( int i, const std::string& text ) {
+		IGenotype* g = _genotypes[i];
+		_out << ">g"<<i<<"|"<<g->key() << "|" <<g->frequency()<<"|"<<g->order()<<endl;
+		_out << text;
+		_out << endl << endl;
+	}
+	
+private:
+	const vector<IGenotype*>& _genotypes;
+	ostream& _out;
+};
+
 void outputGenotypes( EvoSimulator* sim, ostream& out ) {	
 		
-	set<IGenotype*>::iterator git;
 	const set<IGenotype*>& active = sim->activeGenotypes();
-	int i=0;
-	for (git=active.begin(); git!=active.end(); git++) {
-		IGenotype* g = *git;
-		out << ">g"<<i<<"|"<<g->key() << "|" <<g->frequency()<<"|"<<g->order()<<endl;
-		out << g->exportFormat();
-		out << endl << endl;
-		i++;
+	vector<IGenotype*> genotypes( active.begin(), active.end() );
+	GenotypeWriter writer( genotypes, out );
+	// The model's exporter replays the ancestors shared by the genotypes once
+	if (sim->batchExporter()) {
+		sim->batchExporter()->exportBatch( genotypes, writer );
+		return;
+	}
+	for (int i=0; i<(int)genotypes.size(); i++) {
+		writer.write( i, genotypes[i]->exportFormat() );
 	}
 	
 }
@@ -115,6 +174,18 @@ EvoSimulator* createSimulator( const Json::Value& config ) {
 	const string& compName = compression.get("name","Store-Root").asString();
 	
 	if( compName == "Greedy-Load" ) policy = new GreedyLoad(compression.get("k",20).asInt(), compression.get("t",10).asInt());
+	else if( compName == "Tiered-Load" ) policy = new TieredLoad(compression.get("k",20).asInt(), compression.get("t",10).asInt(),
+														 compression.get("w",100).asInt(), compression.get("age",50).asInt());
+	else if( compName == "Incremental-Load" ) policy = new IncrementalLoad(compression.get("k",20).asInt(), compression.get("t",50).asInt(),
+														 compression.get("r",8).asInt());
+	else if( compName == "Optimal-Load" ) policy = new OptimalLoad(compression.get("k",20).asInt(), compression.get("t",10).asInt(),
+														 compression.get("baseline",false).asBool());
+	else if( compName == "Adaptive-Load" ) policy = new AdaptiveLoad(compression.get("k",20).asInt(), compression.get("decay",0.8).asDouble(),
+														 compression.get("h",0.25).asDouble());
+	else if( compName == "Tuned-Load" ) policy = new TunedLoad(compression.get("k",20).asInt(), compression.get("t",10).asInt(),
+														 compression.get("memory",0).asDouble()*1024*1024, compression.get("seconds",0).asDouble(),
+														 compression.get("kMin",2).asInt(), compression.get("kMax",1000).asInt(),
+														 compression.get("tMin",0).asInt(), compression.get("tMax",100).asInt());
 	else if( compName == "Store-Root" ) policy = new BaseCompressionPolicy(STORE_ROOT); 
 	else if( compName == "Store-Active" ) policy = new BaseCompressionPolicy(STORE_ACTIVE);
 	else if( compName == "Store-All" ) policy = new BaseCompressionPolicy(STORE_ALL);
@@ -123,8 +194,17 @@ EvoSimulator* createSimulator( const Json::Value& config ) {
 		cout << "No valid compression policy provided, got: " << compName << endl;
 		return 0;
 	}
+	GreedyLoad* greedy = dynamic_cast<GreedyLoad*>( policy );
+	if( greedy ) greedy->setBackground( compression.get("background",false).asBool() );
+	if( compression.isMember("maxDepth") || compression.isMember("maxCost") )
+		policy = new BoundedReplay( policy, compression.get("maxDepth",0).asInt(), compression.get("maxCost",0).asDouble(),
+			compression.get("checkpoints",0).asInt() );
 	
-	EvoSimulator* sim = new EvoSimulator( new OperationGraph( policy ) );
+	OperationGraph* graph = new OperationGraph( policy );
+	graph->setInterning( config.get("merge", false).asBool() );
+	EvoSimulator* sim = new EvoSimulator( graph );
+	sim->setPipelined( config.get("pipelined", false).asBool() );
+	sim->setParallelOffspring( config.get("parallelOffspring", false).asBool() );
 	
 	// Set Factory & Genotype
 	const Json::Value& geno = config["genotype"];
@@ -139,6 +219,13 @@ EvoSimulator* createSimulator( const Json::Value& config ) {
 
 		SequenceRootFactory factory(geno["length"].asInt(), distr);
 		g = factory.random();
+		sim->setBatchExporter( new BatchEvaluator<SequenceData, ISequence>() );
+		
+		const string& cache = geno.get("cache", "full").asString();
+		if( cache == "diff" ) OpSequenceBase::setDiffCache( true );
+		else if( cache != "full" ) cout << "Unknown sequence cache " << cache << ", caching full sequences\n";
+		OpSequenceBase::setReplayPrograms( geno.get("programs", 0).asInt() );
+		ReplayProgram::setMaxBytes( (size_t)(geno.get("programMemory", 64).asDouble()*1024*1024) );
 		
 		for (int i=0; i<ops.size(); i++) {
 			const Json::Value& gOp = ops[i];
@@ -156,7 +243,9 @@ EvoSimulator* createSimulator( const Json::Value& config ) {
 				sim->addMutator( new SequenceDeletionMutator(gOp.get("cost",10).asDouble(), gOp["rate"].asDouble()*scaling,
 															 gOp["size"][(Json::Value::ArrayIndex)0].asInt(), gOp["size"][1].asInt() ));
 			} else if( opName == "Recombination" ) {
-				sim->addRecombinator( new SequenceRecombinator(gOp.get("cost",100).asDouble(), gOp["rate"].asDouble()*scaling ));
+				SequenceRecombinator* recombinator = new SequenceRecombinator(gOp.get("cost",100).asDouble(), gOp["rate"].asDouble()*scaling );
+				recombinator->setMerging( config.get("merge", false).asBool() );
+				sim->addRecombinator( recombinator );
 			}
 		}
 	} 
@@ -171,6 +260,7 @@ EvoSimulator* createSimulator( const Json::Value& config ) {
 		
 		PathwayRootFactory factory(*info);
 		g = factory.random();
+		sim->setBatchExporter( new BatchEvaluator<PromoterData, ITransRegPathway>() );
 		
 		
 		for (int i=0; i<ops.size(); i++) {
@@ -195,7 +285,41 @@ EvoSimulator* createSimulator( const Json::Value& config ) {
 	return sim;
 }
 
+void configureMemory( const Json::Value& config ) {
+	const Json::Value& pool = config["bufferPool"];
+	BufferPool& bp = BufferPool::instance();
+	
+	bp.setHugePages( pool.get("hugePages", false).asBool() );
+	if( pool.isMember("maxCached") ) bp.setMaxCached( (size_t)(pool["maxCached"].asDouble()*1024*1024) );
+	
+	const Json::Value& numa = config["numa"];
+	string policy = numa.get("policy", "firstTouch").asString();
+	if( policy == "interleave" ) bp.setNumaPolicy( BufferPool::NUMA_INTERLEAVE );
+	else if( policy == "local" ) bp.setNumaPolicy( BufferPool::NUMA_LOCAL );
+	else if( policy != "firstTouch" ) cout << "Unknown NUMA policy " << policy << ", using first touch\n";
+	
+	if( numa.isMember("node") && !numaPinThread( numa["node"].asInt() ) )
+		cout << "Could not pin to NUMA node " << numa["node"].asInt() << endl;
+
+	// Pool workers share the simulation's node, or spread over all nodes to allocate locally
+	if( numa.isMember("node") ) ThreadPool::instance().setNode( numa["node"].asInt() );
+	else if( policy == "local" ) ThreadPool::instance().setNode( ThreadPool::ALL_NODES );
+	
+	const Json::Value& limit = config["memoryLimit"];
+	MemoryMonitor& monitor = MemoryMonitor::instance();
+	monitor.setSoftLimit( (size_t)(limit.get("soft", 0).asDouble()*1024*1024) );
+	monitor.setInterval( limit.get("interval", 64).asInt() );
+	if( limit.isMember("cgroup") && !monitor.setCgroupFile( limit["cgroup"].asString() ) )
+		cout << "Could not read " << limit["cgroup"].asString() << ", counting genome buffers instead\n";
+}
+
 void createAndRunSimulation( const Json::Value& config ) {
+	// Memory settings have to be in place before the root genotype is allocated
+	configureMemory( config );
+	// Workers are started after configureMemory() chose their nodes
+	ThreadPool::instance().setThreads( config.get("threads", 1).asInt() );
+	CostModel::instance().setSampling( config["costModel"].get("sample", 0).asInt() );
+	
 	EvoSimulator* sim = createSimulator( config );
 
 	if (!sim) {
@@ -210,13 +334,54 @@ void createAndRunSimulation( const Json::Value& config ) {
 		perfFile->open( output["performance"].asCString() );
 	}
 	
-	runSimulation(sim, config["individuals"].asInt(), config["generations"].asInt(), config.get("steps", 100).asInt(), perfFile);
+	SnapshotExporter* snapshots = 0;
+	if( output.isMember("snapshots") ) snapshots = new SnapshotExporter();
+	int snapshotEvery = output.get("snapshotEvery", 1).asInt();
+	
+	runSimulation(sim, config["individuals"].asInt(), config["generations"].asInt(), config.get("steps", 100).asInt(), perfFile,
+				  snapshots, output.get("snapshots", "").asString(), (snapshotEvery < 1) ? 1 : snapshotEvery);
+	
+	if(snapshots) {
+		snapshots->wait();
+		cout << "Snapshots: " << snapshots->numExports() << " written" << endl;
+		delete snapshots;
+	}
 	
 	if(perfFile) {
 		perfFile->close();
 		delete perfFile;
 	}
 	
+	OptimalLoad* optimal = dynamic_cast<OptimalLoad*>( &basePolicy( sim ) );
+	if( optimal ) {
+		cout << "Optimal-Load: " << optimal->numSolved() << " placements solved, " << optimal->numMixed() << " around recombinants, " << optimal->numFallbacks() << " by Greedy-Load";
+		if( optimal->optimalCost() > 0 )
+			cout << ", replay cost " << optimal->placedCost()/optimal->optimalCost() << "x the optimum";
+		cout << endl;
+	}
+	
+	GreedyLoad* greedy = dynamic_cast<GreedyLoad*>( &basePolicy( sim ) );
+	if( greedy && greedy->background() )
+		cout << "Background runs: " << greedy->numBatches() << " batches published, " << greedy->numDeferred() << " runs put off" << endl;
+	
+	BoundedReplay* bounded = dynamic_cast<BoundedReplay*>( &((OperationGraph*)sim->heap())->compressionPolicy() );
+	if( bounded )
+		cout << "Replay bound: " << bounded->numCheckpoints() << " checkpoints (" << bounded->numPlaced() << " placed, "
+			<< bounded->numShed() << " shed, bound doubled " << bounded->level() << " times), longest replay "
+			<< bounded->worstDepth() << " operations costing " << bounded->worstCost() << endl;
+	
+	MemoryMonitor& monitor = MemoryMonitor::instance();
+	if( monitor.softLimit() > 0 )
+		cout << "Memory limit crossed " << ((OperationGraph*)sim->heap())->numMemoryEvents() << " times" << endl;
+	
+	CostModel& costs = CostModel::instance();
+	if( costs.sampling() > 0 ) {
+		cout << "Calibrated costs:";
+		for (int i=0; i<costs.numClasses(); i++)
+			cout << " " << costs.configuredCost(i) << "->" << costs.cost(i) << " (" << costs.samples(i) << " samples)";
+		cout << endl;
+	}
+	
 	if( output.isMember("individuals") ) {
 		if( output["individuals"] == "<stdout>") {
 			outputGenotypes( sim, cout );
@@ -234,7 +399,10 @@ void createAndRunSimulation( const Json::Value& config ) {
 		out.close();
 	}
 	
+	OperationGraph* graph = (OperationGraph*)sim->heap();
 	delete sim;
+	// Joins the policy's background thread
+	delete graph;
 }
 
 int main (int argc, char * const argv[])
@@ -50,6 +50,6 @@ void BaseGenotype::setOrder(int i) {
 double BaseGenotype::fitness() const { return _fitness; }
 void BaseGenotype::setFitness(double f) { _fitness = f; }
 
-const char* BaseGenotype::exportFormat() {
+std::string BaseGenotype::exportFormat() {
 	return "No Export Format provided";
 }
\ No newline at end of file
@@ -41,7 +41,9 @@ namespace GPPG {
 		virtual double fitness() const = 0;
 		virtual void setFitness(double f) = 0;
 		
-		virtual const char* exportFormat() = 0;
+		/** Returns the genome as the individuals output writes it.
+		 */
+		virtual std::string exportFormat() = 0;
 	};
 	
 	class BaseGenotype : public IGenotype {
@@ -72,7 +74,7 @@ namespace GPPG {
 		double fitness() const;
 		void setFitness(double f);
 		
-		const char* exportFormat();
+		std::string exportFormat();
 		
 	private:
 		double _freq, _total, _fitness;
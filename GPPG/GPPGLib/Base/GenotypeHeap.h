@@ -37,6 +37,23 @@ public:
 	 */
 	virtual void removeGenotype(IGenotype* g) = 0;
 	
+	/** Removes \param g in two steps, for simulators that remove genotypes behind the next generation.
+	 * retireGenotype() notifies the Heap that g left the population, on the simulator's thread;
+	 * collectGenotype() then removes it and may run on another thread, while new genotypes are added.
+	 * The caller keeps the two threads out of the Heap at the same time.
+	 */
+	virtual void retireGenotype(IGenotype* /* g */) {}
+	virtual void collectGenotype(IGenotype* g) { removeGenotype(g); }
+	
+	/** Returns a genotype in the heap identical to \param g (which has not been added yet), or NULL.
+	 * Heaps that cannot tell genotypes apart always return NULL.
+	 */
+	virtual IGenotype* findDuplicate(IGenotype* /* g */) { return 0; }
+	
+	/** The simulator uses this function to notify the Heap that \param g has become active.
+	 */
+	virtual void genotypeActivated(IGenotype* /* g */) {}
+	
 	virtual void generationFinished(const std::vector<IGenotype*>&) = 0;
 	virtual void generationFinished(const std::set<IGenotype*>&) = 0;
 	
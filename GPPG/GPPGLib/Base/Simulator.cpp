@@ -275,6 +275,7 @@ IGenotype* PopulationSimulator::activateGenotype(IGenotype* g, double freq) {
 	_freqs.push_back( freq );
 	_freqs_m.push_back( freq );
 	_freqs_r.push_back( freq );
+	_heap->genotypeActivated( g );
 	
 	return g;
 }
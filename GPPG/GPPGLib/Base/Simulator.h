@@ -22,6 +22,8 @@ namespace GPPG {
 	class GenotypeSimulator {
 	public:
 		GenotypeSimulator(IGenotypeHeap* heap);
+		
+		virtual ~GenotypeSimulator() {}
 			
 		void addMutator(IMutator* mutator);
 		
@@ -8,8 +8,12 @@
  */
 
 #include "Data.h"
+#include "Util/BitPack.h"
+#include "Util/BufferPool.h"
 #include <algorithm>
+#include <cstring>
 
+using namespace GPPG;
 using namespace GPPG::Model::TransReg;
 using namespace GPPG::Model;
 using namespace std;
@@ -59,11 +63,11 @@ std::vector<int> GlobalInfo::binding(int i) const {
 	else return std::vector<int>();
 }
 PromoterData::PromoterData(const GlobalInfo& info): _info(info) {
-	_pool = (PTYPE*)malloc(sizeof(PTYPE)*_info.totalRegions());
+	_pool = (PTYPE*)BufferPool::instance().allocate(sizeof(PTYPE)*_info.totalRegions());
 }
 
 PromoterData::~PromoterData() {
-	delete _pool;
+	BufferPool::instance().release(_pool, sizeof(PTYPE)*_info.totalRegions());
 }
 
 PromoterData* PromoterData::copy() const {
@@ -82,6 +86,8 @@ void PromoterData::set(int i, int j, PTYPE c) {
 
 PTYPE PromoterData::get(int i)  { return _pool[i]; }
 
+PTYPE PromoterData::get(int i) const { return _pool[i]; }
+
 int PromoterData::totalRegions() const { return _info.totalRegions(); }
 
 int PromoterData::numGenes() const { return _info.numGenes(); }
@@ -94,6 +100,16 @@ PTYPE PromoterData::getBinding(int i, int j)  {
 	return _pool[ _info.offset(i)+j]; 
 }
 
+PTYPE PromoterData::getBinding(int i, int j) const { 
+	return _pool[ _info.offset(i)+j]; 
+}
+
 const GlobalInfo& PromoterData::info() const { return _info; }
 
+void PromoterData::encode(std::vector<unsigned char>& out) const {
+	packSymbols( _pool, totalRegions(), out );
+}
 
+void PromoterData::decode(const std::vector<unsigned char>& in) {
+	unpackSymbols( in, _pool, totalRegions() );
+}
@@ -63,6 +63,8 @@ namespace GPPG {
 			
 		class ITransRegPathway {
 		public:
+			virtual ~ITransRegPathway() {}
+
 			/** Retrieve the number of genes
 			 */
 			virtual int numGenes() const = 0;
@@ -97,6 +99,7 @@ namespace GPPG {
 			
 			/**
 			 * A simple data structure for holding Pathway (promoter) information.
+			 * The promoter buffer is drawn from (and returned to) the BufferPool.
 			 */
 			class PromoterData : ITransRegPathway {
 			public:
@@ -120,6 +123,7 @@ namespace GPPG {
 				/** Gets the BS located at region i
 				 */
 				PTYPE get(int i) ;
+				PTYPE get(int i) const;
 				
 				/** Sets the item at location i
 				 */
@@ -134,9 +138,18 @@ namespace GPPG {
 				int numMotifs() const;
 			
 				PTYPE getBinding(int i, int j) ;
+				PTYPE getBinding(int i, int j) const;
 				
 				const GlobalInfo& info() const;
 				
+				/** Writes the packed (see BitPack.h) binding sites to \param out.
+				 */
+				void encode(std::vector<unsigned char>& out) const;
+				
+				/** Reads the binding sites back from \param in.
+				 */
+				void decode(const std::vector<unsigned char>& in);
+				
 			private:
 				PTYPE *_pool;
 				const GlobalInfo& _info;
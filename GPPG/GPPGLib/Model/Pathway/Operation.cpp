@@ -14,6 +14,7 @@
 #include <iostream>
 #include <algorithm>
 #include <sstream>
+#include "Util/BitPack.h"
 #include "Util/Random.h"
 
 using namespace GPPG;
@@ -50,10 +51,16 @@ int OpPathwayBase::totalRegions() const { return _info.totalRegions(); }
 
 PTYPE OpPathwayBase::get(int i) {
 	incrRequests(1);
-	if (isCompressed()) {
-		return proxyGet(i);
+	// As for sequences, each form is picked up once and a dropped one is retired (see BaseOperation::retire())
+	const std::vector<unsigned char>* blob = encoded();
+	if (blob) {
+		return unpackSymbol(*blob, i);
 	}
-	return data()->get(i);
+	PromoterData* d = data();
+	if (d) {
+		return d->get(i);
+	}
+	return proxyGet(i);
 }
 
 PTYPE OpPathwayBase::getBinding(int i, int j)  {
@@ -62,9 +69,21 @@ PTYPE OpPathwayBase::getBinding(int i, int j)  {
 
 const GlobalInfo& OpPathwayBase::info() const { return _info; }
 
-const char* OpPathwayBase::exportFormat() {
+void OpPathwayBase::encodeData(const PromoterData& d, std::vector<unsigned char>& out) const { d.encode(out); }
+
+PromoterData* OpPathwayBase::decodeData(const std::vector<unsigned char>& in) const {
+	PromoterData* d = new PromoterData(_info);
+	d->decode(in);
+	return d;
+}
+
+std::string OpPathwayBase::exportFormat() {
+	DataView<PromoterData> pd = view();
+	return exportData( *pd );
+}
+
+std::string OpPathwayBase::exportData(const PromoterData& pd) {
 	std::ostringstream output;
-	PromoterData* pd = evaluate();
 	for(int i=0; i<numGenes(); i++) {
 		// print gene
 		output << _info.getGeneName(i) << "\t[" << i+1 << "]\t";
@@ -77,19 +96,23 @@ const char* OpPathwayBase::exportFormat() {
 		output << "]\t";
 		*/
 		for(int j=0; j<_info.numRegions(i); j++) {
-			output << "|" << pd->getBinding(i,j);
+			output << "|" << pd.getBinding(i,j);
 		}
 		output << std::endl;
 	}
 	
-	return output.str().c_str();
+	return output.str();
 }
 
 /**
  ********************************** PATHWAY ROOT ****************************************
  */
 
-PathwayRoot::PathwayRoot( PromoterData* p) : OperationRoot<PromoterData,ITransRegPathway>(p) {}
+PathwayRoot::PathwayRoot( PromoterData* p) : OperationRoot<PromoterData,ITransRegPathway>(p) {
+	Fingerprint f;
+	for (int i=0; i<p->totalRegions(); i++) f ^= siteFingerprint(i, p->get(i));
+	setFingerprint(f);
+}
 
 int PathwayRoot::numGenes() const { return data()->numGenes(); }
 
@@ -153,13 +176,11 @@ GlobalInfo* PathwayRootFactory::randomInfo(int numGenes, int numTFs, int minRegi
 /**
  ********************************** OPERATIONS *********************************************
  */
-BindingSiteChange::BindingSiteChange(OpPathway& op, std::vector<int>* locs, std::vector<PTYPE>* dest) :
-OpPathwayBase(1, op.info(), op), _locs(locs), _c(dest) {}
-
-
-BindingSiteChange::~BindingSiteChange() {
-	delete _locs;
-	delete _c;
+BindingSiteChange::BindingSiteChange(OpPathway& op, const std::vector<int>& locs, const std::vector<PTYPE>& dest, const std::vector<PTYPE>& prev) :
+OpPathwayBase(1, op.info(), op), _sites(&locs[0], &dest[0], locs.size()) {
+	Fingerprint f = op.fingerprint();
+	f ^= _sites.fingerprintDelta(&locs[0], &prev[0], locs.size());
+	setFingerprint(f);
 }
 
 PromoterData* BindingSiteChange::evaluate() {
@@ -167,48 +188,57 @@ PromoterData* BindingSiteChange::evaluate() {
 	if (sd != NULL) return sd;
 	
 	// Get the sequence from the parent and add the point changes
-	sd = parent(0)->evaluate();
+	DataView<PromoterData> p1( parent(0)->evaluate() ), p2;
+	return replay( p1, p2 );
+}
+
+PromoterData* BindingSiteChange::replay(DataView<PromoterData>& p1, DataView<PromoterData>&) {
+	// The changes are written over the parent's promoters
+	PromoterData* sd = p1.release();
 	
-	vector<int>::iterator it_loc = _locs->begin();
-	vector<PTYPE>::iterator it_c = _c->begin();
-	while (it_loc != _locs->end() ) {
-		sd->set( *it_loc, *it_c);
-		it_loc++; it_c++;
+	// Only this operation's own work is timed
+	CostTimer timer( costClass() );
+	int n = _sites.size();
+	vector<int> locs(n);
+	vector<PTYPE> c(n);
+	if (n > 0) _sites.decode(&locs[0], &c[0]);
+	for (int i=0; i<n; i++) {
+		sd->set( locs[i], c[i] );
 	}
 	return sd;
 }
 
 std::string BindingSiteChange::toString() const {
 	std::ostringstream output;
-	for (int i=0; i<numSites(); i++) {
-		output << getSite(i) << "->" << getMutation(i);
-		if (i < numSites()-1) output << ", ";
+	int n = numSites();
+	vector<int> locs(n);
+	vector<PTYPE> c(n);
+	if (n > 0) _sites.decode(&locs[0], &c[0]);
+	for (int i=0; i<n; i++) {
+		output << locs[i] << "->" << c[i];
+		if (i < n-1) output << ", ";
 	}
 	return output.str();
 }
 
-int BindingSiteChange::numSites() const { return _locs->size(); }
+int BindingSiteChange::numSites() const { return _sites.size(); }
 
-PTYPE BindingSiteChange::getMutation(int i) const { return (*_c)[i]; }
+PTYPE BindingSiteChange::getMutation(int i) const { return _sites.symbol(i); }
 
-int BindingSiteChange::getSite(int i) const { return (*_locs)[i]; }
+int BindingSiteChange::getSite(int i) const { return _sites.site(i); }
 
 
 PTYPE BindingSiteChange::proxyGet(int l)  {
 	// See if the index is in the list
-	vector<int>::iterator it_loc = _locs->begin();
-	vector<PTYPE>::iterator it_c = _c->begin();
-	while (it_loc != _locs->end() ) {
-		if (*it_loc == l) return *it_c;
-		it_loc++; it_c++;
-	}
+	PTYPE c;
+	if (_sites.find(l, c)) return c;
 	return parent(0)->get(l);
 }
 
 
 
 BindingSiteMutator::BindingSiteMutator( double cost, double u, int motifOverlap, const vector<double>& motifGainRates, const vector<double>& motifProbLoss) :
-OperationMutator< OpPathway >(cost), _u(u), _overlap(motifOverlap), _gainRates(motifGainRates), _lossProb(motifProbLoss) {
+OperationMutator< OpPathway >(cost, "BindingSiteChange"), _u(u), _overlap(motifOverlap), _gainRates(motifGainRates), _lossProb(motifProbLoss) {
 	
 	
 }
@@ -219,8 +249,9 @@ BindingSiteMutator::~BindingSiteMutator() {
 
 
 OpPathway* BindingSiteMutator::mutate( OpPathway& g ) const {
-	bool isCompressed = g.isCompressed();
-	if( isCompressed ) g.setCompressed(false);
+	// Read the sites through a view rather than toggling the cache of g
+	DataView<PromoterData> pd = g.view();
+	int numReads = 0;
 	
 	int totalRegions = g.totalRegions();
 	int numMotifs = g.numMotifs();
@@ -228,8 +259,8 @@ OpPathway* BindingSiteMutator::mutate( OpPathway& g ) const {
 	// Calculate the losses
 	int numLosses = binomial( totalRegions, _u );
 	int loc, minSite, maxSite;
-	vector<int>* locs = new vector<int>();
-	vector<PTYPE>* sites = new vector<PTYPE>();
+	vector<int> locs;
+	vector<PTYPE> sites, prev;
 	
 	PTYPE c;
 	int g_i, g_offset, g_numRegions;
@@ -245,11 +276,13 @@ OpPathway* BindingSiteMutator::mutate( OpPathway& g ) const {
 			if (maxSite > g_offset+g_numRegions) maxSite = g_offset+g_numRegions;
 		}
 		for (int site_i=minSite; site_i<maxSite+1; site_i++) {
-			c = g.get( site_i );
+			c = pd->get( site_i );
+			numReads++;
 			if (c>0 && random01() <= _lossProb[c]) {
 				// Save site_i, ->0
-				sites->push_back((PTYPE)0);
-				locs->push_back(site_i);
+				sites.push_back((PTYPE)0);
+				prev.push_back(c);
+				locs.push_back(site_i);
 			}
 		}
 	}
@@ -259,26 +292,26 @@ OpPathway* BindingSiteMutator::mutate( OpPathway& g ) const {
 		numGains = binomial( totalRegions, _gainRates[i] );
 		for (int j=0; j<numGains; j++) {
 			loc = (int)(random01()*totalRegions);
-			c = g.get( loc );
+			c = pd->get( loc );
+			numReads++;
 			if (c != (PTYPE)i) {
 				// Save loc, ->i
-				sites->push_back((PTYPE)i);
-				locs->push_back(loc);
+				sites.push_back((PTYPE)i);
+				prev.push_back(c);
+				locs.push_back(loc);
 			}
 		}
 	}
 	
-	if( isCompressed )  g.setCompressed(true); 
+	// Account for the reads as if they went through g.get()
+	g.incrRequests( numReads );
 	
-	if( sites->size() == 0) {
-		delete locs;
-		delete sites;
-		return &g;
-	}
+	if( sites.size() == 0) return &g;
 	
 	// Create mutation
-	BindingSiteChange* bsc = new BindingSiteChange(g, locs, sites);
+	BindingSiteChange* bsc = new BindingSiteChange(g, locs, sites, prev);
 	bsc->setCost( cost() );
+	bsc->setCostClass( costClass() );
 	return bsc;
 }
 
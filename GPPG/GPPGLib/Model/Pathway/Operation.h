@@ -12,6 +12,7 @@
 
 #include <Operation/Operation.h>
 #include <Model/Pathway/Data.h>
+#include <Util/SitePayload.h>
 
 namespace GPPG {
 	namespace Model {
@@ -37,11 +38,15 @@ namespace GPPG {
 				
 				const GlobalInfo& info() const;
 				
-				const char* exportFormat();
+				std::string exportFormat();
+				std::string exportData(const PromoterData& d);
 				
 			protected:
 				virtual PTYPE proxyGet(int i)  = 0;
 				
+				void encodeData(const PromoterData& d, std::vector<unsigned char>& out) const;
+				PromoterData* decodeData(const std::vector<unsigned char>& in) const;
+				
 				const GlobalInfo& _info;
 			};
 			
@@ -77,13 +82,15 @@ namespace GPPG {
 			
 			class BindingSiteChange : public OpPathwayBase {
 			public:
-				BindingSiteChange(OpPathway& op, std::vector<int>* locs, std::vector<PTYPE>* dest);
-				
-				~BindingSiteChange(); 
+				/** Changes the sites \param locs from the motifs \param prev (of \param op) to \param dest.
+				 * The sites are copied into a compact payload; a site listed twice keeps its last motif.
+				 */
+				BindingSiteChange(OpPathway& op, const std::vector<int>& locs, const std::vector<PTYPE>& dest, const std::vector<PTYPE>& prev);
 				
 				std::string toString() const;
 				
 				PromoterData* evaluate();
+				PromoterData* replay(DataView<PromoterData>& p1, DataView<PromoterData>& p2);
 				
 				/** Get the number of mutated sites
 				 */
@@ -102,8 +109,7 @@ namespace GPPG {
 				PTYPE proxyGet(int i) ;
 				
 			private:
-				std::vector<int>* _locs;		/* Locations array */
-				std::vector<PTYPE>* _c;		/* Characters to be changed to */
+				SitePayload _sites;	/* Sorted sites and the motifs they change to */
 				
 			};
 			
@@ -8,8 +8,12 @@
  */
 
 #include "Model/Sequence/Data.h"
+#include "Util/BitPack.h"
+#include "Util/BufferPool.h"
+#include <cstring>
 #include <iostream>
 
+using namespace GPPG;
 using namespace GPPG::Model;
 
 
@@ -21,15 +25,17 @@ SequenceData* SequenceData::copy() const
 }
 
 SequenceData::SequenceData(int length) : _length(length) {
-	_sequence = (STYPE*)malloc(sizeof(STYPE)*_length);
+	_sequence = (STYPE*)BufferPool::instance().allocate(sizeof(STYPE)*_length);
 }
 
 SequenceData::~SequenceData() { 
-	delete _sequence;
+	BufferPool::instance().release(_sequence, sizeof(STYPE)*_length);
 }
 
 STYPE* SequenceData::sequence() { return _sequence; }
 
+const STYPE* SequenceData::sequence() const { return _sequence; }
+
 int SequenceData::length() const { return _length; }
 
 STYPE SequenceData::get(int i)  { return _sequence[i]; }
@@ -38,3 +44,11 @@ STYPE SequenceData::get(int i) const { return _sequence[i]; }
 
 void SequenceData::set(int i, STYPE c) { _sequence[i] = c; }
 
+
+void SequenceData::encode(std::vector<unsigned char>& out) const {
+	packSymbols( (const unsigned short*)_sequence, _length, out );
+}
+
+void SequenceData::decode(const std::vector<unsigned char>& in) {
+	unpackSymbols( in, (unsigned short*)_sequence, _length );
+}
@@ -10,6 +10,8 @@
 #ifndef SEQUENCE_DATA_
 #define SEQUENCE_DATA_
 
+#include <vector>
+
 namespace GPPG {
 	
 	namespace Model {
@@ -17,6 +19,8 @@ namespace GPPG {
 		
 		class ISequence {
 		public:
+			virtual ~ISequence() {}
+
 			/** Retrieve the length of the sequence.
 			 */
 			virtual int length() const = 0;
@@ -28,6 +32,7 @@ namespace GPPG {
 		
 		/**
 		 * A simple data structure for holding sequence information.
+		 * The sequence buffer is drawn from (and returned to) the BufferPool.
 		 */
 		class SequenceData : ISequence {
 		public:
@@ -45,6 +50,7 @@ namespace GPPG {
 			/** Get a pointer to the raw sequence data.
 			 */
 			STYPE* sequence();
+			const STYPE* sequence() const;
 			
 			int length() const;
 			
@@ -58,6 +64,14 @@ namespace GPPG {
 			 */
 			void set(int i, STYPE c);
 			
+			/** Writes the packed (see BitPack.h) sequence to \param out.
+			 */
+			void encode(std::vector<unsigned char>& out) const;
+			
+			/** Reads the sequence back from \param in; the length must match.
+			 */
+			void decode(const std::vector<unsigned char>& in);
+			
 		private:
 			STYPE* _sequence;
 			int _length;
@@ -0,0 +1,195 @@
+/*
+ *  Diff.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "Model/Sequence/Diff.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace GPPG;
+using namespace GPPG::Model;
+
+SequenceDiff::SequenceDiff(DataView<SequenceData> const& root) : _root(root), _length(root->length()) {
+	Piece p = { 0, 0, false };
+	_pieces.push_back(p);
+}
+
+SequenceDiff* SequenceDiff::copy() const { return new SequenceDiff(*this); }
+
+int SequenceDiff::length() const { return _length; }
+
+bool SequenceDiff::sameRoot(const SequenceDiff& d) const { return _root.get() == d._root.get(); }
+
+int SequenceDiff::numSites() const { return _sites.size(); }
+
+int SequenceDiff::numPieces() const { return _pieces.size(); }
+
+size_t SequenceDiff::memoryBytes() const {
+	return sizeof(SequenceDiff) + _pieces.capacity()*sizeof(Piece) + _added.capacity()*sizeof(STYPE)
+		+ _sites.capacity()*sizeof(int) + _symbols.capacity()*sizeof(STYPE);
+}
+
+int SequenceDiff::pieceAt(int i) const {
+	// Last piece starting at or before i
+	int lo = 0, hi = _pieces.size()-1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) >> 1;
+		if (_pieces[mid].start <= i) lo = mid;
+		else hi = mid-1;
+	}
+	return lo;
+}
+
+int SequenceDiff::pieceEnd(int p) const {
+	return (p+1 < (int)_pieces.size()) ? _pieces[p+1].start : _length;
+}
+
+int SequenceDiff::split(int i) {
+	// Makes a piece start at i and returns its index
+	if (i >= _length) return _pieces.size();
+	int p = pieceAt(i);
+	if (_pieces[p].start == i) return p;
+	Piece q = _pieces[p];
+	q.src += i - q.start;
+	q.start = i;
+	_pieces.insert(_pieces.begin()+p+1, q);
+	return p+1;
+}
+
+STYPE SequenceDiff::base(int i) const {
+	const Piece& p = _pieces[pieceAt(i)];
+	int src = p.src + (i - p.start);
+	return p.added ? _added[src] : _root->get(src);
+}
+
+STYPE SequenceDiff::get(int i) const {
+	std::vector<int>::const_iterator it = std::lower_bound(_sites.begin(), _sites.end(), i);
+	if (it != _sites.end() && *it == i) return _symbols[it - _sites.begin()];
+	return base(i);
+}
+
+void SequenceDiff::setSites(const int* sites, const unsigned short* symbols, int n) {
+	// Merge both sorted lists; new characters win, and changes back to the base are dropped
+	std::vector<int> mergedSites;
+	std::vector<STYPE> mergedSymbols;
+	mergedSites.reserve(_sites.size() + n);
+	mergedSymbols.reserve(_sites.size() + n);
+	
+	int i = 0, j = 0;
+	while (i < (int)_sites.size() || j < n) {
+		if (j == n || (i < (int)_sites.size() && _sites[i] < sites[j])) {
+			mergedSites.push_back(_sites[i]);
+			mergedSymbols.push_back(_symbols[i]);
+			i++;
+			continue;
+		}
+		if (i < (int)_sites.size() && _sites[i] == sites[j]) i++;
+		STYPE c = (STYPE)symbols[j];
+		if (c != base(sites[j])) {
+			mergedSites.push_back(sites[j]);
+			mergedSymbols.push_back(c);
+		}
+		j++;
+	}
+	_sites.swap(mergedSites);
+	_symbols.swap(mergedSymbols);
+}
+
+void SequenceDiff::erase(int loc, int span) {
+	if (span <= 0) return;
+	int end = loc + span;
+	
+	// Drop the sites in the span and shift the rest
+	std::vector<int>::iterator first = std::lower_bound(_sites.begin(), _sites.end(), loc);
+	std::vector<int>::iterator last = std::lower_bound(first, _sites.end(), end);
+	int a = first - _sites.begin(), b = last - _sites.begin();
+	_sites.erase(first, last);
+	_symbols.erase(_symbols.begin()+a, _symbols.begin()+b);
+	for (int k=a; k<(int)_sites.size(); k++) _sites[k] -= span;
+	
+	int p = split(loc);
+	int q = split(end);
+	_pieces.erase(_pieces.begin()+p, _pieces.begin()+q);
+	for (int k=p; k<(int)_pieces.size(); k++) _pieces[k].start -= span;
+	_length -= span;
+	
+	if (_pieces.size() == 0) {
+		// Keep one (empty) piece so lookups stay valid
+		Piece e = { 0, 0, true };
+		_pieces.push_back(e);
+	}
+}
+
+void SequenceDiff::insert(int loc, const STYPE* s, int n) {
+	if (n <= 0) return;
+	
+	std::vector<int>::iterator first = std::lower_bound(_sites.begin(), _sites.end(), loc);
+	for (std::vector<int>::iterator it=first; it!=_sites.end(); it++) *it += n;
+	
+	int p = split(loc);
+	for (int k=p; k<(int)_pieces.size(); k++) _pieces[k].start += n;
+	
+	Piece piece = { loc, (int)_added.size(), true };
+	_pieces.insert(_pieces.begin()+p, piece);
+	_added.insert(_added.end(), s, s+n);
+	_length += n;
+}
+
+void SequenceDiff::copyRange(const SequenceDiff& other, int a, int b) {
+	if (b > _length) b = _length;
+	if (a >= b) return;
+	
+	// Sites: ours outside [a,b), theirs inside
+	std::vector<int>::iterator first = std::lower_bound(_sites.begin(), _sites.end(), a);
+	std::vector<int>::iterator last = std::lower_bound(first, _sites.end(), b);
+	int i = first - _sites.begin(), j = last - _sites.begin();
+	std::vector<int>::const_iterator ofirst = std::lower_bound(other._sites.begin(), other._sites.end(), a);
+	std::vector<int>::const_iterator olast = std::lower_bound(ofirst, other._sites.end(), b);
+	int oi = ofirst - other._sites.begin(), oj = olast - other._sites.begin();
+	_sites.erase(first, last);
+	_sites.insert(_sites.begin()+i, ofirst, olast);
+	_symbols.erase(_symbols.begin()+i, _symbols.begin()+j);
+	_symbols.insert(_symbols.begin()+i, other._symbols.begin()+oi, other._symbols.begin()+oj);
+	
+	// Pieces: replace ours in [a,b) by theirs, clipped to [a,b)
+	int p = split(a);
+	int q = split(b);
+	std::vector<Piece> pieces;
+	for (int k=other.pieceAt(a); k<(int)other._pieces.size() && other._pieces[k].start < b; k++) {
+		Piece piece = other._pieces[k];
+		int start = std::max(piece.start, a);
+		int end = std::min(other.pieceEnd(k), b);
+		if (start >= end) continue;
+		piece.src += start - piece.start;
+		piece.start = start;
+		if (piece.added) {
+			// Insertions are copied into our own buffer
+			int offset = _added.size();
+			_added.insert(_added.end(), other._added.begin()+piece.src, other._added.begin()+piece.src+(end-start));
+			piece.src = offset;
+		}
+		pieces.push_back(piece);
+	}
+	_pieces.erase(_pieces.begin()+p, _pieces.begin()+q);
+	_pieces.insert(_pieces.begin()+p, pieces.begin(), pieces.end());
+}
+
+SequenceData* SequenceDiff::materialize() const {
+	SequenceData* data = new SequenceData(_length);
+	STYPE* out = data->sequence();
+	const STYPE* root = _root->sequence();
+	
+	for (int k=0; k<(int)_pieces.size(); k++) {
+		const Piece& p = _pieces[k];
+		int len = pieceEnd(k) - p.start;
+		if (len <= 0) continue;
+		const STYPE* src = p.added ? &_added[p.src] : &root[p.src];
+		memcpy(&out[p.start], src, sizeof(STYPE)*len);
+	}
+	for (int k=0; k<(int)_sites.size(); k++) out[_sites[k]] = _symbols[k];
+	return data;
+}
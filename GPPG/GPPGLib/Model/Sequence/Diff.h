@@ -0,0 +1,98 @@
+/*
+ *  Diff.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef SEQUENCE_DIFF_
+#define SEQUENCE_DIFF_
+
+#include <Model/Sequence/Data.h>
+#include <Operation/DataView.h>
+#include <cstddef>
+#include <vector>
+
+namespace GPPG {
+	
+	namespace Model {
+		
+		/**
+		 * A sequence stored as its difference to a shared root sequence.
+		 * The layout follows a piece table: the sequence is a list of pieces, each a run of either the root
+		 * or an insertion buffer, so indels only split pieces.  Substitutions are kept apart as a sorted list
+		 * of (site, character) pairs on top of the pieces.  A genotype a few hundred changes away from the
+		 * root then costs a few kilobytes instead of a full sequence.
+		 */
+		class SequenceDiff {
+		public:
+			/** Creates the identity diff over \param root.
+			 */
+			SequenceDiff(DataView<SequenceData> const& root);
+			
+			/** Deep-copy (the root stays shared)
+			 */
+			SequenceDiff* copy() const;
+			
+			int length() const;
+			
+			/** Gets the item at location i
+			 */
+			STYPE get(int i) const;
+			
+			/** True if \param d is a diff over the same root.
+			 */
+			bool sameRoot(const SequenceDiff& d) const;
+			
+			/** Sets \param n sorted, unique \param sites to \param symbols.
+			 */
+			void setSites(const int* sites, const unsigned short* symbols, int n);
+			
+			/** Removes \param span items starting at \param loc.
+			 */
+			void erase(int loc, int span);
+			
+			/** Inserts the \param n items of \param s before \param loc.
+			 */
+			void insert(int loc, const STYPE* s, int n);
+			
+			/** Replaces the range [\param a, \param b) with the same range of \param other.
+			 * Both diffs must share their root.
+			 */
+			void copyRange(const SequenceDiff& other, int a, int b);
+			
+			int numSites() const;
+			int numPieces() const;
+			
+			/** Bytes held by this diff (excluding the root).
+			 */
+			size_t memoryBytes() const;
+			
+			/** Writes out the full sequence.
+			 */
+			SequenceData* materialize() const;
+			
+		private:
+			struct Piece {
+				int start;		/* Offset in this sequence */
+				int src;		/* Offset in the root or in the insertion buffer */
+				bool added;		/* True if the piece comes from the insertion buffer */
+			};
+			
+			int pieceAt(int i) const;
+			int pieceEnd(int p) const;
+			int split(int i);
+			STYPE base(int i) const;
+			
+			DataView<SequenceData> _root;
+			std::vector<Piece> _pieces;
+			std::vector<STYPE> _added;		/* Insertion buffer */
+			std::vector<int> _sites;		/* Sorted substituted sites */
+			std::vector<STYPE> _symbols;	/* Characters at _sites */
+			int _length;
+		};
+	}
+}
+
+#endif
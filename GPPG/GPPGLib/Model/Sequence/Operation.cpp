@@ -9,6 +9,8 @@
 
 #include "GPPG.h"
 #include "Operation.h"
+#include "Model/Sequence/ReplayProgram.h"
+#include "Util/BitPack.h"
 #include "Util/Random.h"
 //#include <boost/random/mersenne_twister.hpp>
 //#include <boost/random/discrete_distribution.hpp>
@@ -28,34 +30,191 @@ using namespace GPPG;
  *				OPSEQUENCEBASE OPERATION
  */
 
+/* A diff is kept only while it is smaller than this fraction of the full sequence */
+#define DIFF_MAX_FRACTION 4
+
+bool OpSequenceBase::_diffCache = false;
+int OpSequenceBase::_programsAfter = 0;
+
 OpSequenceBase::OpSequenceBase( int cost, int length, OpSequence& parent1 ):
-OpSequence(cost, parent1), _length(length) {}
+OpSequence(cost, parent1), _length(length), _diff(0), _replays(0) {}
 
 OpSequenceBase::OpSequenceBase( int cost, int length, OpSequence& parent1, OpSequence& parent2 ):
-OpSequence(cost, parent1, parent2), _length(length) {}
+OpSequence(cost, parent1, parent2), _length(length), _diff(0), _replays(0) {}
+
+OpSequenceBase::~OpSequenceBase() { delete _diff; }
 
 int OpSequenceBase::length() const { return _length; }
 
 STYPE OpSequenceBase::get(int i) {
 	incrRequests(1);
-	if (isCompressed()) {
-		return proxyGet(i);
+	// Each form is picked up once: one dropped meanwhile is retired, not freed, while a reader is pinned
+	SequenceDiff* diff = _diff;
+	if (diff) {
+		return diff->get(i);
+	}
+	const std::vector<unsigned char>* blob = encoded();
+	if (blob) {
+		return (STYPE)unpackSymbol(*blob, i);
+	}
+	SequenceData* d = data();
+	if (d) {
+		return d->get(i);
+	}
+	return proxyGet(i);
+}
+
+void OpSequenceBase::setDiffCache(bool b) { _diffCache = b; }
+
+bool OpSequenceBase::diffCache() { return _diffCache; }
+
+void OpSequenceBase::setReplayPrograms(int n) { _programsAfter = n; }
+
+int OpSequenceBase::replayPrograms() { return _programsAfter; }
+
+int OpSequenceBase::host() const { return 0; }
+
+bool OpSequenceBase::isCompressed() const { return _diff == 0 && OpSequence::isCompressed(); }
+
+bool OpSequenceBase::isMaterialized() const {
+	{
+		ScopedLock lock( _caches );
+		if (_diff) return true;
+	}
+	return OpSequence::isMaterialized();
+}
+
+void OpSequenceBase::setCompressed(bool compress) {
+	if (compress) {
+		dropDiff();
+		OpSequence::setCompressed(true);
+		return;
+	}
+	if (!_diffCache || !isCompressed()) {
+		OpSequence::setCompressed(false);
+		return;
+	}
+	
+	BaseOperation::setCompressed(false);
+	SequenceDiff* diff = evaluateDiff();
+	OpSequence::setEncoded(false);
+	if (diff && diff->memoryBytes() > sizeof(STYPE)*_length/DIFF_MAX_FRACTION) {
+		delete diff;
+		diff = 0;
+	}
+	if (diff) {
+		ScopedLock lock( _caches );
+		_diff = diff;
+	}
+	// Fall back to the full sequence
+	if (!_diff) OpSequence::setCompressed(false);
+}
+
+void OpSequenceBase::dropDiff() {
+	SequenceDiff* diff = _diff;
+	{
+		ScopedLock lock( _caches );
+		_diff = 0;
+	}
+	retire( diff );
+}
+
+void OpSequenceBase::prepareCache() {
+	if (!_diffCache) OpSequence::prepareCache();
+}
+
+void OpSequenceBase::uncompressByReplay() {
+	if (_diffCache) setCompressed(false);
+	else OpSequence::uncompressByReplay();
+}
+
+void OpSequenceBase::encodeData(const SequenceData& d, std::vector<unsigned char>& out) const { d.encode(out); }
+
+SequenceData* OpSequenceBase::decodeData(const std::vector<unsigned char>& in) const {
+	SequenceData* d = new SequenceData(_length);
+	d->decode(in);
+	return d;
+}
+
+SequenceData* OpSequenceBase::evaluate() {
+	{
+		ScopedLock lock( _caches );
+		if (_diff) {
+			incrRequests(1);
+			return _diff->materialize();
+		}
+	}
+	SequenceData* sd = OpSequence::evaluate();
+	if (sd != NULL || _programsAfter <= 0) return sd;
+	
+	DataView<ReplayProgram> program = compiled();
+	return program.isNull() ? NULL : program->run();
+}
+
+DataView<ReplayProgram> OpSequenceBase::compiled() {
+	DataView<ReplayProgram> program, old;
+	{
+		ScopedLock lock( _caches );
+		program = _program;
+	}
+	if (!program.isNull() && program->isCurrent()) return program;
+	// Only hot operations are compiled; once hot, an out of date program is compiled again
+	if (program.isNull() && atomicAdd( &_replays, 1 ) < _programsAfter) return program;
+	
+	program = DataView<ReplayProgram>( ReplayProgram::compile( this ) );
+	{
+		ScopedLock lock( _caches );
+		old = _program;
+		_program = program;
+	}
+	// The old program is dropped outside the lock
+	return program;
+}
+
+SequenceDiff* OpSequenceBase::evaluateDiff() {
+	incrRequests(1);
+	{
+		ScopedLock lock( _caches );
+		if (_diff) return _diff->copy();
 	}
-	return data()->get(i);
+	if (!OpSequence::isCompressed()) return NULL;
+	return proxyDiff();
+}
+
+SequenceDiff* OpSequenceBase::diffOf(OpSequence* op) {
+	OpSequenceBase* base = dynamic_cast<OpSequenceBase*>(op);
+	if (base) return base->evaluateDiff();
+	// Roots are the base of all diffs
+	if (op->numParents() == 0) return new SequenceDiff( op->view() );
+	return NULL;
 }
 
-const char* OpSequenceBase::exportFormat() {
+std::string OpSequenceBase::exportFormat() {
+	DataView<SequenceData> sd = view();
+	return exportData( *sd );
+}
+
+std::string OpSequenceBase::exportData(const SequenceData& sd) {
 	std::stringstream output;
 	const char* alpha = "ACTG";
-	SequenceData* sd = evaluate();
 	for(int i=0; i<length(); i++) {
-		output << alpha[sd->get(i)];
+		output << alpha[sd.get(i)];
 	}
 	
-	return output.str().c_str();
+	return output.str();
 }
 
-SequenceRoot::SequenceRoot(SequenceData* d) : OperationRoot<SequenceData, ISequence>(d) { setCost(1); }
+/* Tags mixed into the fingerprints of operations that move sites */
+#define FP_DELETION 1
+#define FP_INSERTION 2
+#define FP_CROSSOVER 3
+
+SequenceRoot::SequenceRoot(SequenceData* d) : OperationRoot<SequenceData, ISequence>(d) {
+	setCost(1);
+	Fingerprint f;
+	for (int i=0; i<d->length(); i++) f ^= siteFingerprint(i, d->get(i));
+	setFingerprint(f);
+}
 
 int SequenceRoot::length() const { return data()->length(); }
 STYPE SequenceRoot::get(int i) { incrRequests(1); return data()->get(i); }
@@ -97,50 +256,115 @@ SequenceRoot* SequenceRootFactory::random() const {
 
 
 
-SequencePointChange::SequencePointChange(OpSequence& op, int* locs, int numLocs, STYPE* dest) : 
-OpSequenceBase(numLocs,op.length(), op), _loc(locs), _numlocs(numLocs), _c(dest) {}
+/* Point changes usually touch a handful of sites, so decode into the stack when possible */
+#define SITE_STACK 32
+
+static const unsigned short* toSymbols(const STYPE* dest, int n, std::vector<unsigned short>& buf) {
+	buf.resize(n);
+	for (int i=0; i<n; i++) buf[i] = (unsigned short)dest[i];
+	return n > 0 ? &buf[0] : NULL;
+}
 
-SequencePointChange::~SequencePointChange() { delete _loc; delete _c; }
+SequencePointChange::SequencePointChange(OpSequence& op, const int* locs, int numLocs, const STYPE* dest, const STYPE* prev) : 
+OpSequenceBase(numLocs,op.length(), op) {
+	std::vector<unsigned short> symbols;
+	_sites = SitePayload(locs, toSymbols(dest, numLocs, symbols), numLocs);
+	
+	// Swap the parent's character for the final one at each site
+	std::vector<unsigned short> before;
+	Fingerprint f = op.fingerprint();
+	f ^= _sites.fingerprintDelta(locs, toSymbols(prev, numLocs, before), numLocs);
+	setFingerprint(f);
+}
 
 SequenceData* SequencePointChange::evaluate()  {
 	SequenceData* sd = OpSequenceBase::evaluate();
 	if (sd != NULL) return sd;
 	
 	// Get the sequence from the parent and add the point changes
-	sd = parent(0)->evaluate();
+	DataView<SequenceData> p1( parent(0)->evaluate() ), p2;
+	return replay( p1, p2 );
+}
+
+SequenceData* SequencePointChange::replay(DataView<SequenceData>& p1, DataView<SequenceData>&) {
+	// The changes are written over the parent's sequence
+	SequenceData* sd = p1.release();
+	
+	// Only this operation's own work is timed
+	CostTimer timer( costClass() );
+	int n = _sites.size();
+	int stackLocs[SITE_STACK];
+	unsigned short stackSyms[SITE_STACK];
+	std::vector<int> heapLocs;
+	std::vector<unsigned short> heapSyms;
+	int* locs = stackLocs;
+	unsigned short* syms = stackSyms;
+	if (n > SITE_STACK) {
+		heapLocs.resize(n);
+		heapSyms.resize(n);
+		locs = &heapLocs[0];
+		syms = &heapSyms[0];
+	}
+	_sites.decode(locs, syms);
 	
-	for (int i=0; i<_numlocs; i++) {
-		sd->set(_loc[i], _c[i]);
+	STYPE* data = sd->sequence();
+	for (int i=0; i<n; i++) {
+		data[locs[i]] = (STYPE)syms[i];
 	}
 	return sd;
 }
 
 std::string SequencePointChange::toString() const {
 	std::ostringstream output;
-	for (int i=0; i<numSites(); i++) {
-		output << getSite(i) << "->" << getMutation(i);
-		if (i < numSites()-1) output << ", ";
+	int n = numSites();
+	std::vector<int> locs(n);
+	std::vector<unsigned short> syms(n);
+	if (n > 0) _sites.decode(&locs[0], &syms[0]);
+	for (int i=0; i<n; i++) {
+		output << locs[i] << "->" << syms[i];
+		if (i < n-1) output << ", ";
 	}
 	return output.str();
 }
 
-int SequencePointChange::numSites() const { return _numlocs; }
+int SequencePointChange::numSites() const { return _sites.size(); }
 
-STYPE SequencePointChange::getMutation(int i) const { return _c[i]; }
+void SequencePointChange::compile(ReplayProgram& program) {
+	int n = _sites.size();
+	std::vector<int> locs(n);
+	std::vector<unsigned short> syms(n);
+	if (n > 0) _sites.decode(&locs[0], &syms[0]);
+	program.setSites(n > 0 ? &locs[0] : NULL, n > 0 ? &syms[0] : NULL, n);
+}
 
-int SequencePointChange::getSite(int i) const { return _loc[i]; }
+STYPE SequencePointChange::getMutation(int i) const { return (STYPE)_sites.symbol(i); }
 
+int SequencePointChange::getSite(int i) const { return _sites.site(i); }
+
+
+SequenceDiff* SequencePointChange::proxyDiff() {
+	SequenceDiff* d = diffOf(parent(0));
+	if (!d) return NULL;
+	
+	int n = _sites.size();
+	std::vector<int> locs(n);
+	std::vector<unsigned short> syms(n);
+	if (n > 0) {
+		_sites.decode(&locs[0], &syms[0]);
+		d->setSites(&locs[0], &syms[0], n);
+	}
+	return d;
+}
 
 STYPE SequencePointChange::proxyGet(int l)  {
 	// See if the index is in the list
-	for (int i=0; i<_numlocs; i++) {
-		if (_loc[i] == l) return _c[i];
-	}
+	unsigned short c;
+	if (_sites.find(l, c)) return (STYPE)c;
 	return parent(0)->get(l);
 }
 
 SequencePointMutator::SequencePointMutator(int cost, double rate, const std::vector<double> &T) : 
-OperationMutator<OpSequence>(cost), _rate(rate), _M(T) {
+OperationMutator<OpSequence>(cost, "SequencePointChange"), _rate(rate), _M(T) {
 	// Create random discrete distributions for each character
 	int size = _M.size() >> 2;
 	
@@ -174,22 +398,24 @@ OpSequence* SequencePointMutator::mutate( OpSequence& g) const {
 	std::cout << "SequencePointMutator: mutating..." << std::endl;
 #endif
 	
-	int* locs = (int*) malloc(sizeof(int)*numLocs);
-	STYPE* dest = (STYPE*) malloc(sizeof(STYPE)*numLocs);
+	std::vector<int> locs(numLocs);
+	std::vector<STYPE> dest(numLocs), prev(numLocs);
 	for (int i=0; i<numLocs; i++) {
 		int loc = (int)(random01()*length);
 		STYPE c = g.get(loc); //data->get(loc);
 		locs[i] = loc;
+		prev[i] = c;
 		dest[i] = (STYPE)( discreteDistributionRandom(_transition[c]) );
 		
 	}
-	SequencePointChange* spc = new SequencePointChange(g, locs, numLocs, dest);
+	SequencePointChange* spc = new SequencePointChange(g, &locs[0], numLocs, &dest[0], &prev[0]);
 	
 #ifdef DEBUG_0
 	std::cout << "Created Operation (" << spc->numParents() << "): " << spc->toString() << std::endl;
 #endif
 	//if (isCopy) delete data;
 	spc->setCost( cost() );
+	spc->setCostClass( costClass() );
 	return spc;
 }
 
@@ -207,29 +433,42 @@ ostream& operator<<(ostream& output, const SequencePointMutator& s) {
 }
 
 
-SequenceDeletion::SequenceDeletion(OpSequence& op, int loc, int span): OpSequenceBase(10, op.length()-span, op), _loc(loc), _span(span) {}
+SequenceDeletion::SequenceDeletion(OpSequence& op, int loc, int span): OpSequenceBase(10, op.length()-span, op), _loc(loc), _span(span) {
+	Fingerprint f = mixFingerprint( op.fingerprint(), FP_DELETION );
+	f = mixFingerprint( f, loc );
+	setFingerprint( mixFingerprint(f, span) );
+}
 
 SequenceData* SequenceDeletion::evaluate() {
 	SequenceData* sd = OpSequenceBase::evaluate();
 	if (sd != NULL) return sd;
 	
-	// Get the sequence from the parent and add the point changes
-	sd = parent(0)->evaluate();
-	
-	
+	// Read the parent without copying it; the deletion is written into a new sequence
+	DataView<SequenceData> p1 = parent(0)->view(), p2;
+	return replay( p1, p2 );
+}
+
+SequenceData* SequenceDeletion::replay(DataView<SequenceData>& p1, DataView<SequenceData>&) {
+	CostTimer timer( costClass() );
 	SequenceData* data = new SequenceData( length() );
 	
 	STYPE* sdata = data->sequence();
-	STYPE* pdata = sd->sequence();
+	const STYPE* pdata = p1->sequence();
 	if (_loc > 0) 
 		memcpy(sdata, pdata, sizeof(STYPE)*_loc);
 	memcpy(&sdata[_loc], &pdata[_loc+_span] , sizeof(STYPE)*(length()-_loc));
-
-	delete sd;
 	
 	return data;
 }
 
+void SequenceDeletion::compile(ReplayProgram& program) { program.deleteRange(_loc, _span); }
+
+SequenceDiff* SequenceDeletion::proxyDiff() {
+	SequenceDiff* d = diffOf(parent(0));
+	if (d) d->erase(_loc, _span);
+	return d;
+}
+
 STYPE SequenceDeletion::proxyGet(int i)  {
 	// See if the index is in the list
 	if (i >= _loc) {
@@ -246,7 +485,13 @@ std::string SequenceDeletion::toString() const {
 }
 
 SequenceInsertion::SequenceInsertion(OpSequence& op, int loc, SequenceData* span): 
-	OpSequenceBase(10, op.length()+span->length(), op), _loc(loc), _span(span) {}
+	OpSequenceBase(10, op.length()+span->length(), op), _loc(loc), _span(span) {
+	Fingerprint f = mixFingerprint( op.fingerprint(), FP_INSERTION );
+	f = mixFingerprint( f, loc );
+	Fingerprint content;
+	for (int i=0; i<span->length(); i++) content ^= siteFingerprint(i, span->get(i));
+	setFingerprint( mixFingerprint(f, content) );
+}
 
 SequenceInsertion::~SequenceInsertion() { delete _span; }
 
@@ -254,26 +499,36 @@ SequenceData* SequenceInsertion::evaluate() {
 	SequenceData* sd = OpSequenceBase::evaluate();
 	if (sd != NULL) return sd;
 	
-	// Get the sequence from the parent and add the point changes
-	sd = parent(0)->evaluate();
-	
-	
+	// Read the parent without copying it; the insertion is written into a new sequence
+	DataView<SequenceData> p1 = parent(0)->view(), p2;
+	return replay( p1, p2 );
+}
+
+SequenceData* SequenceInsertion::replay(DataView<SequenceData>& p1, DataView<SequenceData>&) {
+	CostTimer timer( costClass() );
 	SequenceData* data = new SequenceData( length() );
 	int end = _loc+_span->length();
 	
 	STYPE* sdata = data->sequence();
-	STYPE* pdata = sd->sequence();
+	const STYPE* pdata = p1->sequence();
 	if (_loc > 0) 
 		memcpy(sdata, pdata, sizeof(STYPE)*_loc);
 	// copy span
 	memcpy(&sdata[_loc], _span->sequence() , sizeof(STYPE)*(_span->length()));
 	
 	memcpy(&sdata[end], &pdata[_loc] , sizeof(STYPE)*(length()-end));
-	delete sd;
 	
 	return data;
 }
 
+void SequenceInsertion::compile(ReplayProgram& program) { program.insertSpan(_loc, _span->sequence(), _span->length()); }
+
+SequenceDiff* SequenceInsertion::proxyDiff() {
+	SequenceDiff* d = diffOf(parent(0));
+	if (d) d->insert(_loc, _span->sequence(), _span->length());
+	return d;
+}
+
 STYPE SequenceInsertion::proxyGet(int i)  {
 	// See if the index is in the list
 	int index = i;
@@ -294,7 +549,7 @@ std::string SequenceInsertion::toString() const {
 }
 
 SequenceDeletionMutator::SequenceDeletionMutator(int cost, double rate, int minL, int maxL) :
-OperationMutator<OpSequence>(cost), _rate(rate), _minL(minL), _maxL(maxL) {}
+OperationMutator<OpSequence>(cost, "SequenceDeletion"), _rate(rate), _minL(minL), _maxL(maxL) {}
 
 OpSequence* SequenceDeletionMutator::mutate( OpSequence& g) const {
 	if (binomial(g.length(), _rate) == 0) return &g;
@@ -308,6 +563,7 @@ OpSequence* SequenceDeletionMutator::mutate( OpSequence& g) const {
 	
 	SequenceDeletion *sd = new SequenceDeletion(g, loc, spanLength);
 	sd->setCost(cost());
+	sd->setCostClass( costClass() );
 	return sd;
 	
 }
@@ -320,7 +576,7 @@ double SequenceDeletionMutator::rate() const { return _rate; }
 
 
 SequenceInsertionMutator::SequenceInsertionMutator(int cost, double rate, int minL, int maxL, const std::vector<double>& distr) :
-OperationMutator<OpSequence>(cost), _rate(rate), _minL(minL), _maxL(maxL), _distr(distr) {
+OperationMutator<OpSequence>(cost, "SequenceInsertion"), _rate(rate), _minL(minL), _maxL(maxL), _distr(distr) {
 	cumSum(_distr);
 }
 
@@ -340,6 +596,7 @@ OpSequence* SequenceInsertionMutator::mutate( OpSequence& g) const {
 	
 	SequenceInsertion *sd = new SequenceInsertion(g, loc, span);
 	sd->setCost( cost() );
+	sd->setCostClass( costClass() );
 	return sd;
 }
 
@@ -355,21 +612,35 @@ double SequenceInsertionMutator::rate() const { return _rate; }
  *******************************************************************/
 
 SequenceCrossover::SequenceCrossover(OpSequence& op1, OpSequence& op2, const std::vector<int>& locs) :
-OpSequenceBase(100, (locs.size()%2==0)? op1.length(): op2.length(), op1, op2), _locs(locs) {}
+OpSequenceBase(100, (locs.size()%2==0)? op1.length(): op2.length(), op1, op2), _locs(locs) {
+	Fingerprint f = mixFingerprint( op1.fingerprint(), FP_CROSSOVER );
+	f = mixFingerprint( f, op2.fingerprint() );
+	for (int j=0; j<(int)_locs.size(); j++) f = mixFingerprint( f, _locs[j] );
+	setFingerprint( f );
+}
 
 
 SequenceData* SequenceCrossover::evaluate() {
 	SequenceData* sd = OpSequenceBase::evaluate();
 	if (sd != NULL) return sd;
 	
-	SequenceData* sd1 = parent(0)->evaluate();
-	SequenceData* sd2 = parent(1)->evaluate();
+	// choose the host; only the host is written to, so the other parent is just viewed
+	int h = host();
+	DataView<SequenceData> p[2];
+	p[h] = DataView<SequenceData>( parent(h)->evaluate() );
+	p[1-h] = parent(1-h)->view();
+	return replay( p[0], p[1] );
+}
+
+SequenceData* SequenceCrossover::replay(DataView<SequenceData>& p1, DataView<SequenceData>& p2) {
+	// The donor's segments are written over the host's sequence
+	bool even = (_locs.size() % 2 == 0);
+	SequenceData* result = even ? p1.release() : p2.release();
+	const DataView<SequenceData>& donor = even ? p2 : p1;
 	
-	// choose the host
-	SequenceData* result = (_locs.size() % 2 == 0) ? sd1 : sd2;
-	SequenceData* to_delete = (_locs.size() % 2 == 0) ? sd2 : sd1;
+	CostTimer timer( costClass() );
 	STYPE* data = result->sequence();
-	STYPE* other = to_delete->sequence();
+	const STYPE* other = donor->sequence();
 	
 	int a,b,l;
 	int start = (_locs.size() % 2 == 0) ? 1: 0;
@@ -381,7 +652,37 @@ SequenceData* SequenceCrossover::evaluate() {
 		memcpy( &data[a], &other[a], l*sizeof(STYPE) );
 	}
 	
-	delete to_delete;
+	return result;
+}
+
+int SequenceCrossover::host() const { return (_locs.size() % 2 == 0) ? 0 : 1; }
+
+void SequenceCrossover::compile(ReplayProgram& program) {
+	std::vector<int> bounds;
+	int start = (_locs.size() % 2 == 0) ? 1: 0;
+	for (int i=start; i<(int)_locs.size(); i+=2) {
+		bounds.push_back( (i==0) ? 0 : _locs[i-1] );
+		bounds.push_back( _locs[i] );
+	}
+	program.copySegments( parent(1-host()), bounds );
+}
+
+SequenceDiff* SequenceCrossover::proxyDiff() {
+	int h = host();
+	SequenceDiff* result = diffOf(parent(h));
+	SequenceDiff* donor = result ? diffOf(parent(1-h)) : NULL;
+	if (!donor || !result->sameRoot(*donor)) {
+		delete result;
+		delete donor;
+		return NULL;
+	}
+	
+	int start = (_locs.size() % 2 == 0) ? 1: 0;
+	for (int i=start; i<(int)_locs.size(); i+=2) {
+		int a = (i==0) ? 0 : _locs[i-1];
+		result->copyRange(*donor, a, _locs[i]);
+	}
+	delete donor;
 	return result;
 }
 
@@ -389,12 +690,9 @@ STYPE SequenceCrossover::proxyGet(int i)  {
 	// See if the index is in the list
 	parent(0)->touch();
 	parent(1)->touch();	
-	for (int j=0; j<_locs.size(); j++) {
-		if (i<j) {
-			return (j%2==0) ? parent(0)->get(i) : parent(1)->get(i);
-		}
-	}
-	return (_locs.size()%2==0) ? parent(0)->get(i) : parent(1)->get(i);
+	int j;
+	for (j=0; j<(int)_locs.size() && i>=_locs[j]; j++);
+	return (j%2==0) ? parent(0)->get(i) : parent(1)->get(i);
 }
 
 std::string SequenceCrossover::toString() const {
@@ -408,7 +706,7 @@ std::string SequenceCrossover::toString() const {
 	return output.str();
 }
 
-SequenceRecombinator::SequenceRecombinator(int cost, double rate) : OperationRecombinator<OpSequence>(cost), _rate(rate) {}
+SequenceRecombinator::SequenceRecombinator(int cost, double rate) : OperationRecombinator<OpSequence>(cost, "SequenceCrossover"), _rate(rate), _merge(false) {}
 
 int SequenceRecombinator::numMutants(OpSequence& g, OpSequence& g2, long N) const {
 	double amt = N*g.frequency()*g2.frequency();
@@ -424,7 +722,8 @@ int SequenceRecombinator::numMutants(OpSequence& g, OpSequence& g2, long N) cons
 }
 
 OpSequence* SequenceRecombinator::recombine(OpSequence& g1, OpSequence& g2) const {
-	if (g1.key() == g2.key()) return &g1;
+	// Crossing identical genotypes gives the same genotype back
+	if (g1.key() == g2.key() || (_merge && g1.fingerprint() == g2.fingerprint())) return &g1;
 	
 	int length = (g1.length() < g2.length()) ? g1.length() : g2.length();
 
@@ -441,9 +740,14 @@ OpSequence* SequenceRecombinator::recombine(OpSequence& g1, OpSequence& g2) cons
 	
 	SequenceCrossover* sc = new SequenceCrossover( g1, g2, locs );
 	sc->setCost( cost() );
+	sc->setCostClass( costClass() );
 	return sc;
 	
 }
 
 double SequenceRecombinator::rate() const { return _rate; }
 
+void SequenceRecombinator::setMerging(bool b) { _merge = b; }
+
+bool SequenceRecombinator::merging() const { return _merge; }
+
@@ -13,6 +13,8 @@
 #include <Operation/Operation.h>
 #include <Base/Mutator.h>
 #include <Model/Sequence/Data.h>
+#include <Model/Sequence/Diff.h>
+#include <Util/SitePayload.h>
 
 /*
 #include <boost/numeric/ublas/matrix.hpp>
@@ -33,22 +35,101 @@ namespace GPPG {
 				
 		typedef Operation<SequenceData, ISequence> OpSequence;		
 		
+		class ReplayProgram;
 		
 		class OpSequenceBase : public OpSequence {
 		public:
 			OpSequenceBase(int cost, int length, OpSequence& parent1);
 			OpSequenceBase(int cost, int length, OpSequence& parent1, OpSequence& parent2);
+			~OpSequenceBase();
 			
 			int length() const;
 			
 			STYPE get(int i);
 			
-			const char* exportFormat();
+			std::string exportFormat();
+			std::string exportData(const SequenceData& d);
+			
+			/** Uncompressing fills either the full sequence or, in diff mode, a SequenceDiff against the root.
+			 * Diffs that grow past a fraction of the sequence are replaced by the full sequence.
+			 */
+			void setCompressed(bool compress);
+			bool isCompressed() const;
+			
+			/** A cached diff also counts.
+			 */
+			bool isMaterialized() const;
+			
+			/** Diffs are not prepared ahead; publishCache() then builds the diff itself.
+			 */
+			void prepareCache();
+			
+			/** In diff mode the diff is built from the parents' diffs instead, as setCompressed(false) does.
+			 */
+			void uncompressByReplay();
+			
+			/** Returns a full evaluation; a cached diff is materialized.  Once replayed often enough (see
+			 * setReplayPrograms()), the replay runs a ReplayProgram compiled for this operation.
+			 */
+			SequenceData* evaluate();
+			
+			/** Returns this operation as a diff against the root (to be deleted by the caller),
+			 * or NULL if it cannot be expressed as one (e.g. an ancestor caches the full sequence).
+			 */
+			SequenceDiff* evaluateDiff();
+			
+			/** Cache uncompressed operations as diffs against the root instead of full sequences.
+			 */
+			static void setDiffCache(bool b);
+			static bool diffCache();
+			
+			/** Compile the replay of operations evaluated \param n times into a ReplayProgram (0, the default,
+			 * never compiles).
+			 */
+			static void setReplayPrograms(int n);
+			static int replayPrograms();
+			
 		protected:
 			virtual STYPE proxyGet(int i)  = 0;
 			
+			/** Appends this operation's own change to \param program.
+			 */
+			virtual void compile(ReplayProgram& program) = 0;
+			
+			/** The parent this operation's sequence is written over (the other one, if any, only donates).
+			 */
+			virtual int host() const;
+			
+			void encodeData(const SequenceData& d, std::vector<unsigned char>& out) const;
+			SequenceData* decodeData(const std::vector<unsigned char>& in) const;
+			
+			/** Applies this operation to the diffs of its parents.
+			 */
+			virtual SequenceDiff* proxyDiff() = 0;
+			
+			/** Returns the diff of \param op (a parent), or NULL.
+			 */
+			static SequenceDiff* diffOf(OpSequence* op);
+			
 		private:
+			/** Drops the cached diff.
+			 */
+			void dropDiff();
+			
+			/** Returns the program replaying this operation, compiling it if it is hot and missing or out of
+			 * date; the handle is empty while there is none.
+			 */
+			DataView<ReplayProgram> compiled();
+			
+			friend class ReplayProgram;
+			
 			int _length;
+			SequenceDiff* _diff;
+			DataView<ReplayProgram> _program;
+			int _replays;
+			
+			static bool _diffCache;
+			static int _programsAfter;
 		};
 		
 
@@ -84,13 +165,15 @@ namespace GPPG {
 		
 		class SequencePointChange: public OpSequenceBase {
 		public:
-			SequencePointChange(OpSequence& op, int* locs, int numLocs, STYPE* dest);
-			
-			~SequencePointChange(); 
+			/** Changes the sites \param locs from the characters \param prev (of \param op) to \param dest.
+			 * The sites are copied into a compact payload; a site listed twice keeps its last character.
+			 */
+			SequencePointChange(OpSequence& op, const int* locs, int numLocs, const STYPE* dest, const STYPE* prev);
 			
 			std::string toString() const;
 			
 			SequenceData* evaluate();
+			SequenceData* replay(DataView<SequenceData>& p1, DataView<SequenceData>& p2);
 			
 			/** Get the number of mutated sites
 			 */
@@ -106,12 +189,11 @@ namespace GPPG {
 			
 		protected:
 			STYPE proxyGet(int i) ;
+			SequenceDiff* proxyDiff();
+			void compile(ReplayProgram& program);
 			
 		private:
-			int* _loc;		/* Locations array */
-			int _numlocs;	/* Number of locations to change */
-			STYPE* _c;		/* Characters to be changed to */
-			int _length;
+			SitePayload _sites;	/* Sorted sites and the characters they change to */
 		};
 		
 		class SequencePointMutator : public OperationMutator< OpSequence > {
@@ -140,11 +222,14 @@ namespace GPPG {
 			SequenceDeletion(OpSequence& op, int loc, int span);
 			
 			SequenceData* evaluate();
+			SequenceData* replay(DataView<SequenceData>& p1, DataView<SequenceData>& p2);
 			
 			std::string toString() const;
 			
 		protected:
 			STYPE proxyGet(int i);
+			SequenceDiff* proxyDiff();
+			void compile(ReplayProgram& program);
 			
 		private:
 			int _loc, _span;
@@ -175,11 +260,14 @@ namespace GPPG {
 			~SequenceInsertion();
 			
 			SequenceData* evaluate();
+			SequenceData* replay(DataView<SequenceData>& p1, DataView<SequenceData>& p2);
 			
 			std::string toString() const;
 			
 		protected:
 			STYPE proxyGet(int i);
+			SequenceDiff* proxyDiff();
+			void compile(ReplayProgram& program);
 			
 		private:
 			int _loc;
@@ -211,10 +299,17 @@ namespace GPPG {
 			SequenceCrossover();
 			
 			SequenceData* evaluate();
+			SequenceData* replay(DataView<SequenceData>& p1, DataView<SequenceData>& p2);
 			std::string toString() const;
 			
 		protected:
 			STYPE proxyGet(int i);
+			SequenceDiff* proxyDiff();
+			void compile(ReplayProgram& program);
+			
+			/** Even crossovers write over the first parent, odd ones over the second.
+			 */
+			int host() const;
 			
 		private:
 			std::vector<int> _locs;
@@ -230,8 +325,16 @@ namespace GPPG {
 			
 			double rate() const;
 			
+			/** Also give back parents with equal fingerprints uncrossed, as a graph merging genotypes (see
+			 * OperationGraph::setInterning()) treats them as one (off by default).  Without it only a parent
+			 * crossed with itself is, so the random draws of a run do not depend on the fingerprints.
+			 */
+			void setMerging(bool b);
+			bool merging() const;
+			
 		private:
 			double _rate;
+			bool _merge;
 		};
 	}
 }
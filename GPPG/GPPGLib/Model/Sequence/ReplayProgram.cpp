@@ -0,0 +1,172 @@
+/*
+ *  ReplayProgram.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "Model/Sequence/ReplayProgram.h"
+#include "Util/Thread.h"
+#include <cstring>
+
+using namespace GPPG;
+using namespace GPPG::Model;
+
+size_t ReplayProgram::_used = 0;
+size_t ReplayProgram::_max = 64 << 20;
+
+ReplayProgram::ReplayProgram(OpSequence* base) : _base(base), _maxLength(base->length()), _resizes(false), _bytes(0) {}
+
+ReplayProgram::~ReplayProgram() {
+	if (_bytes > 0) atomicAdd( &_used, -_bytes );
+}
+
+ReplayProgram* ReplayProgram::compile(OpSequenceBase* target) {
+	if (usedBytes() >= _max) return NULL;
+	
+	// Follow the hosts down to the first materialized ancestor
+	std::vector<OpSequenceBase*> path( 1, target );
+	OpSequence* op = target->parent( target->host() );
+	OpSequenceBase* b;
+	while ((b = dynamic_cast<OpSequenceBase*>(op)) && !b->isMaterialized()) {
+		path.push_back( b );
+		op = b->parent( b->host() );
+	}
+	// A single operation replays just as fast on its own
+	if (path.size() < 2) return NULL;
+
+	ReplayProgram* program = new ReplayProgram( op );
+	for (int i=path.size()-1; i>=0; i--) {
+		program->_path.push_back( path[i] );
+		path[i]->compile( *program );
+		if (path[i]->length() > program->_maxLength) program->_maxLength = path[i]->length();
+	}
+
+	size_t bytes = sizeof(ReplayProgram) + sizeof(int)*program->_code.capacity() + sizeof(STYPE)*program->_spans.capacity()
+		+ sizeof(OpSequence*)*(program->_donors.capacity() + program->_path.capacity());
+	program->_bytes = bytes;
+	if (atomicAdd( &_used, bytes ) > _max) {
+		delete program;
+		return NULL;
+	}
+	return program;
+}
+
+SequenceData* ReplayProgram::run() const {
+	for (int i=0; i+1<(int)_path.size(); i++) _path[i]->incrRequests(1);
+
+	DataView<SequenceData> base = _base->view();
+	int length = base->length();
+	SequenceData *result = 0, *scratch = 0;
+	STYPE* data;
+	if (_resizes) {
+		// Indels shift the tail in place, so the buffer must hold the longest sequence on the way
+		scratch = new SequenceData( _maxLength );
+		data = scratch->sequence();
+		memcpy( data, base->sequence(), sizeof(STYPE)*length );
+		base.reset();
+	} else {
+		result = base.release();
+		data = result->sequence();
+	}
+
+	const int* pc = _code.empty() ? NULL : &_code[0];
+	const int* end = pc + _code.size();
+	while (pc < end) {
+		switch (*pc++) {
+			case SET_SITES: {
+				int n = pc[0];
+				const int* sites = pc+1;
+				const int* symbols = sites+n;
+				for (int i=0; i<n; i++) data[sites[i]] = (STYPE)symbols[i];
+				pc += 1+2*n;
+				break;
+			}
+			case DELETE_RANGE: {
+				int loc = pc[0], span = pc[1];
+				memmove( &data[loc], &data[loc+span], sizeof(STYPE)*(length-loc-span) );
+				length -= span;
+				pc += 2;
+				break;
+			}
+			case INSERT_SPAN: {
+				int loc = pc[0], n = pc[1];
+				memmove( &data[loc+n], &data[loc], sizeof(STYPE)*(length-loc) );
+				memcpy( &data[loc], &_spans[pc[2]], sizeof(STYPE)*n );
+				length += n;
+				pc += 3;
+				break;
+			}
+			case CROSSOVER_SEGMENTS: {
+				DataView<SequenceData> donor = _donors[pc[0]]->view();
+				const STYPE* other = donor->sequence();
+				int n = pc[1];
+				const int* bounds = pc+2;
+				for (int i=0; i<n; i++) {
+					int a = bounds[2*i], b = bounds[2*i+1];
+					memcpy( &data[a], &other[a], sizeof(STYPE)*(b-a) );
+				}
+				pc += 2+2*n;
+				break;
+			}
+		}
+	}
+
+	if (scratch) {
+		result = new SequenceData( length );
+		memcpy( result->sequence(), data, sizeof(STYPE)*length );
+		delete scratch;
+	}
+	return result;
+}
+
+bool ReplayProgram::isCurrent() const {
+	if (_base->numParents() > 0 && !_base->isMaterialized()) return false;
+	for (int i=0; i+1<(int)_path.size(); i++) {
+		if (_path[i]->isMaterialized()) return false;
+	}
+	return true;
+}
+
+void ReplayProgram::setSites(const int* sites, const unsigned short* symbols, int n) {
+	_code.push_back( SET_SITES );
+	_code.push_back( n );
+	_code.insert( _code.end(), sites, sites+n );
+	_code.insert( _code.end(), symbols, symbols+n );
+}
+
+void ReplayProgram::deleteRange(int loc, int span) {
+	_code.push_back( DELETE_RANGE );
+	_code.push_back( loc );
+	_code.push_back( span );
+	_resizes = true;
+}
+
+void ReplayProgram::insertSpan(int loc, const STYPE* s, int n) {
+	if (n == 0) return;
+	_code.push_back( INSERT_SPAN );
+	_code.push_back( loc );
+	_code.push_back( n );
+	_code.push_back( _spans.size() );
+	_spans.insert( _spans.end(), s, s+n );
+	_resizes = true;
+}
+
+void ReplayProgram::copySegments(OpSequence* donor, const std::vector<int>& bounds) {
+	_code.push_back( CROSSOVER_SEGMENTS );
+	_code.push_back( _donors.size() );
+	_code.push_back( bounds.size()/2 );
+	_code.insert( _code.end(), bounds.begin(), bounds.end() );
+	_donors.push_back( donor );
+}
+
+int ReplayProgram::numOperations() const { return _path.size(); }
+
+size_t ReplayProgram::memoryBytes() const { return _bytes; }
+
+void ReplayProgram::setMaxBytes(size_t bytes) { _max = bytes; }
+
+size_t ReplayProgram::maxBytes() { return _max; }
+
+size_t ReplayProgram::usedBytes() { return atomicAdd( &_used, (size_t)0 ); }
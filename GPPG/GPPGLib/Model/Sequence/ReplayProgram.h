@@ -0,0 +1,106 @@
+/*
+ *  ReplayProgram.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef SEQUENCE_REPLAY_PROGRAM_
+#define SEQUENCE_REPLAY_PROGRAM_
+
+#include <Model/Sequence/Operation.h>
+#include <cstddef>
+#include <vector>
+
+namespace GPPG {
+
+	namespace Model {
+
+		/**
+		 * The replay of a compressed Sequence genotype, compiled into a compact instruction stream.
+		 * Evaluating a genotype normally recurses through its ancestors down to the closest materialized
+		 * one, the base, and each indel on the way writes a new copy of the sequence.  A program instead
+		 * lists the changes of the operations on that path, oldest first, with their operands in one buffer
+		 * of ints (and the inserted spans in one of characters); run() interprets it in a single loop,
+		 * without a virtual call per operation, and writes in place into one buffer as long as the longest
+		 * sequence on the path.  Crossovers copy their segments from the other parent, the donor, which is
+		 * read as usual.
+		 * The operations on the path stay alive as long as the target, so a program stays correct while the
+		 * caches change; it is only out of date (see isCurrent()) once a closer ancestor is materialized or
+		 * the base is not anymore.
+		 */
+		class ReplayProgram {
+		public:
+			enum Instruction { SET_SITES, DELETE_RANGE, INSERT_SPAN, CROSSOVER_SEGMENTS };
+
+			/** Compiles the replay of \param target, which must be compressed, from its closest materialized
+			 * ancestor through the hosts of its crossovers.  Returns NULL if the programs in memory would
+			 * take more than the budget (see setMaxBytes()), or if the target's parent is materialized, as
+			 * there is nothing to gain then.
+			 */
+			static ReplayProgram* compile(OpSequenceBase* target);
+
+			~ReplayProgram();
+
+			/** Replays the target; the caller must delete the result.  Each ancestor on the path counts one
+			 * request, as if it was evaluated (the target's own evaluation counts itself).
+			 */
+			SequenceData* run() const;
+
+			/** True while the base is materialized (or a root) and no other operation on the path is.
+			 */
+			bool isCurrent() const;
+
+			/** Appends the instruction that sets the \param n \param sites to \param symbols.
+			 */
+			void setSites(const int* sites, const unsigned short* symbols, int n);
+
+			/** Appends the instruction that removes \param span items starting at \param loc.
+			 */
+			void deleteRange(int loc, int span);
+
+			/** Appends the instruction that inserts the \param n items of \param s before \param loc.
+			 */
+			void insertSpan(int loc, const STYPE* s, int n);
+
+			/** Appends the instruction that copies the ranges [\param bounds[2i], \param bounds[2i+1]) from
+			 * the sequence of \param donor.
+			 */
+			void copySegments(OpSequence* donor, const std::vector<int>& bounds);
+
+			/** Number of operations replayed by the program.
+			 */
+			int numOperations() const;
+
+			size_t memoryBytes() const;
+
+			/** Caps the memory held by all programs at \param bytes (64MB by default).
+			 */
+			static void setMaxBytes(size_t bytes);
+			static size_t maxBytes();
+
+			/** Memory held by all programs.
+			 */
+			static size_t usedBytes();
+
+		private:
+			ReplayProgram(OpSequence* base);
+			ReplayProgram(ReplayProgram const&);
+			ReplayProgram& operator=(ReplayProgram const&);
+
+			std::vector<int> _code;
+			std::vector<STYPE> _spans;
+			std::vector<OpSequence*> _donors;
+			std::vector<OpSequenceBase*> _path;	/* Oldest first; the target is last */
+			OpSequence* _base;
+			int _maxLength;
+			bool _resizes;	/* Some instruction changes the length */
+			size_t _bytes;
+
+			static size_t _used, _max;
+		};
+	}
+}
+
+#endif
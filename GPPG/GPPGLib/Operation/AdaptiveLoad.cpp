@@ -0,0 +1,278 @@
+/*
+ *  AdaptiveLoad.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "AdaptiveLoad.h"
+#include "Operation/Operation.h"
+#include "Util/BufferPool.h"
+#include "Util/MemoryMonitor.h"
+#include <algorithm>
+
+using namespace GPPG;
+
+using std::set;
+using std::map;
+using std::vector;
+using std::pair;
+
+typedef map<IOperation*, double>::iterator ScoreIter;
+typedef set<IOperation*>::iterator OpIter;
+typedef pair<double, IOperation*> Ranked;
+
+/* Scores below this are forgotten */
+#define MIN_SCORE 1e-3
+
+/* Only this many times k of the most valuable genotypes are considered */
+#define SCAN_FACTOR 8
+
+/* Genotypes whose full evaluation costs more than this many times their replay cost are not uncompressed */
+#define MAX_BLOWUP 4
+
+/* Orders ancestors before their descendants: keys are handed out as genotypes are added, while order()
+ * is restamped on activation */
+struct OlderFirst {
+	bool operator()(const IOperation* a, const IOperation* b) const {
+		return a->key() < b->key();
+	}
+};
+
+/* Orders by value, then by key for determinism */
+struct RankedOrder {
+	bool operator()(const Ranked& a, const Ranked& b) const {
+		if (a.first != b.first) return a.first > b.first;
+		return a.second->key() < b.second->key();
+	}
+};
+
+AdaptiveLoad::AdaptiveLoad(int maxExplicit, double decay, double hysteresis) :
+	_root(0), _maxExplicit(maxExplicit), _memoryCap(0), _decay(decay), _hysteresis(hysteresis), _admitted(0), _evicted(0) {}
+
+void AdaptiveLoad::decompressionReleased( IOperation* op ) {
+	_score.erase( op );
+	_U.erase( op );
+}
+
+void AdaptiveLoad::generationFinished( OperationGraph*, const std::set<IOperation*>& active ) {
+	if (active.size() == 0) return;
+	if (_root == 0) {
+		IOperation* op = *active.begin();
+		while (op->numParents() > 0) op = op->parent(0);
+		_root = op;
+		_U.insert( _root );
+	}
+
+	_memoryCap = MemoryMonitor::instance().relaxCap( _memoryCap, _maxExplicit );
+	observe( active );
+	select();
+}
+
+void AdaptiveLoad::observe( const std::set<IOperation*>& active ) {
+	// Age the scores
+	vector<IOperation*> pending;
+	ScoreIter it = _score.begin();
+	while (it != _score.end()) {
+		ScoreIter cur = it++;
+		cur->second *= _decay;
+		pending.push_back( cur->first );
+		if (cur->second < MIN_SCORE) _score.erase( cur );
+	}
+
+	// Reads land on the replay paths, so follow the parents of every genotype that was read; the
+	// counts are cleared as they are folded in, so a genotype reached again is not followed again
+	pending.insert( pending.end(), active.begin(), active.end() );
+	while (!pending.empty()) {
+		IOperation* op = pending.back();
+		pending.pop_back();
+
+		// The reads are taken as they are, as the cost they were weighed by may have been calibrated since.
+		// The mark touch() leaves is not a read and is kept: clearing it would have every proxied read
+		// walk the compressed ancestry again.
+		long long r = op->reads();
+		op->setRequests( 0 );
+		if (r <= 0) continue;
+		_score[op] += (double)r;
+		for (int i=0; i<op->numParents(); i++)
+			pending.push_back( op->parent(i) );
+	}
+}
+
+AdaptiveLoad::Costs::Costs(const std::map<IOperation*, double>& score) : replay( score.size(), -1 ) {
+	tracked.reserve( score.size() );
+	for (map<IOperation*, double>::const_iterator it=score.begin(); it!=score.end(); it++)
+		tracked.push_back( it->first );
+}
+
+double* AdaptiveLoad::Costs::replayed(IOperation* op) {
+	vector<IOperation*>::iterator it = std::lower_bound( tracked.begin(), tracked.end(), op );
+	if (it == tracked.end() || *it != op) return NULL;
+	return &replay[ it - tracked.begin() ];
+}
+
+double AdaptiveLoad::replayCost( IOperation* op, Costs& costs ) const {
+	// Walk up to the end of the replay or to a genotype already costed, then fill in the costs back down
+	vector<IOperation*>& path = costs.path;
+	path.clear();
+	double c = 0;
+	IOperation* p = op;
+	while (true) {
+		double* known = costs.replayed( p );
+		if (known != NULL && *known >= 0) {
+			c = *known;
+			break;
+		}
+		path.push_back( p );
+		p = (p->numParents() > 0) ? p->parent(0) : 0;
+		if (p == 0 || !p->isCompressed() || p->numParents() == 0) break;
+	}
+	for (int i=(int)path.size()-1; i>=0; i--) {
+		c += path[i]->cost();
+		double* known = costs.replayed( path[i] );
+		if (known != NULL) *known = c;
+	}
+	return c;
+}
+
+double AdaptiveLoad::evaluationCost( IOperation* op, double limit, Costs& costs ) const {
+	// A full evaluation replays every compressed parent, recombinants included, without sharing work
+	// between them, so the cost is summed over the paths to the nearest uncompressed ancestors.  Each
+	// genotype is costed only after its parents, so every cost memoised before stopping is complete.
+	map<IOperation*, double>& memo = costs.evaluation;
+	vector<IOperation*> pending( 1, op );
+	while (!pending.empty()) {
+		IOperation* cur = pending.back();
+		if (memo.find( cur ) != memo.end()) {
+			pending.pop_back();
+			continue;
+		}
+		bool ready = true;
+		double c = cur->cost();
+		for (int i=0; i<cur->numParents(); i++) {
+			IOperation* p = cur->parent(i);
+			if (!p->isCompressed()) continue;
+			ScoreIter it = memo.find( p );
+			if (it == memo.end()) {
+				pending.push_back( p );
+				ready = false;
+			} else {
+				c += it->second;
+			}
+		}
+		if (!ready) continue;
+
+		memo[cur] = c;
+		pending.pop_back();
+		// The cost only grows towards op
+		if (c > limit) return c;
+	}
+	return memo[op];
+}
+
+void AdaptiveLoad::select() {
+	int slots = ((_memoryCap > 0 && _memoryCap < _maxExplicit) ? _memoryCap : _maxExplicit) - 1;
+
+	// Rank the tracked genotypes by value
+	Costs costs( _score );
+	vector<Ranked> ranked;
+	for (ScoreIter it=_score.begin(); it!=_score.end(); it++) {
+		if (it->first == _root) continue;
+		ranked.push_back( Ranked(it->second * replayCost(it->first, costs), it->first) );
+	}
+
+	// The genotypes that would be kept without hysteresis, and the compressed ones among them.  Those
+	// too costly to uncompress are passed over for now; they become cheap once their older recombinant
+	// ancestors are uncompressed
+	set<IOperation*> want;
+	vector<Ranked> challengers;
+	int n = ranked.size();
+	if (n > SCAN_FACTOR*slots) n = SCAN_FACTOR*slots;
+	std::partial_sort( ranked.begin(), ranked.begin() + n, ranked.end(), RankedOrder() );
+	for (int i=0; i<n && (int)want.size()<slots; i++) {
+		IOperation* op = ranked[i].second;
+		if (_U.count( op ) == 0) {
+			double limit = MAX_BLOWUP * replayCost( op, costs );
+			if (evaluationCost( op, limit, costs ) > limit) continue;
+			challengers.push_back( ranked[i] );
+		}
+		want.insert( op );
+	}
+
+	vector<Ranked> weakest;
+	vector<IOperation*> forgotten;
+	for (OpIter it=_U.begin(); it!=_U.end(); it++) {
+		IOperation* op = *it;
+		if (op == _root || want.count(op) > 0) continue;
+		ScoreIter s = _score.find( op );
+		if (s == _score.end()) forgotten.push_back( op );
+		else weakest.push_back( Ranked(s->second * replayCost(op, costs), op) );
+	}
+	std::sort( weakest.begin(), weakest.end(), RankedOrder() );
+	std::reverse( weakest.begin(), weakest.end() );
+
+	// Genotypes no longer read at all leave regardless
+	vector<IOperation*> in, out( forgotten );
+	for (int i=0; i<(int)forgotten.size(); i++) _U.erase( forgotten[i] );
+
+	int free = slots - ((int)_U.size() - 1);
+	int w = 0;
+	for (int i=0; i<(int)challengers.size(); i++) {
+		if (free <= 0) {
+			if (w >= (int)weakest.size() || challengers[i].first <= (1+_hysteresis)*weakest[w].first) break;
+			out.push_back( weakest[w].second );
+			_U.erase( weakest[w++].second );
+		} else {
+			free--;
+		}
+		in.push_back( challengers[i].second );
+		_U.insert( challengers[i].second );
+	}
+
+	// Uncompress ancestors first and compress only afterwards, so every genotype is replayed from the
+	// nearest data already present; replaying through a compressed recombinant evaluates both parents
+	std::sort( in.begin(), in.end(), OlderFirst() );
+	for (int i=0; i<(int)in.size(); i++) in[i]->setCompressed(false);
+	for (int i=0; i<(int)out.size(); i++) out[i]->setCompressed(true);
+	_admitted += in.size();
+	_evicted += out.size();
+}
+
+void AdaptiveLoad::memoryPressure( OperationGraph* ) {
+	Costs costs( _score );
+	vector<Ranked> weakest;
+	for (OpIter it=_U.begin(); it!=_U.end(); it++) {
+		if (*it == _root) continue;
+		weakest.push_back( Ranked(score(*it) * replayCost(*it, costs), *it) );
+	}
+	std::sort( weakest.begin(), weakest.end(), RankedOrder() );
+	std::reverse( weakest.begin(), weakest.end() );
+
+	MemoryMonitor& monitor = MemoryMonitor::instance();
+	int shed = 0;
+	for (; shed<(int)weakest.size() && monitor.overLimit(); shed++) {
+		_U.erase( weakest[shed].second );
+		weakest[shed].second->setCompressed(true);
+		BufferPool::instance().trim();
+	}
+	_evicted += shed;
+
+	// The next selection would uncompress them again, so k is held to what fits while the pressure lasts
+	if (shed > 0) _memoryCap = _U.size();
+}
+
+int AdaptiveLoad::maxUncompressed() const { return _maxExplicit; }
+
+double AdaptiveLoad::decay() const { return _decay; }
+
+double AdaptiveLoad::hysteresis() const { return _hysteresis; }
+
+double AdaptiveLoad::score(IOperation* op) const {
+	map<IOperation*, double>::const_iterator it = _score.find( op );
+	return (it == _score.end()) ? 0 : it->second;
+}
+
+long AdaptiveLoad::numAdmitted() const { return _admitted; }
+
+long AdaptiveLoad::numEvicted() const { return _evicted; }
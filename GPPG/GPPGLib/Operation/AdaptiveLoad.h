@@ -0,0 +1,114 @@
+/*
+ *  AdaptiveLoad.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef OPERATION_ADAPTIVE_LOAD_
+#define OPERATION_ADAPTIVE_LOAD_
+
+#include "Operation/CompressionPolicy.h"
+#include <map>
+#include <set>
+#include <vector>
+
+namespace GPPG {
+
+	/** AdaptiveLoad keeps uncompressed the genotypes whose data is actually read the most.
+	 * Every read of an Operation (including the reads made while replaying its descendants) adds to its
+	 * request counter.  After each generation the policy collects the counters along the replay paths of
+	 * the active genotypes and folds them into a score that decays by \c decay per generation (LFU with
+	 * aging).  A genotype is worth its score times its replay cost, the cost of the operations back to
+	 * its nearest uncompressed ancestor.  The k most valuable genotypes are kept uncompressed; an
+	 * uncompressed genotype is only displaced by one worth more than (1 + \c hysteresis) times as much,
+	 * so the set does not flap between near ties.
+	 *
+	 * Uncompressing a genotype evaluates it in full, and a full evaluation replays both parents of every
+	 * compressed recombinant on the way, so genotypes below a tangle of recombinants wait until the
+	 * older recombinants are uncompressed.
+	 */
+	class AdaptiveLoad : public CompressionPolicy {
+	public:
+		/** Create an AdaptiveLoad policy keeping at most \param maxExplicit genotypes uncompressed (the root included).
+		 */
+		AdaptiveLoad(int maxExplicit, double decay = 0.8, double hysteresis = 0.25);
+
+		void decompressionReleased( IOperation* op );
+
+		void generationFinished( OperationGraph* heap, const std::set<IOperation*>& active );
+
+		/** Compresses the least valuable uncompressed genotypes (never the root) until the MemoryMonitor is
+		 * under its limit, and caps k at the number left until the cap grows back (see MemoryMonitor::relaxCap()).
+		 */
+		void memoryPressure( OperationGraph* heap );
+
+		/** Retrieve the maximum number of uncompressed genotypes.
+		 */
+		int maxUncompressed() const;
+
+		/** Retrieve the factor applied to the scores every generation.
+		 */
+		double decay() const;
+
+		/** Retrieve the margin a genotype needs to displace an uncompressed one.
+		 */
+		double hysteresis() const;
+
+		/** Retrieve the current score of \param op (0 if it is not tracked).
+		 */
+		double score(IOperation* op) const;
+
+		/** Number of genotypes uncompressed and compressed again by the policy.
+		 */
+		long numAdmitted() const;
+		long numEvicted() const;
+
+	private:
+		AdaptiveLoad(AdaptiveLoad const&);
+		AdaptiveLoad const& operator=(AdaptiveLoad const&);
+
+		/** Folds the request counters on the replay paths of \param active into the scores.
+		 */
+		void observe( const std::set<IOperation*>& active );
+
+		/** Recomputes the uncompressed set from the scores.
+		 */
+		void select();
+
+		/** Costs worked out during one pass over the genotypes, while no cache changes.  The replay costs
+		 * of the tracked genotypes are kept in the order of their scores, so they are found by bisection.
+		 */
+		struct Costs {
+			Costs(const std::map<IOperation*, double>& score);
+
+			/** The replay cost of \param op (negative until it is worked out), or NULL if it is not tracked.
+			 */
+			double* replayed(IOperation* op);
+
+			std::vector<IOperation*> tracked, path;
+			std::vector<double> replay;
+			std::map<IOperation*, double> evaluation;
+		};
+
+		/** Cost of replaying a read of \param op from its nearest uncompressed ancestor; memoised in
+		 * \param costs for the tracked genotypes, as a compressed parent's cost plus their own.
+		 */
+		double replayCost( IOperation* op, Costs& costs ) const;
+
+		/** Cost of fully evaluating \param op, which replays both parents of every compressed recombinant
+		 * on the way; memoised in \param costs.  Once an ancestor costs more than \param limit, its cost
+		 * is returned instead.
+		 */
+		double evaluationCost( IOperation* op, double limit, Costs& costs ) const;
+
+		std::map<IOperation*, double> _score;
+		std::set<IOperation*> _U;
+		IOperation* _root;
+		int _maxExplicit, _memoryCap;	/* The cap is 0 without memory pressure */
+		double _decay, _hysteresis;
+		long _admitted, _evicted;
+	};
+}
+#endif
@@ -0,0 +1,245 @@
+/*
+ *  BatchEvaluator.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef OPERATION_BATCH_EVALUATOR_
+#define OPERATION_BATCH_EVALUATOR_
+
+#include "Operation/Operation.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace GPPG {
+
+	/** IBatchExporter produces the export format of many genotypes at once.
+	 */
+	class IBatchExporter {
+	public:
+		/** Receives the export format of each genotype.
+		 */
+		class Sink {
+		public:
+			virtual ~Sink() {}
+
+			/** Called once for the \param i'th genotype, possibly on the exporter's own thread.
+			 */
+			virtual void write(int i, const std::string& text) = 0;
+		};
+
+		virtual ~IBatchExporter() {}
+
+		/** Passes the export format of each of \param targets to \param sink, in the order of \param targets.
+		 */
+		virtual void exportBatch(const std::vector<IGenotype*>& targets, Sink& sink) = 0;
+	};
+
+	/** BatchEvaluator materializes many Operations together, so the ancestors they share are replayed once.
+	 * Evaluating each target on its own replays its whole ancestry from the nearest materialized Operation;
+	 * instead, the evaluator collects the sub-DAG spanning the targets down from their materialized
+	 * ancestors (or roots), the bases, and walks it depth-first from the bases.  Each Operation of the
+	 * sub-DAG is replayed once from the data of its parents (see Operation::replay()), which is kept on
+	 * the walk only until its last child in the sub-DAG is done; the last child takes it over and writes in
+	 * place.  Reads of the bases and the replays count as one request each.
+	 * The graph must not be changed meanwhile, but the caches may be (e.g. while a SnapshotExporter runs).
+	 */
+	template <typename T, class P> class BatchEvaluator : public IBatchExporter {
+	public:
+		typedef Operation<T,P> Op;
+
+		/** Receives the data of each target.
+		 */
+		class Visitor {
+		public:
+			virtual ~Visitor() {}
+
+			/** Called once for the \param i'th target, \param op, while its data \param d is materialized.
+			 * The visitor may keep a handle on the data; it is then not dropped after the call.
+			 */
+			virtual void visit(int i, Op* op, const DataView<T>& d) = 0;
+		};
+
+		BatchEvaluator() : _bases(0), _replayed(0) {}
+
+		/** Materializes \param targets, passing each to \param visitor in the order of the walk.
+		 * A target listed twice is visited twice.
+		 */
+		void evaluate(const std::vector<Op*>& targets, Visitor& visitor) {
+			std::map<Op*, Node> nodes;
+			std::vector<Op*> pending, ready;
+			_bases = 0;
+			_replayed = 0;
+
+			for (int i=0; i<(int)targets.size(); i++) {
+				typename std::map<Op*, Node>::iterator it = nodes.find( targets[i] );
+				if (it == nodes.end()) {
+					it = nodes.insert( std::make_pair(targets[i], Node()) ).first;
+					pending.push_back( targets[i] );
+				}
+				it->second.targets.push_back( i );
+			}
+
+			// Collect the sub-DAG up to the bases
+			while (!pending.empty()) {
+				Op* op = pending.back();
+				pending.pop_back();
+				Node& n = nodes[op];
+				n.base = op->numParents() == 0 || op->isMaterialized();
+				if (n.base) {
+					ready.push_back( op );
+					continue;
+				}
+				for (int j=0; j<op->numParents(); j++) {
+					Op* p = op->parent(j);
+					std::pair<typename std::map<Op*, Node>::iterator, bool> r = nodes.insert( std::make_pair(p, Node()) );
+					if (r.second) pending.push_back( p );
+					r.first->second.children.push_back( op );
+					r.first->second.uses++;
+					n.waiting++;
+				}
+			}
+
+			// Walk it from the bases; an Operation is ready once all its parents are materialized
+			while (!ready.empty()) {
+				Op* op = ready.back();
+				ready.pop_back();
+				Node& n = nodes[op];
+				if (n.base) {
+					n.data = op->view();
+					_bases++;
+				} else {
+					DataView<T> p1 = take( nodes, op->parent(0) ), p2;
+					if (op->numParents() > 1) p2 = take( nodes, op->parent(1) );
+					op->incrRequests(1);
+					n.data = DataView<T>( op->replay( p1, p2 ) );
+					_replayed++;
+				}
+
+				for (int j=0; j<(int)n.targets.size(); j++) {
+					visitor.visit( n.targets[j], op, n.data );
+				}
+				if (n.uses == 0) n.data.reset();
+
+				for (int j=0; j<(int)n.children.size(); j++) {
+					if (--nodes[ n.children[j] ].waiting == 0) ready.push_back( n.children[j] );
+				}
+			}
+		}
+
+		/** Materializes \param target alone and returns its data, which the handle holds on its own.
+		 */
+		DataView<T> evaluate(Op* target) {
+			Keeper keeper;
+			evaluate( std::vector<Op*>( 1, target ), keeper );
+			return keeper.data;
+		}
+
+		/** Exports the targets that are Operations of this kind in one batch, and the others one by one.
+		 * The texts that come before their turn in the walk are held until the ones ahead of them are written.
+		 */
+		void exportBatch(const std::vector<IGenotype*>& targets, Sink& sink) {
+			std::vector<Op*> ops;
+			std::vector<int> index;
+			Exporter exporter( sink, index );
+			for (int i=0; i<(int)targets.size(); i++) {
+				Op* op = dynamic_cast<Op*>( targets[i] );
+				if (op) {
+					ops.push_back( op );
+					index.push_back( i );
+				} else {
+					exporter.pass( i, targets[i]->exportFormat() );
+				}
+			}
+			evaluate( ops, exporter );
+		}
+
+		/** Number of bases read and of Operations replayed by the last evaluation.
+		 */
+		long numBases() const { return _bases; }
+		long numReplayed() const { return _replayed; }
+
+	private:
+		struct Node {
+			Node() : uses(0), waiting(0), base(false) {}
+			std::vector<int> targets;
+			std::vector<Op*> children;
+			DataView<T> data;
+			int uses, waiting;	/* Children not replayed yet, parents not materialized yet */
+			bool base;
+		};
+
+		/** Passes the export format of the targets to a Sink, under their original index and in its order.
+		 */
+		class Exporter : public Visitor {
+		public:
+			Exporter(Sink& sink, const std::vector<int>& index) : _sink(sink), _index(index), _next(0) {}
+
+			void visit(int i, Op* op, const DataView<T>& d) { pass( _index[i], op->exportData( *d ) ); }
+
+			/** Writes \param text of the \param i'th target if its turn has come, and then the held texts
+			 * that follow it; otherwise holds it.
+			 */
+			void pass(int i, const std::string& text) {
+				if (i != _next) {
+					_early[i] = text;
+					return;
+				}
+				_sink.write( _next++, text );
+				std::map<int, std::string>::iterator it;
+				while ((it = _early.find( _next )) != _early.end()) {
+					_sink.write( _next++, it->second );
+					_early.erase( it );
+				}
+			}
+
+		private:
+			Sink& _sink;
+			const std::vector<int>& _index;
+			std::map<int, std::string> _early;
+			int _next;
+		};
+
+		/** Keeps the data of a single target.
+		 */
+		struct Keeper : public Visitor {
+			void visit(int, Op*, const DataView<T>& d) { data = d; }
+			DataView<T> data;
+		};
+
+		/** Returns the data of \param p for one of its children, and lets it go after the last one, so
+		 * that child may write in place.
+		 */
+		static DataView<T> take(std::map<Op*, Node>& nodes, Op* p) {
+			Node& n = nodes[p];
+			DataView<T> d = n.data;
+			if (--n.uses == 0) n.data.reset();
+			return d;
+		}
+
+		long _bases, _replayed;
+	};
+
+	template <typename T, class P> void Operation<T,P>::uncompressByReplay() {
+		if (!isCompressed()) return;
+		// An encoding only needs decoding
+		if (isMaterialized()) {
+			setCompressed(false);
+			return;
+		}
+		
+		// The compressed ancestors read through are replayed once each, down from the materialized ones
+		BatchEvaluator<T,P> batch;
+		DataView<T> d = batch.evaluate( this );
+		if (!isCompressed()) return;
+		BaseOperation::setCompressed(false);
+		setData(d.release());
+		setEncoded(false);
+	}
+}
+
+#endif
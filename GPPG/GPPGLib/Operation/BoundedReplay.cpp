@@ -0,0 +1,318 @@
+/*
+ *  BoundedReplay.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "BoundedReplay.h"
+#include "Operation/Operation.h"
+#include "Util/MemoryMonitor.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace GPPG;
+
+typedef std::set<IOperation*>::iterator OpIter;
+
+/* Without a set budget, the budget is four times the active genotypes, and at least this.  With
+   recombination every lineage reaches back through checkpoints of its own, so spacing them further apart
+   does not hold fewer, and a lineage's next ones are placed before the last ones are superseded */
+#define MIN_CHECKPOINTS 256
+
+BoundedReplay::BoundedReplay(ICompressionPolicy* policy, int maxDepth, double maxCost, int maxCheckpoints) :
+	_policy(policy), _maxDepth(maxDepth), _worstDepth(0), _maxCost(maxCost), _worstCost(0),
+	_maxCheckpoints(maxCheckpoints > 0 ? maxCheckpoints : MIN_CHECKPOINTS), _memoryCap(0), _level(0), _placed(0), _shed(0),
+	_published(false), _scaled(maxCheckpoints <= 0) {}
+
+BoundedReplay::~BoundedReplay() {
+	delete _policy;
+}
+
+void BoundedReplay::operationAdded( IOperation* op ) {
+	_policy->operationAdded( op );
+	int height = 0;
+	for (int i=0; i<op->numParents(); i++) {
+		std::map<IOperation*, int>::iterator it = _heights.find( op->parent(i) );
+		if (it != _heights.end() && it->second + 1 > height) height = it->second + 1;
+	}
+	_heights[op] = height;
+	bound( op );
+}
+
+void BoundedReplay::operationRemoved( IOperation* op ) {
+	_policy->operationRemoved( op );
+	forget( op );
+}
+
+void BoundedReplay::operationActivated( IOperation* op ) {
+	_policy->operationActivated( op );
+	forget( op );
+}
+
+void BoundedReplay::decompressionReleased( IOperation* op ) {
+	_policy->decompressionReleased( op );
+	forget( op );
+	_checkpoints.erase( op );
+	_heights.erase( op );
+}
+
+void BoundedReplay::generationFinished( OperationGraph* heap, const std::set<IOperation*>& active ) {
+	_policy->generationFinished( heap, active );
+	// The wrapped policy moved caches, and may have started background work
+	_reach.clear();
+	_published = false;
+
+	if (_scaled) _maxCheckpoints = std::max( 4*(int)active.size(), MIN_CHECKPOINTS );
+	// Once the checkpoints fit in half the budget, the bounds tighten back a level
+	_memoryCap = MemoryMonitor::instance().relaxCap( _memoryCap, _maxCheckpoints );
+	if (_level > 0 && (int)_checkpoints.size()*2 < budget()) _level--;
+
+	// The wrapped policy may have compressed checkpoints
+	for (OpIter it=active.begin(); it!=active.end(); it++) bound( *it );
+	releaseSuperseded( active );
+}
+
+void BoundedReplay::generationFinished( OperationGraph* heap, const std::vector<IOperation*>& active ) {
+	_policy->generationFinished( heap, active );
+	_reach.clear();
+	_published = false;
+}
+
+void BoundedReplay::memoryPressure( OperationGraph* heap ) {
+	// The bounds give way before the wrapped policy's placement does, and stay relaxed while the cap lasts
+	if (!_checkpoints.empty()) {
+		shed();
+		_memoryCap = std::max( (int)_checkpoints.size(), 1 );
+	}
+	_policy->memoryPressure( heap );
+	_reach.clear();
+}
+
+void BoundedReplay::synchronize() {
+	publish();
+}
+
+void BoundedReplay::publish() {
+	if (_published) return;
+	_policy->synchronize();
+	_published = true;
+	_reach.clear();
+}
+
+BoundedReplay::Reach BoundedReplay::reach( IOperation* op ) {
+	std::vector<IOperation*> pending( 1, op );
+	while (!pending.empty()) {
+		IOperation* cur = pending.back();
+		if (_reach.count( cur ) > 0) {
+			pending.pop_back();
+			continue;
+		}
+		Reach r;
+		r.depth = 0;
+		r.cost = 0;
+		// Reads stop at data that is present, including an encoding
+		if (!cur->isCompressed() || cur->isEncoded() || cur->numParents() == 0) {
+			_reach[cur] = r;
+			pending.pop_back();
+			continue;
+		}
+
+		bool ready = true;
+		for (int i=0; i<cur->numParents(); i++) {
+			if (_reach.count( cur->parent(i) ) == 0) {
+				pending.push_back( cur->parent(i) );
+				ready = false;
+			}
+		}
+		if (!ready) continue;
+
+		// A read follows either parent of a recombinant, so the longer one bounds it
+		for (int i=0; i<cur->numParents(); i++) {
+			const Reach& p = _reach[ cur->parent(i) ];
+			if (p.depth > r.depth) r.depth = p.depth;
+			if (p.cost > r.cost) r.cost = p.cost;
+		}
+		r.depth += 1;
+		r.cost += cur->cost();
+		_reach[cur] = r;
+		pending.pop_back();
+	}
+	return _reach[op];
+}
+
+void BoundedReplay::forget( IOperation* op ) {
+	// Only replays walked through op depend on it, and those are walked with op's
+	if (_reach.erase( op ) == 0) return;
+	const std::set<IOperation*>& children = op->children();
+	std::vector<IOperation*> pending( children.begin(), children.end() );
+	while (!pending.empty()) {
+		IOperation* c = pending.back();
+		pending.pop_back();
+		std::map<IOperation*, Reach>::iterator it = _reach.find( c );
+		// Replays stop at data that is present
+		if (it == _reach.end() || !c->isCompressed() || c->isEncoded()) continue;
+		_reach.erase( it );
+		pending.insert( pending.end(), c->children().begin(), c->children().end() );
+	}
+}
+
+bool BoundedReplay::exceeds( int depth, double cost ) const {
+	return (_maxDepth > 0 && depth > ((long long)_maxDepth << _level)) || (_maxCost > 0 && cost > std::ldexp( _maxCost, _level ));
+}
+
+bool BoundedReplay::exceeds( const Reach& r ) const {
+	return exceeds( r.depth, r.cost );
+}
+
+int BoundedReplay::rank( IOperation* op ) const {
+	std::map<IOperation*, int>::const_iterator it = _heights.find( op );
+	if (it == _heights.end() || it->second <= 0) return 0;
+	int r = 0;
+	for (int h = it->second; (h & 1) == 0; h >>= 1) r++;
+	return r;
+}
+
+IOperation* BoundedReplay::placement( IOperation* op ) {
+	// Checkpointing the ancestor above cur leaves op replaying the operations from op to cur on this path
+	IOperation* best = 0;
+	int bestRank = -1, depth = 0;
+	double cost = 0;
+	for (IOperation* cur = op; ; ) {
+		depth++;
+		cost += cur->cost();
+		// The parent is taken even beyond the bounds: an operation over the cost bound by itself cannot be helped
+		if (best != 0 && exceeds( depth, cost )) break;
+
+		// The parent with the longest replay; it is within the bound itself unless the wrapped policy
+		// compressed the checkpoints above it
+		IOperation* far = 0;
+		for (int i=0; i<cur->numParents(); i++) {
+			IOperation* p = cur->parent(i);
+			if (!p->isCompressed() || p->isEncoded()) continue;
+			if (far == 0 || _reach[p].depth > _reach[far].depth || (_reach[p].depth == _reach[far].depth && _reach[p].cost > _reach[far].cost))
+				far = p;
+		}
+		if (far == 0) break;
+
+		int r = rank( far );
+		if (r >= bestRank) {
+			best = far;
+			bestRank = r;
+		}
+		cur = far;
+	}
+	return best;
+}
+
+void BoundedReplay::bound( IOperation* op ) {
+	Reach r = reach( op );
+	if (!exceeds( r )) return;
+
+	// Background work of the wrapped policy reads the caches changed here, and publishing it moves them
+	publish();
+	r = reach( op );
+	for (;;) {
+		while (exceeds( r )) {
+			IOperation* cp = placement( op );
+			if (cp == 0) break;
+
+			cp->uncompressByReplay();
+			_checkpoints.insert( cp );
+			_placed++;
+
+			forget( cp );
+			r = reach( op );
+		}
+		if ((int)_checkpoints.size() <= budget()) break;
+
+		// Shedding doubles the bounds, so this ends
+		shed();
+		r = reach( op );
+	}
+}
+
+int BoundedReplay::budget() const {
+	return (_memoryCap > 0 && _memoryCap < _maxCheckpoints) ? _memoryCap : _maxCheckpoints;
+}
+
+void BoundedReplay::shed() {
+	int lowest = -1;
+	for (OpIter it=_checkpoints.begin(); it!=_checkpoints.end(); it++) {
+		int r = rank( *it );
+		if (lowest < 0 || r < lowest) lowest = r;
+	}
+	std::vector<IOperation*> dropped;
+	for (OpIter it=_checkpoints.begin(); it!=_checkpoints.end(); it++) {
+		if (rank( *it ) == lowest) dropped.push_back( *it );
+	}
+
+	publish();
+	for (int i=0; i<(int)dropped.size(); i++) {
+		_checkpoints.erase( dropped[i] );
+		dropped[i]->setCompressed(true);
+		forget( dropped[i] );
+	}
+	_shed += dropped.size();
+	_level++;
+}
+
+void BoundedReplay::releaseSuperseded( const std::set<IOperation*>& active ) {
+	// Walk the replays of the active genotypes, noting the uncompressed genotypes they end at
+	std::set<IOperation*> used;
+	std::vector<IOperation*> pending( active.begin(), active.end() );
+	_worstDepth = 0;
+	_worstCost = 0;
+	for (OpIter it=active.begin(); it!=active.end(); it++) {
+		Reach r = reach( *it );
+		if (r.depth > _worstDepth) _worstDepth = r.depth;
+		if (r.cost > _worstCost) _worstCost = r.cost;
+	}
+	std::set<IOperation*> seen;
+	while (!pending.empty()) {
+		IOperation* op = pending.back();
+		pending.pop_back();
+		if (!seen.insert( op ).second) continue;
+		if (!op->isCompressed()) {
+			used.insert( op );
+			continue;
+		}
+		if (op->isEncoded()) continue;
+		for (int i=0; i<op->numParents(); i++) pending.push_back( op->parent(i) );
+	}
+
+	// Superseded checkpoints are compressed, which frees their data.  One the wrapped policy compressed
+	// is no longer ours
+	std::vector<IOperation*> stale;
+	for (OpIter it=_checkpoints.begin(); it!=_checkpoints.end(); it++) {
+		if ((*it)->isCompressed() || used.count( *it ) == 0) stale.push_back( *it );
+	}
+	if (!stale.empty()) publish();
+	for (int i=0; i<(int)stale.size(); i++) {
+		_checkpoints.erase( stale[i] );
+		if (!stale[i]->isCompressed()) stale[i]->setCompressed(true);
+		forget( stale[i] );
+	}
+}
+
+ICompressionPolicy& BoundedReplay::policy() { return *_policy; }
+
+int BoundedReplay::maxDepth() const { return _maxDepth; }
+
+double BoundedReplay::maxCost() const { return _maxCost; }
+
+int BoundedReplay::numCheckpoints() const { return _checkpoints.size(); }
+
+long BoundedReplay::numPlaced() const { return _placed; }
+
+long BoundedReplay::numShed() const { return _shed; }
+
+int BoundedReplay::maxCheckpoints() const { return _maxCheckpoints; }
+
+int BoundedReplay::level() const { return _level; }
+
+int BoundedReplay::worstDepth() const { return _worstDepth; }
+
+double BoundedReplay::worstCost() const { return _worstCost; }
@@ -0,0 +1,156 @@
+/*
+ *  BoundedReplay.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef OPERATION_BOUNDED_REPLAY_
+#define OPERATION_BOUNDED_REPLAY_
+
+#include "Operation/CompressionPolicy.h"
+#include <map>
+#include <set>
+
+namespace GPPG {
+
+	/** BoundedReplay wraps another compression policy and bounds the replay of the active genotypes.
+	 * A read of a compressed genotype replays the operations back to its nearest uncompressed ancestor,
+	 * so under Store-Root or a small k a read of a young genotype can replay thousands of them.  Here no
+	 * active genotype is more than \c maxDepth operations, or \c maxCost in operation cost, away from an
+	 * uncompressed or encoded ancestor (through either parent of a recombinant).
+	 *
+	 * When a new genotype would exceed the bound, one of its ancestors within the bound is uncompressed as
+	 * a checkpoint, so a growing chain gets a checkpoint every maxDepth operations.  Checkpoints are placed
+	 * as in a skip list: the level of an operation is the number of trailing zero bits of its height (its
+	 * distance from the root), and the checkpoint is the ancestor of the highest level within reach.  At
+	 * most \c maxCheckpoints are held; past that, or under memory pressure, the lowest level is shed and
+	 * the bound doubles.  Along a chain the remaining checkpoints (twice as far apart) still meet it, but
+	 * with recombination every lineage reaches back through checkpoints of its own however far apart they
+	 * are, so a budget below about one per active genotype keeps doubling the bound: the bound only holds
+	 * within the budget.  The bound comes back a level at a time once the checkpoints fit again.
+	 *
+	 * After each generation the bound is restored where the wrapped policy compressed a checkpoint, and
+	 * checkpoints no active genotype replays from any more (those superseded by a newer one on the same
+	 * chain) are compressed.  The replays walked are kept for the generation, so a new genotype is bounded
+	 * from its parents' replays; placing a checkpoint forgets only those of its descendants.
+	 */
+	class BoundedReplay : public ICompressionPolicy {
+	public:
+		/** Wrap \param policy (which is then owned by this one) with the bounds \param maxDepth and \param maxCost,
+		 * holding at most \param maxCheckpoints checkpoints; a bound of 0 is not used.  A budget of 0 is four
+		 * times the number of active genotypes, and at least 256.
+		 */
+		BoundedReplay(ICompressionPolicy* policy, int maxDepth, double maxCost, int maxCheckpoints);
+
+		~BoundedReplay();
+
+		void operationAdded( IOperation* op );
+
+		void operationRemoved( IOperation* op );
+
+		void operationActivated( IOperation* op );
+
+		void decompressionReleased( IOperation* op );
+
+		void generationFinished( OperationGraph* heap, const std::set<IOperation*>& active );
+
+		void generationFinished( OperationGraph* heap, const std::vector<IOperation*>& active );
+
+		void memoryPressure( OperationGraph* heap );
+
+		void synchronize();
+
+		/** Retrieve the wrapped policy.
+		 */
+		ICompressionPolicy& policy();
+
+		/** Retrieve the bounds.
+		 */
+		int maxDepth() const;
+		double maxCost() const;
+
+		/** Number of checkpoints currently held, placed in total, and shed to keep within the budget.
+		 */
+		int numCheckpoints() const;
+		long numPlaced() const;
+		long numShed() const;
+
+		/** Checkpoint budget, and the number of times the bounds are currently doubled to keep within it.
+		 */
+		int maxCheckpoints() const;
+		int level() const;
+
+		/** Longest replay of an active genotype, in operations and in cost, after the last generation.
+		 */
+		int worstDepth() const;
+		double worstCost() const;
+
+	private:
+		BoundedReplay(BoundedReplay const&);
+		BoundedReplay const& operator=(BoundedReplay const&);
+
+		/** Replay of a genotype back to its nearest uncompressed ancestors.
+		 */
+		struct Reach {
+			int depth;
+			double cost;
+		};
+
+		/** Computes the replay of \param op, memoised for the generation.
+		 */
+		Reach reach( IOperation* op );
+
+		/** Forgets the replays of \param op and of the descendants walked through it, once its cache changed.
+		 */
+		void forget( IOperation* op );
+
+		/** Publishes the background work of the wrapped policy, which moves caches, and forgets the replays
+		 * walked before.  Nothing is started again until the next generation, so this only waits once.
+		 */
+		void publish();
+
+		/** True if a replay of \param depth operations costing \param cost exceeds the current bounds.
+		 */
+		bool exceeds( int depth, double cost ) const;
+		bool exceeds( const Reach& r ) const;
+
+		/** Skip-list level of \param op: the number of trailing zero bits of its height.
+		 */
+		int rank( IOperation* op ) const;
+
+		/** The checkpoint for \param op, whose replay is walked: the ancestor of the highest level (the
+		 * furthest one among equals) on its longest replay, within the current bounds of it.
+		 */
+		IOperation* placement( IOperation* op );
+
+		/** Places checkpoints above \param op until its replay is within the bounds, and keeps them within
+		 * the budget.
+		 */
+		void bound( IOperation* op );
+
+		/** The budget, lowered while memory is short.
+		 */
+		int budget() const;
+
+		/** Compresses the checkpoints of the lowest level and doubles the bounds.
+		 */
+		void shed();
+
+		/** Compresses the checkpoints none of \param active replays from.
+		 */
+		void releaseSuperseded( const std::set<IOperation*>& active );
+
+		ICompressionPolicy* _policy;
+		std::set<IOperation*> _checkpoints;
+		std::map<IOperation*, int> _heights;
+		std::map<IOperation*, Reach> _reach;
+		int _maxDepth, _worstDepth;
+		double _maxCost, _worstCost;
+		int _maxCheckpoints, _memoryCap, _level;
+		long _placed, _shed;
+		bool _published, _scaled;
+	};
+}
+#endif
@@ -17,8 +17,14 @@ void CompressionPolicy::operationAdded(IOperation* op) {}
 
 void CompressionPolicy::operationRemoved( IOperation* op ) {}
 
+void CompressionPolicy::operationActivated( IOperation* ) {}
+
 void CompressionPolicy::decompressionReleased( IOperation* op ) {}
 
 void CompressionPolicy::generationFinished( OperationGraph* heap, const std::vector<IOperation*>& ) {}
 
-void CompressionPolicy::generationFinished( OperationGraph* heap, const std::set<IOperation*>& ) {}
\ No newline at end of file
+void CompressionPolicy::generationFinished( OperationGraph*, const std::set<IOperation*>& ) {}
+
+void CompressionPolicy::memoryPressure( OperationGraph* ) {}
+
+void CompressionPolicy::synchronize() {}
\ No newline at end of file
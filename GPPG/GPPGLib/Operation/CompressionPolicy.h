@@ -29,6 +29,10 @@ namespace GPPG {
 		 */
 		virtual void operationRemoved( IOperation* op ) = 0;
 		
+		/** Called when an Operation in the OperationGraph becomes active (gains a frequency)
+		 */
+		virtual void operationActivated( IOperation* op ) = 0;
+		
 		/** Called when an uncompressed Operation is deleted by the OperationGraph
 		 */
 		virtual void decompressionReleased( IOperation* op ) = 0;
@@ -39,6 +43,16 @@ namespace GPPG {
 		virtual void generationFinished( OperationGraph* heap, const std::set<IOperation*>& ) = 0;
 
 		virtual void generationFinished( OperationGraph* heap, const std::vector<IOperation*>& ) = 0;
+
+		/** Called when memory use crosses the soft limit of the MemoryMonitor in the middle of a generation.
+		 * The policy should drop cached data, least valuable first, until the monitor is under its limit.
+		 */
+		virtual void memoryPressure( OperationGraph* heap ) = 0;
+		
+		/** Finishes the work the policy runs in the background and applies its results.
+		 * Called before caches are changed outside the policy, since the background work reads them.
+		 */
+		virtual void synchronize() = 0;
 	};
 	
 	/** This class provides a bare-bones implementation of the CompressionPolicy
@@ -49,11 +63,17 @@ namespace GPPG {
 		
 		void operationRemoved( IOperation* op );
 		
+		void operationActivated( IOperation* op );
+		
 		void decompressionReleased( IOperation* op );
 		
 		void generationFinished( OperationGraph* heap, const std::vector<IOperation*>& );
 		
 		void generationFinished( OperationGraph* heap, const std::set<IOperation*>& );
+		
+		void memoryPressure( OperationGraph* heap );
+		
+		void synchronize();
 	};
 }
 
@@ -0,0 +1,105 @@
+/*
+ *  DataView.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef OPERATION_DATA_VIEW_
+#define OPERATION_DATA_VIEW_
+
+#include "Util/Thread.h"
+
+namespace GPPG {
+
+	/** DataView is a reference-counted, read-only handle to the data produced by an Operation.
+	 * Views of a cached Operation share the cache instead of copying it.  A private copy is only made
+	 * when a holder asks to mutate (or take) data that is still shared; if the holder is the last one,
+	 * it takes the data over without a copy.  When an Operation drops its cache, outstanding views keep
+	 * the data alive and the last one deletes it.  The count is atomic, so views of the same data may be
+	 * taken and dropped on different threads.
+	 */
+	template <typename T> class DataView {
+	public:
+		DataView() : _block(0) {}
+
+		/** Creates a view that owns \param data (which may be NULL).
+		 */
+		explicit DataView(T* data) : _block(0) {
+			if (data) _block = new Block(data);
+		}
+
+		DataView(DataView<T> const& v) : _block(v._block) {
+			if (_block) atomicAdd( &_block->refs, 1 );
+		}
+
+		~DataView() { reset(); }
+
+		DataView<T>& operator=(DataView<T> const& v) {
+			if (v._block) atomicAdd( &v._block->refs, 1 );
+			reset();
+			_block = v._block;
+			return *this;
+		}
+
+		bool isNull() const { return _block == 0; }
+
+		/** True if other views share this data.  The count is read atomically, as views of it may be
+		 * dropped on other threads meanwhile.
+		 */
+		bool isShared() const { return _block && atomicAdd( &_block->refs, 0 ) > 1; }
+
+		const T* get() const { return _block ? _block->data : 0; }
+		const T* operator->() const { return get(); }
+		const T& operator*() const { return *get(); }
+
+		/** Returns a mutable pointer to the data, making a private copy first if it is shared.
+		 */
+		T* mutate() {
+			if (isShared()) {
+				T* copy = _block->data->copy();
+				reset();
+				_block = new Block(copy);
+			}
+			return _block ? _block->data : 0;
+		}
+
+		/** Hands the data over to the caller, who must delete it.
+		 * The data is copied only if it is still shared; the view is empty afterwards.
+		 */
+		T* release() {
+			if (!_block) return 0;
+			T* data;
+			if (isShared()) {
+				data = _block->data->copy();
+			} else {
+				data = _block->data;
+				_block->data = 0;
+			}
+			reset();
+			return data;
+		}
+
+		/** Drops this reference; the data is deleted with the last one.
+		 */
+		void reset() {
+			if (_block && atomicAdd( &_block->refs, -1 ) == 0) {
+				if (_block->data) delete _block->data;
+				delete _block;
+			}
+			_block = 0;
+		}
+
+	private:
+		struct Block {
+			Block(T* d) : data(d), refs(1) {}
+			T* data;
+			int refs;
+		};
+
+		Block* _block;
+	};
+}
+
+#endif
@@ -13,7 +13,13 @@
 #include "GPPG.h"
 #include <sstream>
 #include <map>
+#include <vector>
+#include <algorithm>
 #include <Util/Random.h>
+#include <Util/IndexedHeap.h>
+#include <Util/Thread.h>
+#include <Util/BufferPool.h>
+#include <Util/MemoryMonitor.h>
 
 #ifdef UBIGRAPH
 extern "C" {
@@ -37,7 +43,12 @@ template <class T> std::string TToStr( const T &t )
 
 
 GreedyLoad::GreedyLoad(int maxExplicit, int numGens) : 
-	_root(0),_maxExplicit(maxExplicit), _waitGens(numGens), _elapsedGens(0), _numExplicit(0), _runs(0) {}
+	_root(0),_maxExplicit(maxExplicit), _waitGens(numGens), _elapsedGens(0), _numExplicit(0), _runs(0), _memoryCap(0),
+	_materializer(0), _batches(0), _deferred(0) {}
+
+GreedyLoad::~GreedyLoad() {
+	delete _materializer;
+}
 
 void GreedyLoad::decompressionReleased( IOperation* op ) {
 #ifdef DEBUG_0
@@ -47,6 +58,13 @@ void GreedyLoad::decompressionReleased( IOperation* op ) {
 	}
 	std::cout << std::endl;
 #endif
+	// The batch reads the genotypes it evaluates; what it prepared for op goes with op.  Nothing is
+	// published here, as the simulator may remove genotypes on another thread
+	if (_staged.count( op ) > 0) {
+		_materializer->wait();
+		_staged.erase( op );
+	}
+	_leaving.erase( op );
 	_U.erase( op );
 }
 
@@ -58,12 +76,20 @@ void GreedyLoad::operationAdded( IOperation* op) {
 
 void GreedyLoad::generationFinished( OperationGraph* heap, const std::set<IOperation*>& active ) {
 	_elapsedGens++;
+	_memoryCap = MemoryMonitor::instance().relaxCap( _memoryCap, _maxExplicit );
+	bool idle = publish( false );
 
 	if (_elapsedGens == _waitGens) {
 		//heap->clearRequests();
 	}
 	else if (_elapsedGens > _waitGens) {
+		if (!idle) {
+			_deferred++;
+			return;
+		}
 		apply( active );
+		// After apply(), so changes a subclass makes to the caches are not made under the batch
+		launch();
 		// Clear data requests
 		//heap->clearRequests();
 	}
@@ -74,7 +100,56 @@ void GreedyLoad::generationFinished( OperationGraph* heap, const std::set<IOpera
 	}*/
 }
 
+void GreedyLoad::memoryPressure( OperationGraph* ) {
+	synchronize();
+	
+	// Requests counted since the last run tell which genotypes this generation reads the least
+	std::vector< std::pair<long long, IOperation*> > byLoad;
+	for (OpIter it=_U.begin(); it!=_U.end(); it++)
+		if (*it != _root) byLoad.push_back( std::make_pair( load(*it), *it ) );
+	std::sort( byLoad.begin(), byLoad.end() );
+	
+	MemoryMonitor& monitor = MemoryMonitor::instance();
+	int shed = 0;
+	for (; shed<(int)byLoad.size() && monitor.overLimit(); shed++) {
+		remove( byLoad[shed].second );
+		byLoad[shed].second->setCompressed(true);
+		BufferPool::instance().trim();
+	}
+	
+	// The next run would uncompress them again, so k is held to what fits while the pressure lasts
+	if (shed > 0) _memoryCap = _U.size();
+}
+
 void GreedyLoad::apply( const std::set<IOperation*>& active ) {
+	place( active );
+	
+	// Step 5: Apply compression
+	commit();
+
+	// Step 6: Reset
+	clearLoadMap();
+	
+	_runs++;
+	
+	//resetAnnotation( active );
+	//resetAnnotation(_U);
+	//for (OpIter it=_U.begin(); it!=_U.end(); it++) {
+	//	reset( *it );
+	
+		
+#ifdef UBIGRAPH_GL
+		//ubigraph_set_vertex_attribute( (*it)->key(), "label", TToStr<int>((*it)->key()).c_str() );
+		//usleep(1000000);
+#endif
+	//}
+	
+#ifdef UBIGRAPH_GL
+	ubigraph_set_vertex_attribute( 0, "label", "Simulating" );
+#endif
+}
+
+void GreedyLoad::place( const std::set<IOperation*>& active ) {
 	_elapsedGens = 0;
 	
 #ifdef UBIGRAPH_GL
@@ -111,6 +186,17 @@ void GreedyLoad::apply( const std::set<IOperation*>& active ) {
 			remove(op);
 	}
 	
+	// Step 2b: Drop the least loaded ones if k was lowered
+	int k = effectiveMaxUncompressed();
+	if ((int)_U.size() > k) {
+		std::vector< std::pair<long long, IOperation*> > byLoad;
+		for (it=_U.begin(); it!=_U.end(); it++)
+			if (*it != _root) byLoad.push_back( std::make_pair( load(*it), *it ) );
+		std::sort( byLoad.begin(), byLoad.end() );
+		for (int i=0; (int)_U.size() > k && i<(int)byLoad.size(); i++)
+			remove( byLoad[i].second );
+	}
+	
 	// Step 3: Advance down
 #ifdef UBIGRAPH_GL
 	//ubigraph_set_vertex_attribute( 0, "label", "Advance" );
@@ -123,91 +209,89 @@ void GreedyLoad::apply( const std::set<IOperation*>& active ) {
 			advance( op );
 	}
 	
-	// Step 4: Split
-	// Make a copy of the set
-	set<IOperation*> C = _U;
+	// Step 4: Split (the candidates are copied out of U)
+	splitAll( _U );
+}
+
+void GreedyLoad::splitAll( const std::set<IOperation*>& C ) {
 	int s1, s2;
 	IOperation* g1, *g2;
 	
-#ifdef UBIGRAPH_GL
-	//ubigraph_set_vertex_attribute( 0, "label", "Split" );
-#endif
-	while (_U.size() < _maxExplicit && C.size() > 0) {
-		IOperation* op = getMaxItem( C, false );
-		if (op == 0) {
+	// Candidates by load; split only changes the load of the genotype it splits
+	IndexedHeap<IOperation*> heap;
+	for (OpIter it=C.begin(); it!=C.end(); it++)
+		heap.push( *it, load(*it) );
+	
+	int k = effectiveMaxUncompressed();
+	while ((int)_U.size() < k && !heap.empty()) {
+		if (heap.topKey() <= 0) {
 			std::cout << "No max item found\n";
 			break;
 		}
+		IOperation* op = heap.top();
 		
-#ifdef UBIGRAPH_GL
-		//ubigraph_set_vertex_attribute( op->key(), "label", "Spliting..." );
-#endif
 		split( op, s1, s2, g1, g2 );
 		
 		if (s1 == 0) {
-			C.erase( op );
+			heap.erase( op );
 		} else {
-			C.insert( g1 );
+			heap.push( g1, load(g1) );
 			if (s2 == 1) {
-				C.erase( op );
-				C.insert( g2 );
+				heap.erase( op );
+				heap.push( g2, load(g2) );
+			} else {
+				heap.push( op, load(op) );
 			}
 		}
-#ifdef UBIGRAPH_GL
-		//usleep(1000000);		
-		//ubigraph_set_vertex_attribute( op->key(), "label", "" );
-#endif
-	
 	}
-	
-	
-	// Step 5: Apply compression
-	/*
-	for (OpIter it=_V.begin(); it!=_V.end(); it++) 
-		ubigraph_set_vertex_attribute( (*it)->key(), "label", "V" );
-			
-	for (OpIter it=_U.begin(); it!=_U.end(); it++) {
-		if( _runs > 5 ) usleep(100000);
-		ubigraph_set_vertex_attribute( (*it)->key(), "label", "Z" );		
-		(*it)->setCompressed(false);
-		if (_runs > 5 && _root->requests() > 0)
-			ubigraph_set_vertex_attribute( (*it)->key(), "label", "P" );
-		else 
-			ubigraph_set_vertex_attribute( (*it)->key(), "label", "W" );
+}
+
+void GreedyLoad::commit() {
+	if (_materializer) {
+		// Nothing changes until launch() and publish()
+		_staged.clear();
+		_leaving.clear();
+		for (OpIter it=_U.begin(); it!=_U.end(); it++)
+			if ((*it)->isCompressed()) _staged.insert( *it );
+		for (OpIter it=_V.begin(); it!=_V.end(); it++)
+			if (_U.count( *it ) == 0) _leaving.insert( *it );
+		return;
 	}
-	
+	Materializer::uncompress( std::vector<IOperation*>( _U.begin(), _U.end() ) );
 	for (OpIter it=_V.begin(); it!=_V.end(); it++) 
-		if (_U.count( *it ) == 0) {
-			(*it)->setCompressed(true);
-			ubigraph_set_vertex_attribute( (*it)->key(), "label", "" );
-		}
-	*/
+		if (_U.count( *it ) == 0) release( *it );
+}
 
-	for (OpIter it=_U.begin(); it!=_U.end(); it++)
-		(*it)->setCompressed(false);
-	for (OpIter it=_V.begin(); it!=_V.end(); it++) 
-		if (_U.count( *it ) == 0) (*it)->setCompressed(true);
+void GreedyLoad::launch() {
+	if (!_materializer || _materializer->busy()) return;
+	if (!_staged.empty()) {
+		_materializer->start( std::vector<IOperation*>( _staged.begin(), _staged.end() ) );
+		return;
+	}
+	// Only departures; they need no evaluation
+	for (OpIter it=_leaving.begin(); it!=_leaving.end(); it++) release( *it );
+	_leaving.clear();
+}
 
-	// Step 6: Reset
-	clearLoadMap();
-	
-	_runs++;
+bool GreedyLoad::publish(bool wait) {
+	if (!_materializer || (_staged.empty() && _leaving.empty())) return true;
+	if (!wait && !_materializer->done()) return false;
 	
-	//resetAnnotation( active );
-	//resetAnnotation(_U);
-	//for (OpIter it=_U.begin(); it!=_U.end(); it++) {
-	//	reset( *it );
-	
-		
-#ifdef UBIGRAPH_GL
-		//ubigraph_set_vertex_attribute( (*it)->key(), "label", TToStr<int>((*it)->key()).c_str() );
-		//usleep(1000000);
-#endif
-	//}
-	
-#ifdef UBIGRAPH_GL
-	ubigraph_set_vertex_attribute( 0, "label", "Simulating" );
-#endif
+	_materializer->wait();
+	for (OpIter it=_staged.begin(); it!=_staged.end(); it++) (*it)->publishCache();
+	for (OpIter it=_leaving.begin(); it!=_leaving.end(); it++) release( *it );
+	_staged.clear();
+	_leaving.clear();
+	_batches++;
+	return true;
+}
+
+void GreedyLoad::synchronize() {
+	publish( true );
+}
+
+void GreedyLoad::release(IOperation* op) {
+	op->setCompressed(true);
 }
 
 void GreedyLoad::clearLoadMap() {
@@ -215,7 +299,7 @@ void GreedyLoad::clearLoadMap() {
 		(*it)->clearDescendentRequests();
 }
 
-void GreedyLoad::setLoad(IOperation* op, int v) {
+void GreedyLoad::setLoad(IOperation* op, long long v) {
 	if( v == 0) op->clearRequests();
 	else op->setRequests(v);
 }
@@ -224,12 +308,16 @@ void GreedyLoad::incrLoad(IOperation* op, int v) {
 	op->incrRequests( v );
 }
 
-void GreedyLoad::decrLoad(IOperation* op, int v) {
+void GreedyLoad::decrLoad(IOperation* op, long long v) {
 	op->decrRequests( v );
 }
 
+void GreedyLoad::withdrawLoad(IOperation* op, long long reads) {
+	op->withdrawReads( reads );
+}
+
 
-int GreedyLoad::load(IOperation* op) {
+long long GreedyLoad::load(IOperation* op) {
 	return op->requests();
 }
 
@@ -245,7 +333,7 @@ void GreedyLoad::split( IOperation* op, int& s1, int& s2, IOperation*& g1, IOper
 	}
 	
 	//op->setLoad( op->load() - c->load() - op->cost()*c->loadFreq(), op->loadFreq()-c->loadFreq() );
-	int l = load(op)-load(c);
+	long long l = load(op)-load(c);
 	op->setRequests( (l<=0)?1:l);
 	
 	c = findMaxAdvance( c, true );
@@ -352,11 +440,31 @@ void GreedyLoad::advance( IOperation* op ) {
 }
 
 
-void GreedyLoad::annotate(const std::set<IOperation*>& active) {
-	for (OpIter it=active.begin(); it!=active.end(); it++) {
-		IOperation* op = *it;
-		op->touch();
+/* Touches a range of active genotypes; a genotype reached from several threads is expanded by only one */
+class TouchTask : public ParallelTask {
+public:
+	TouchTask(const std::vector<IOperation*>& ops) : _ops(ops) {}
+	
+	void run(int begin, int end, int) {
+		std::vector<IOperation*> pending;
+		for (int i=begin; i<end; i++) {
+			pending.push_back( _ops[i] );
+			while (!pending.empty()) {
+				IOperation* op = pending.back();
+				pending.pop_back();
+				op->touch( pending );
+			}
+		}
 	}
+	
+private:
+	const std::vector<IOperation*>& _ops;
+};
+
+void GreedyLoad::annotate(const std::set<IOperation*>& active) {
+	std::vector<IOperation*> ops( active.begin(), active.end() );
+	TouchTask task( ops );
+	ThreadPool::instance().parallelFor( ops.size(), task, 64 );
 }
 
 
@@ -372,4 +480,29 @@ void GreedyLoad::reset(IOperation* op) {
 
 int GreedyLoad::maxUncompressed() const { return _maxExplicit; }
 
-int GreedyLoad::numGenerations() const { return _waitGens; }
\ No newline at end of file
+void GreedyLoad::setMaxUncompressed(int k) { _maxExplicit = (k < 1) ? 1 : k; }
+
+int GreedyLoad::effectiveMaxUncompressed() const {
+	return (_memoryCap > 0 && _memoryCap < _maxExplicit) ? _memoryCap : _maxExplicit;
+}
+
+int GreedyLoad::numGenerations() const { return _waitGens; }
+
+void GreedyLoad::setNumGenerations(int t) { _waitGens = t; }
+
+void GreedyLoad::setBackground(bool b) {
+	if (b == background()) return;
+	if (!b) {
+		synchronize();
+		delete _materializer;
+		_materializer = 0;
+		return;
+	}
+	_materializer = new Materializer();
+}
+
+bool GreedyLoad::background() const { return _materializer != 0; }
+
+long GreedyLoad::numBatches() const { return _batches; }
+
+long GreedyLoad::numDeferred() const { return _deferred; }
\ No newline at end of file
@@ -11,6 +11,7 @@
 #define OPERATION_GREEDY_LOAD_
 
 #include "Operation/CompressionPolicy.h"
+#include "Operation/Materializer.h"
 #include <set>
 #include <map>
 
@@ -23,32 +24,94 @@ namespace GPPG {
 		 */
 		GreedyLoad(int maxExplicit, int numGens);
 		
+		/** Waits for the background batch, if one is running.
+		 */
+		~GreedyLoad();
+		
 		void decompressionReleased( IOperation* op );
 		
 		void operationAdded(IOperation* op);
 		
 		void generationFinished( OperationGraph* heap, const std::set<IOperation*>& active );
 		
+		/** Compresses the least requested uncompressed genotypes (never the root) until the MemoryMonitor
+		 * is under its limit, and caps k at the number left so the next run does not undo it.  The cap
+		 * grows back to the configured k while the monitor stays under its limit (see
+		 * MemoryMonitor::relaxCap()).
+		 */
+		void memoryPressure( OperationGraph* heap );
+		
+		/** Waits for the background batch, if any, and publishes it.
+		 */
+		void synchronize();
+		
 		/** Force an update by the policy.
 		 * This resets the count of elapsed generations.
 		 */
-		void apply( const std::set<IOperation*>& active );
+		virtual void apply( const std::set<IOperation*>& active );
 		
 		/** Retrieve the maximum number of uncompressed genotypes.
 		 * This is the 'k' parameter in the paper.
 		 */
 		int maxUncompressed() const;
 		
+		/** Change the maximum number of uncompressed genotypes; it takes effect at the next run.
+		 * When it is lowered, the least loaded genotypes are compressed.
+		 */
+		void setMaxUncompressed(int k);
+		
+		/** The k runs use: maxUncompressed(), or less while the cap set by memoryPressure() holds.
+		 */
+		int effectiveMaxUncompressed() const;
+		
 		/** Retrieve the number of generations to elapse.
 		 * This is the 't' parameter in the paper.
 		 */
 		int numGenerations() const;
+		void setNumGenerations(int t);
 		
-	private:
-		GreedyLoad(GreedyLoad const&);
-		GreedyLoad const& operator=(GreedyLoad const&);
+		/** Uncompress the genotypes chosen by a run on a background thread (see Materializer).
+		 * The run itself still happens at the generation boundary, but its new genotypes are evaluated while
+		 * the simulation goes on, and published at the first boundary after they are done; the genotypes
+		 * leaving the uncompressed set stay uncompressed until then.  Runs that fall due before that are
+		 * put off to the boundary that publishes.
+		 */
+		void setBackground(bool b);
+		bool background() const;
 		
+		/** Number of background batches published, and of generation boundaries a run was put off at.
+		 */
+		long numBatches() const;
+		long numDeferred() const;
 		
+	protected:
+		/** Steps 0 to 4 of apply(): chooses the new uncompressed set U for \param active, keeping the
+		 * current one in V, without changing any cache.
+		 */
+		void place( const std::set<IOperation*>& active );
+		
+		/** Called for each genotype that leaves the uncompressed set; the default compresses it.
+		 */
+		virtual void release(IOperation* op);
+		
+		/** Step 4 of apply(): splits the most loaded of the uncompressed genotypes \param C until there are
+		 * maxUncompressed() of them.  The candidates are kept in an IndexedHeap, so this is O(k log k).
+		 */
+		void splitAll(const std::set<IOperation*>& C);
+		
+		/** Step 5 of apply(): (un)compresses the genotypes that entered or left the uncompressed set.
+		 * In the background mode they are only staged for launch().
+		 */
+		void commit();
+		
+		/** Publishes the background batch if it is done, or after waiting for it if \param wait.
+		 * Returns false if the batch is still running; true if there was none.
+		 */
+		bool publish(bool wait);
+		
+		/** Starts the background batch for what commit() staged.
+		 */
+		void launch();
 		
 		void advance(IOperation* op);
 		
@@ -60,10 +123,11 @@ namespace GPPG {
 		void split( IOperation* op, int& s1, int& s2, IOperation*& g1, IOperation*& g2 );
 		
 		// Methods for annotating load
-		void setLoad(IOperation* op, int c);
+		void setLoad(IOperation* op, long long c);
 		void incrLoad(IOperation* op, int c);
-		void decrLoad(IOperation* op, int c);
-		int load(IOperation* op);
+		void decrLoad(IOperation* op, long long c);
+		void withdrawLoad(IOperation* op, long long reads);
+		long long load(IOperation* op);
 		void clearLoadMap();
 		void annotate(const std::set<IOperation*>&);
 		void reset(IOperation* op);
@@ -78,6 +142,16 @@ namespace GPPG {
 		std::set<IOperation*> _U, _V;
 		IOperation* _root;
 		int _maxExplicit, _elapsedGens, _numExplicit, _waitGens, _runs;
+		int _memoryCap;	/* k under memory pressure; 0 if there is none */
+		
+		// Background runs: the genotypes being evaluated and the ones leaving U when they are published
+		Materializer* _materializer;
+		std::set<IOperation*> _staged, _leaving;
+		long _batches, _deferred;
+		
+	private:
+		GreedyLoad(GreedyLoad const&);
+		GreedyLoad const& operator=(GreedyLoad const&);
 	};
 }
 #endif
@@ -12,6 +12,7 @@
 #include "GPPG.h"
 #include <sstream>
 #include <map>
+#include <vector>
 #include <Util/Random.h>
 
 #ifdef UBIGRAPH
@@ -368,12 +369,20 @@ void GreedyLoadMap::resetAnnotation(IOperation* op, bool reset) {
 }
 
 void GreedyLoadMap::reverseAnnotate(IOperation* op, double freq, double cost) {
-	if (load(op) == 0) return;
-	
-	decrLoad(op, freq, cost );
-	if (isCompressed(op) && op->numParents() > 0) {
-		for (int i=0; i<op->numParents(); i++) 
-			reverseAnnotate( op->parent(i), freq, cost+op->cost());
+	// Depth first, in the order of the recursive definition
+	std::vector< std::pair<IOperation*, double> > pending;
+	pending.push_back( std::make_pair(op, cost) );
+	while (!pending.empty()) {
+		op = pending.back().first;
+		cost = pending.back().second;
+		pending.pop_back();
+		if (load(op) == 0) continue;
+		
+		decrLoad(op, freq, cost );
+		if (isCompressed(op)) {
+			for (int i=op->numParents()-1; i>=0; i--) 
+				pending.push_back( std::make_pair(op->parent(i), cost+op->cost()) );
+		}
 	}
 }
 
@@ -385,30 +394,21 @@ void GreedyLoadMap::annotate(const std::set<IOperation*>& active) {
 }
 
 void GreedyLoadMap::innerAnnotate(IOperation* op, double freq, double cost ) {
-	incrLoad(op, freq, cost ); 
-	/*
-	if (op->isCompressed() && op->numParents() > 0) {
-		for (int i=0; i<op->numParents(); i++) 
-			innerAnnotate( op->parent(i), freq, cost+op->cost() );
-	}
-	 */
-	
-	int p = op->numParents();
-	
-	if (op->isCompressed()) {
-		if(p == 1) 
-			innerAnnotate(op->parent(0), freq, cost+op->cost() );
-		else if(p==2) {
-			if( random01() < 0.5 ) {
-				innerAnnotate(op->parent(0), freq, cost+op->cost() );
-			} else {
-				innerAnnotate(op->parent(1), freq, cost+op->cost() );
-			}
-
+	// The load follows a single path up (a random parent at recombinations)
+	while (op != 0) {
+		incrLoad(op, freq, cost ); 
+		
+		int p = op->numParents();
+		IOperation* next = 0;
+		if (op->isCompressed()) {
+			if(p == 1) 
+				next = op->parent(0);
+			else if(p==2)
+				next = ( random01() < 0.5 ) ? op->parent(0) : op->parent(1);
 		}
-
+		cost += op->cost();
+		op = next;
 	}
-	
 }
 /*
 void GreedyLoadMap::resetOp(IOperation* op) {
@@ -416,10 +416,15 @@ void GreedyLoadMap::resetOp(IOperation* op) {
 }
 */
 void GreedyLoadMap::reset(IOperation* op) {
-	if (load(op) > 0 || op->isActive()) {
-		setLoad(op,0,0);
-		for (int i=0; i<op->numParents(); i++) {
-			reset( op->parent(i) );
+	std::vector<IOperation*> pending(1, op);
+	while (!pending.empty()) {
+		op = pending.back();
+		pending.pop_back();
+		if (load(op) > 0 || op->isActive()) {
+			setLoad(op,0,0);
+			for (int i=op->numParents()-1; i>=0; i--) {
+				pending.push_back( op->parent(i) );
+			}
 		}
 	}
 }
@@ -0,0 +1,163 @@
+/*
+ *  IncrementalLoad.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "IncrementalLoad.h"
+#include "Operation/Operation.h"
+#include "Util/MemoryMonitor.h"
+#include <map>
+#include <vector>
+
+using namespace GPPG;
+
+using std::set;
+
+typedef set<IOperation*>::iterator OpIter;
+
+IncrementalLoad::IncrementalLoad(int maxExplicit, int numGens, int maxSteps) :
+	GreedyLoad(maxExplicit, numGens), _maxSteps(maxSteps), _repairs(0) {}
+
+void IncrementalLoad::operationAdded( IOperation* op ) {
+	// A new child may change which child of its parent is uncovered
+	_dirty.insert( op );
+}
+
+void IncrementalLoad::operationRemoved( IOperation* op ) {
+	long long reads = ownReads( op );
+	if (reads > 0) withdraw( op, reads );
+	_dirty.insert( op );
+}
+
+void IncrementalLoad::operationActivated( IOperation* op ) {
+	// Annotate the new load; touch() stops at the first annotated or uncompressed ancestor
+	op->touch();
+	_dirty.insert( op );
+}
+
+void IncrementalLoad::decompressionReleased( IOperation* op ) {
+	GreedyLoad::decompressionReleased( op );
+	_dirty.erase( op );
+	// The parents survive op unless they are released next
+	for (int i=0; i<op->numParents(); i++)
+		_dirty.insert( op->parent(i) );
+}
+
+void IncrementalLoad::generationFinished( OperationGraph*, const std::set<IOperation*>& active ) {
+	_elapsedGens++;
+	_memoryCap = MemoryMonitor::instance().relaxCap( _memoryCap, _maxExplicit );
+	// Repairs wait for the background batch too; the dirty genotypes are kept until then
+	if (!publish( false )) {
+		_deferred++;
+		return;
+	}
+	
+	if (_root == 0 || _elapsedGens > _waitGens) apply( active );
+	else repair();
+	launch();
+}
+
+void IncrementalLoad::apply( const std::set<IOperation*>& active ) {
+	GreedyLoad::apply( active );
+	_dirty.clear();
+	
+	// The batch run clears the annotation; restore it for the genotypes still alive
+	annotate( active );
+}
+
+void IncrementalLoad::repair() {
+	set<IOperation*> C;
+	for (OpIter it=_dirty.begin(); it!=_dirty.end(); it++) {
+		IOperation* u = cover( *it );
+		if (u) C.insert( u );
+	}
+	_dirty.clear();
+	if (C.size() == 0) return;
+	
+	_V = _U;
+	
+	// Step 2 of GreedyLoad::apply, restricted to the covering genotypes.  Only genotypes nothing below
+	// still reads through are dropped; one that is merely unread since the last run keeps its slot.
+	set<IOperation*> todo = C;
+	for (OpIter it=todo.begin(); it!=todo.end(); it++) {
+		if (*it != _root && isDefunct( *it )) {
+			remove( *it );
+			C.erase( *it );
+		}
+	}
+	
+	// Step 3, advancing the ones left
+	todo = C;
+	for (OpIter it=todo.begin(); it!=todo.end(); it++) {
+		IOperation* op = *it;
+		if (op == _root) continue;
+		IOperation* t = findMaxAdvance( op, true );
+		if (t != op) {
+			move( op, t );
+			C.erase( op );
+			C.insert( t );
+		}
+	}
+	
+	// Step 4: refill freed slots from the covering genotypes, then step 5
+	splitAll( C );
+	commit();
+	_repairs++;
+}
+
+IOperation* IncrementalLoad::cover( IOperation* op ) {
+	for (int i=0; op != 0 && i<=_maxSteps; i++) {
+		if (!isCompressed( op )) return op;
+		op = (op->numParents() > 0) ? op->parent(0) : 0;
+	}
+	return 0;
+}
+
+long long IncrementalLoad::ownReads( IOperation* op ) {
+	long long reads = op->reads();
+	// Reads of a compressed child are replayed through op
+	const set<IOperation*>& children = op->children();
+	for (OpIter it=children.begin(); it!=children.end(); it++) {
+		IOperation* c = *it;
+		if (c->isCompressed()) reads -= c->reads();
+	}
+	return (reads > 0) ? reads : 0;
+}
+
+void IncrementalLoad::withdraw( IOperation* op, long long reads ) {
+	withdrawLoad( op, reads );
+	if (!op->isCompressed()) return;
+	
+	// A read replays an ancestor once per path to it, so the reads are carried up a level at a time
+	// and summed where paths meet.  As in cover(), at most maxSteps levels are walked; loads above
+	// are left to the next full run.
+	std::map<IOperation*, long long> level, next;
+	for (int i=0; i<op->numParents(); i++) level[ op->parent(i) ] += reads;
+	for (int s=0; s<_maxSteps && !level.empty(); s++) {
+		for (std::map<IOperation*, long long>::iterator it=level.begin(); it!=level.end(); it++) {
+			IOperation* a = it->first;
+			withdrawLoad( a, it->second );
+			if (!a->isCompressed()) continue;
+			for (int i=0; i<a->numParents(); i++) next[ a->parent(i) ] += it->second;
+		}
+		level.swap( next );
+		next.clear();
+	}
+}
+
+bool IncrementalLoad::isDefunct( IOperation* op ) {
+	if (load(op) > 0 || op->isActive()) return false;
+	const set<IOperation*>& children = op->children();
+	for (OpIter it=children.begin(); it!=children.end(); it++) {
+		IOperation* c = *it;
+		if (isCompressed(c) && (load(c) > 0 || c->isActive())) return false;
+	}
+	return true;
+}
+
+int IncrementalLoad::maxSteps() const { return _maxSteps; }
+
+long IncrementalLoad::numRepairs() const { return _repairs; }
@@ -0,0 +1,84 @@
+/*
+ *  IncrementalLoad.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef OPERATION_INCREMENTAL_LOAD_
+#define OPERATION_INCREMENTAL_LOAD_
+
+#include "Operation/GreedyLoad.h"
+#include <set>
+
+namespace GPPG {
+	
+	/** IncrementalLoad keeps the GreedyLoad placement up to date between its periodic runs.
+	 * Added, activated and removed genotypes are annotated as they arrive and queued.  At the end of each
+	 * generation only the uncompressed genotypes covering the queued ones are revisited: they are advanced
+	 * and freed slots are filled by splitting them, as in the steps of GreedyLoad::apply.  Finding the covering genotype walks at most \c maxSteps ancestors, so the work
+	 * per event is bounded.  Every \c numGens generations the full GreedyLoad algorithm is rerun, which
+	 * resynchronises the placement with the batch one.
+	 * The load of a genotype is the cost of the reads made through it.  When a genotype is removed, its
+	 * own reads are taken back out of the loads of the ancestors they were replayed through (at most
+	 * \c maxSteps up), so the loads stay those of the genotypes still alive, and covering genotypes left
+	 * without load are dropped.
+	 */
+	class IncrementalLoad : public GreedyLoad {
+	public:
+		/** Create an IncrementalLoad policy with the GreedyLoad parameters \param maxExplicit and \param numGens
+		 * (here the number of generations between full runs), walking at most \param maxSteps ancestors per event.
+		 */
+		IncrementalLoad(int maxExplicit, int numGens, int maxSteps);
+		
+		void operationAdded( IOperation* op );
+		
+		void operationRemoved( IOperation* op );
+		
+		void operationActivated( IOperation* op );
+		
+		void decompressionReleased( IOperation* op );
+		
+		void generationFinished( OperationGraph* heap, const std::set<IOperation*>& active );
+		
+		void apply( const std::set<IOperation*>& active );
+		
+		/** Retrieve the maximum number of ancestors visited per event.
+		 */
+		int maxSteps() const;
+		
+		/** Retrieve the number of local repairs done since construction.
+		 */
+		long numRepairs() const;
+		
+	private:
+		/** Revisits the uncompressed genotypes covering the queued events.
+		 */
+		void repair();
+		
+		/** Returns the uncompressed genotype at most maxSteps() ancestors above \param op, or NULL.
+		 */
+		IOperation* cover(IOperation* op);
+		
+		/** Number of reads of \param op itself, i.e. not made on the way to one of its compressed children.
+		 */
+		long long ownReads(IOperation* op);
+		
+		/** Takes \param reads reads of \param op, with the load they added at whatever cost they were counted,
+		 * out of its load and the loads of the ancestors they were replayed through, up to the first
+		 * uncompressed ones and at most maxSteps() above.  An ancestor reached along several paths gives
+		 * back the reads of each.
+		 */
+		void withdraw(IOperation* op, long long reads);
+		
+		/** True if \param op is unloaded, inactive and has no loaded or active compressed child.
+		 */
+		bool isDefunct(IOperation* op);
+		
+		std::set<IOperation*> _dirty;
+		int _maxSteps;
+		long _repairs;
+	};
+}
+#endif
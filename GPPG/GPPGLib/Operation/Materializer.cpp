@@ -0,0 +1,136 @@
+/*
+ *  Materializer.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "Materializer.h"
+#include "Operation/Operation.h"
+
+using namespace GPPG;
+
+/* Evaluates the genotypes of one wave; none of them replays through another */
+class WaveTask : public ParallelTask {
+public:
+	WaveTask(const std::vector<IOperation*>& ops) : _ops(ops) {}
+	
+	void run(int begin, int end, int) {
+		BaseOperation::setCountingRequests( false );
+		for (int i=begin; i<end; i++) _ops[i]->prepareCache();
+		BaseOperation::setCountingRequests( true );
+	}
+	
+private:
+	const std::vector<IOperation*>& _ops;
+};
+
+Materializer::Materializer() : _finished(0), _busy(false) {}
+
+Materializer::~Materializer() {
+	_thread.join();
+}
+
+void Materializer::start(const std::vector<IOperation*>& ops) {
+	if (_busy) throw "Materializer: the previous batch is still running";
+	_batch = ops;
+	_waves.clear();
+	order( _batch, _waves );
+	_error.clear();
+	_finished = 0;
+	_busy = true;
+	_thread.start( this );
+}
+
+bool Materializer::busy() const { return _busy; }
+
+bool Materializer::done() {
+	return !_busy || atomicAdd( &_finished, 0 ) != 0;
+}
+
+void Materializer::wait() {
+	if (!_busy) return;
+	_thread.join();
+	_busy = false;
+	if (!_error.empty()) {
+		// The message must outlive this call
+		static std::string message;
+		message = _error;
+		throw message.c_str();
+	}
+}
+
+const std::vector<IOperation*>& Materializer::batch() const { return _batch; }
+
+void Materializer::run() {
+	BaseOperation::setCountingRequests( false );
+	BaseOperation::setReadingPrepared( true );
+	try {
+		for (int w=0; w<(int)_waves.size(); w++)
+			for (int i=0; i<(int)_waves[w].size(); i++) _waves[w][i]->prepareCache();
+	} catch (const char* e) {
+		_error = e;
+	}
+	BaseOperation::setReadingPrepared( false );
+	BaseOperation::setCountingRequests( true );
+	atomicAdd( &_finished, 1 );
+}
+
+void Materializer::uncompress(const std::vector<IOperation*>& ops) {
+	std::vector< std::vector<IOperation*> > waves;
+	order( ops, waves );
+	
+	for (int w=0; w<(int)waves.size(); w++) {
+		WaveTask task( waves[w] );
+		ThreadPool::instance().parallelFor( waves[w].size(), task );
+		for (int i=0; i<(int)waves[w].size(); i++) waves[w][i]->publishCache();
+	}
+}
+
+void Materializer::order(const std::vector<IOperation*>& ops, std::vector< std::vector<IOperation*> >& waves) {
+	std::set<IOperation*> targets;
+	for (int i=0; i<(int)ops.size(); i++)
+		if (ops[i]->isCompressed()) targets.insert( ops[i] );
+	
+	std::map<IOperation*, int> memo;
+	for (std::set<IOperation*>::iterator it=targets.begin(); it!=targets.end(); it++) {
+		int w = waveOf( *it, targets, memo );
+		if (w >= (int)waves.size()) waves.resize( w+1 );
+		waves[w].push_back( *it );
+	}
+}
+
+int Materializer::waveOf(IOperation* op, const std::set<IOperation*>& targets, std::map<IOperation*, int>& memo) {
+	std::vector<IOperation*> pending( 1, op );
+	while (!pending.empty()) {
+		IOperation* cur = pending.back();
+		if (memo.count( cur ) > 0) {
+			pending.pop_back();
+			continue;
+		}
+		bool target = targets.count( cur ) > 0;
+		// Replays stop at data that is present, including an encoding
+		if (!cur->isCompressed() || cur->isEncoded() || cur->numParents() == 0) {
+			memo[cur] = target ? 0 : -1;
+			pending.pop_back();
+			continue;
+		}
+		
+		bool ready = true;
+		for (int i=0; i<cur->numParents(); i++) {
+			if (memo.count( cur->parent(i) ) == 0) {
+				pending.push_back( cur->parent(i) );
+				ready = false;
+			}
+		}
+		if (!ready) continue;
+		
+		int w = -1;
+		for (int i=0; i<cur->numParents(); i++)
+			if (memo[ cur->parent(i) ] > w) w = memo[ cur->parent(i) ];
+		memo[cur] = target ? w+1 : w;
+		pending.pop_back();
+	}
+	return memo[op];
+}
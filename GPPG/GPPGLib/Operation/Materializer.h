@@ -0,0 +1,90 @@
+/*
+ *  Materializer.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef OPERATION_MATERIALIZER_
+#define OPERATION_MATERIALIZER_
+
+#include "Util/Thread.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace GPPG {
+	class IOperation;
+
+	/** Materializer evaluates a batch of genotypes on a background thread.
+	 * Each one is evaluated with IOperation::prepareCache(), which leaves the graph untouched, so the
+	 * simulation can keep reading it meanwhile; the owner publishes the results (publishCache()) on its
+	 * own thread once the batch is done.  The batch is evaluated in the waves of uncompress(), and reads
+	 * the genotypes of the earlier waves from what it prepared for them.  Until then the owner must not change the caches the batch
+	 * reads, nor delete the genotypes in it.  Reads made by the batch are not counted as requests.
+	 * Without thread support, start() evaluates the batch before it returns.
+	 *
+	 * uncompress() is the synchronous counterpart, which uncompresses a set of genotypes in parallel.
+	 */
+	class Materializer : public Runnable {
+	public:
+		Materializer();
+
+		/** Waits for the batch still running.
+		 */
+		~Materializer();
+
+		/** Starts evaluating \param ops; the previous batch must have been waited for.  The waves are
+		 * ordered here, on the owner's thread.
+		 */
+		void start(const std::vector<IOperation*>& ops);
+
+		/** True from start() until wait().
+		 */
+		bool busy() const;
+
+		/** True once the batch has finished; this never blocks.
+		 */
+		bool done();
+
+		/** Waits for the batch to finish.  An error thrown by an evaluation is thrown again here.
+		 */
+		void wait();
+
+		/** Retrieve the genotypes of the current batch.
+		 */
+		const std::vector<IOperation*>& batch() const;
+
+		void run();
+
+		/** Uncompresses \param ops on the ThreadPool, in waves.  A genotype whose replay reaches another one
+		 * in the set goes in a later wave, and each wave is cached before the next one starts, so it replays
+		 * from the genotypes uncompressed before it; the genotypes of a wave are evaluated concurrently.
+		 * As for a batch, the reads made to uncompress them are not counted as requests.
+		 */
+		static void uncompress(const std::vector<IOperation*>& ops);
+
+	private:
+		Materializer(Materializer const&);
+		Materializer& operator=(Materializer const&);
+
+		/** Wave of \param op among \param targets: for a target, one past the latest wave of the targets
+		 * its replay reaches; for another genotype, the latest of those waves (-1 for none).
+		 */
+		static int waveOf(IOperation* op, const std::set<IOperation*>& targets, std::map<IOperation*, int>& memo);
+
+		/** Splits the compressed genotypes of \param ops into \param waves.
+		 */
+		static void order(const std::vector<IOperation*>& ops, std::vector< std::vector<IOperation*> >& waves);
+
+		Thread _thread;
+		std::vector<IOperation*> _batch;
+		std::vector< std::vector<IOperation*> > _waves;
+		std::string _error;
+		int _finished;
+		bool _busy;
+	};
+}
+#endif
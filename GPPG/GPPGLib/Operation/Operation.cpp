@@ -9,6 +9,9 @@
 
 #include "GPPG.h"
 #include "Operation.h"
+#include "Util/Thread.h"
+#include "Util/CostModel.h"
+#include <deque>
 #include <sstream>
 #include <string>
 #include <iomanip>
@@ -24,6 +27,23 @@ extern "C" {
 using namespace GPPG;
 using std::string;
 
+/* Reads made by a background materialization are not requests */
+static THREAD_LOCAL bool countRequests = true;
+
+/* Operations constructed by threads creating offspring together are linked later */
+static THREAD_LOCAL bool stageOperations = false;
+
+/* A background materialization reads what it prepared so far */
+static THREAD_LOCAL bool readPrepared = false;
+
+Mutex BaseOperation::_links;
+Mutex BaseOperation::_caches;
+Epochs BaseOperation::_readers;
+
+/* Forms dropped while readers were pinned, oldest first, by epoch */
+static std::deque< std::pair<long, RetiredForm*> > retiredForms;
+static Mutex retiring;
+
 string ConvertRGBtoHex(int num) {
 	static string hexDigits = "0123456789ABCDEF";
 	string rgb;
@@ -66,7 +86,7 @@ std::ostream& operator<<(std::ostream& output, const GPPG::IOperation& op) {
 }
 
 BaseOperation::BaseOperation(int cost) : 
-	_key(-1), _index(-1), _state(-1), _freq(0.0), _total(0), _order(-1), _fitness(1.0), _cost(cost), _load(0), _loadFreq(0), _loadCost(0), _requests(0), _touch(0) {
+	_freq(0.0), _total(0), _fitness(1.0), _index(-1), _order(-1), _key(-1), _state(-1), _requests(0), _reads(0), _touch(0), _load(0), _loadFreq(0), _loadCost(0), _cost(cost), _costClass(-1) {
 #ifdef UBIGRAPH
 	//ubigraph_new_vertex_w_id( (long)this );
 #endif
@@ -170,11 +190,19 @@ void BaseOperation::setCompressed( bool c ) {
 double BaseOperation::fitness() const { return _fitness; }
 void BaseOperation::setFitness(double f) { _fitness = f; }
 
-int BaseOperation::cost() const { return _cost; }
+int BaseOperation::cost() const { return (_costClass < 0) ? _cost : CostModel::instance().cost(_costClass); }
 
 void BaseOperation::setCost(int v) { _cost = v; if(_cost<=0) _cost=1; }
 
-int BaseOperation::requests() const { return _requests + _touch; }
+int BaseOperation::costClass() const { return _costClass; }
+
+void BaseOperation::setCostClass(int c) { _costClass = c; }
+
+const Fingerprint& BaseOperation::fingerprint() const { return _fingerprint; }
+
+void BaseOperation::setFingerprint(const Fingerprint& f) { _fingerprint = f; }
+
+long long BaseOperation::requests() const { return _requests + _touch; }
 
 void BaseOperation::clearRequests() {
 	setRequests(0);
@@ -185,20 +213,29 @@ void BaseOperation::clearDescendentRequests() {
 	if(_requests == 0 && _touch == 0) return;
 	
 	clearRequests();
-	const std::set<IOperation*>& childs = children();
-	for(std::set<IOperation*>::iterator it=childs.begin(); it!=childs.end(); it++) {
-		if( (*it)->isCompressed() && (*it)->requests()>0)
-			(*it)->clearDescendentRequests();
+	std::vector<IOperation*> pending(1, this);
+	while (!pending.empty()) {
+		IOperation* op = pending.back();
+		pending.pop_back();
+		const std::set<IOperation*>& childs = op->children();
+		for(std::set<IOperation*>::iterator it=childs.begin(); it!=childs.end(); it++) {
+			if( (*it)->isCompressed() && (*it)->requests()>0) {
+				(*it)->clearRequests();
+				pending.push_back( *it );
+			}
+		}
 	}
 }
 
-const char* BaseOperation::exportFormat() {
+std::string BaseOperation::exportFormat() {
 	return "Operation has no export formats";
 }
 
-void BaseOperation::setRequests(int i) {
+void BaseOperation::setRequests(long long i) {
 	_requests = i;
 	if(_requests < 0) _requests = 0;
+	// The reads are kept with the load they make up
+	if(_requests == 0) _reads = 0;
 	#ifdef UBIGRAPH
 	double v = _requests/1.0;
 	v = (v > 5) ? 5 : v+1;
@@ -206,21 +243,85 @@ void BaseOperation::setRequests(int i) {
 	
 	#endif
 }
+void BaseOperation::setCountingRequests(bool b) { countRequests = b; }
+
+void BaseOperation::setStaging(bool b) { stageOperations = b; }
+
+bool BaseOperation::staging() { return stageOperations; }
+
+void BaseOperation::setReadingPrepared(bool b) { readPrepared = b; }
+
+bool BaseOperation::readingPrepared() { return readPrepared; }
+
+int BaseOperation::pinCaches() { return _readers.pin(); }
+
+void BaseOperation::unpinCaches(int slot) { _readers.unpin( slot ); }
+
+void BaseOperation::defer(RetiredForm* form) {
+	ScopedLock lock( retiring );
+	retiredForms.push_back( std::make_pair( _readers.current(), form ) );
+}
+
+void BaseOperation::reclaimCaches() {
+	std::vector<RetiredForm*> done;
+	{
+		ScopedLock lock( retiring );
+		if (retiredForms.empty()) return;
+		long oldest = _readers.advance();
+		while (!retiredForms.empty() && retiredForms.front().first < oldest) {
+			done.push_back( retiredForms.front().second );
+			retiredForms.pop_front();
+		}
+	}
+	for (int i=0; i<(int)done.size(); i++) delete done[i];
+}
+
 void BaseOperation::incrRequests(int i) {
-	setRequests(_requests + i*_cost);
+	if (!countRequests) return;
+	if (stageOperations) {
+		atomicAdd( &_requests, (long long)i*cost() );
+		atomicAdd( &_reads, (long long)i );
+		return;
+	}
+	_reads += i;
+	setRequests(_requests + (long long)i*cost());
 }
-void BaseOperation::decrRequests(int i) { 
+void BaseOperation::decrRequests(long long i) { 
 	setRequests(_requests -i); 
 }
 
+long long BaseOperation::reads() const { return _reads; }
+
+void BaseOperation::withdrawReads(long long n) {
+	if (n <= 0 || _reads <= 0) return;
+	if (n >= _reads) {
+		setRequests(0);
+		return;
+	}
+	// Each read takes back the mean load of the reads, whatever the cost was when it was counted
+	long long share = (long long)((double)_requests * n / _reads + 0.5);
+	_reads -= n;
+	setRequests(_requests - share);
+}
+
 void BaseOperation::touch() {
-	if( _touch > 0) return;
-	_touch = 1;
+	std::vector<IOperation*> pending;
+	if (!touch(pending)) return;
+	while (!pending.empty()) {
+		IOperation* op = pending.back();
+		pending.pop_back();
+		op->touch(pending);
+	}
+}
+
+bool BaseOperation::touch(std::vector<IOperation*>& pending) {
+	if (!atomicCompareAndSwap<unsigned short>(&_touch, 0, 1)) return false;
 	if(isCompressed()) {
 		int p = numParents();
-		if(p>0) parent(0)->touch();
-		if(p>1) parent(1)->touch();
+		if(p>1) pending.push_back( parent(1) );
+		if(p>0) pending.push_back( parent(0) );
 	}
+	return true;
 }
 std::string BaseOperation::toString() const {
 	return "<No Content>";
@@ -15,8 +15,14 @@
 #include "Base/GenotypeFactory.h"
 #include "Base/Mutator.h"
 #include "Base/Recombinator.h"
+#include "Operation/DataView.h"
+#include "Util/Fingerprint.h"
+#include "Util/CostModel.h"
+#include "Util/Epochs.h"
 
+#include <map>
 #include <set>
+#include <vector>
 #include <iostream>
 
 namespace GPPG {
@@ -40,10 +46,49 @@ namespace GPPG {
 		virtual void setCompressed(bool compress) = 0;
 		virtual bool isCompressed() const = 0;
 		
+		/** Keep this Operation in an encoded (warm) form between uncompressed and compressed.
+		 * Encoding drops the full data; reads decode it again, which is much cheaper than replaying the ancestors.
+		 * An encoded Operation still counts as compressed.  Uncompressing or compressing drops the encoding.
+		 */
+		virtual void setEncoded(bool encode) = 0;
+		virtual bool isEncoded() const = 0;
+		
+		/** Bytes held by the encoded form (0 if not encoded).
+		 */
+		virtual int encodedSize() const = 0;
+		
+		/** Evaluates the data that uncompressing would cache, but keeps it aside until publishCache().
+		 * Nothing else is written, so this may run on another thread while the graph is only read.
+		 */
+		virtual void prepareCache() = 0;
+		
+		/** Caches the data kept aside by prepareCache(), as setCompressed(false) would; without it, this
+		 * uncompresses as usual.  Data prepared for an Operation that was uncompressed since is dropped.
+		 */
+		virtual void publishCache() = 0;
+		
+		/** Uncompresses this Operation, as setCompressed(false) would, but replays each compressed ancestor
+		 * it is read through only once, down from their materialized ancestors.  A full evaluation replays
+		 * both parents of every compressed recombinant on their own; here nothing but this is cached.
+		 */
+		virtual void uncompressByReplay() = 0;
+		
+		/** Adds this Operation to its parents' children, unless it is already.  The constructor does it,
+		 * except on a thread that stages operations (see BaseOperation::setStaging()); the graph then
+		 * does it when the operation is added.
+		 */
+		virtual void attach() = 0;
+		
+		/** Takes this Operation out of its parents' children ahead of its deletion, which may be deferred
+		 * while readers on other threads could still hold it.  Its parent links stay valid until then.
+		 */
+		virtual void detach() = 0;
+		
 		
 		/** Returns the cost of applying this operation.
 		 * The cost is provided in the construction of the operation and should take into account
 		 * the complexity of the operation and the amount of CPU-time required to apply it.
+		 * With calibration on, it is the measured cost of the operation's kind (see CostModel).
 		 */
 		virtual int cost() const = 0;
 		
@@ -71,17 +116,58 @@ namespace GPPG {
 		
 		/** Requests cache
 		*/
-		virtual int requests() const = 0;
+		virtual long long requests() const = 0;
 		virtual void clearRequests() = 0;
 		virtual void clearDescendentRequests() = 0;
-		virtual void setRequests(int i) = 0;
+		virtual void setRequests(long long i) = 0;
 		virtual void incrRequests(int i) = 0;
-		virtual void decrRequests(int i) = 0;
+		virtual void decrRequests(long long i) = 0;
+		
+		/** Number of reads counted into the requests since they were last cleared.  The requests weigh each
+		 * read by the cost at the time, which changes under calibration, so only this gives the reads back.
+		 */
+		virtual long long reads() const = 0;
+		
+		/** Takes \param n of the reads back out, together with their share of the requests.
+		 */
+		virtual void withdrawReads(long long n) = 0;
+		
+		/** Marks this Operation, and the compressed ancestors it is replayed from, as needed.
+		 * The walk uses an explicit stack, so deep graphs cannot overflow the call stack.
+		 */
 		virtual void touch() = 0;
 		
+		/** Marks only this Operation; if it was not marked yet and is compressed, its parents are appended
+		 * to \param pending.  Returns false if it was already marked.  Marking is atomic, so several
+		 * threads may touch overlapping parts of the graph.
+		 */
+		virtual bool touch(std::vector<IOperation*>& pending) = 0;
+		
+		/** Retrieves the fingerprint of the genotype produced by this Operation.
+		 * Operations producing the same genotype from the same base by point changes have equal fingerprints;
+		 * indels and crossovers are hashed by the path taken, not the content (see Fingerprint).
+		 */
+		virtual const Fingerprint& fingerprint() const = 0;
+		
 		virtual std::string toString() const = 0;
 	};
 	
+	/** A cached form dropped by an Operation, kept until no reader on another thread can hold it.
+	 */
+	class RetiredForm {
+	public:
+		virtual ~RetiredForm() {}
+	};
+	
+	template <class X> class Retired : public RetiredForm {
+	public:
+		Retired(X* form) : _form(form) {}
+		~Retired() { delete _form; }
+		
+	private:
+		X* _form;
+	};
+	
 	class BaseOperation : public IOperation {
 	public:
 		BaseOperation(int cost);
@@ -111,45 +197,118 @@ namespace GPPG {
 		double fitness() const;
 		void setFitness(double f);
 		 
-		int requests() const;
+		long long requests() const;
 		void clearRequests();
 		void clearDescendentRequests();
-		void setRequests(int i);
+		void setRequests(long long i);
 		void incrRequests(int i);
-		void decrRequests(int i);
+		void decrRequests(long long i);
+		long long reads() const;
+		void withdrawReads(long long n);
 		void touch();
+		bool touch(std::vector<IOperation*>& pending);
+		
+		/** Whether reads on the calling thread count as requests (they do by default).
+		 * Background materializations turn it off, so the policies do not see their reads as load.
+		 */
+		static void setCountingRequests(bool b);
+		
+		/** Whether the calling thread stages the operations it constructs (off by default).  A staged
+		 * operation is not linked to its parents until attach(), and reads on the thread add to the
+		 * request counts atomically, so several threads can create and read operations at once as long
+		 * as the graph itself is not changed meanwhile.
+		 */
+		static void setStaging(bool b);
+		static bool staging();
+		
+		/** Whether reads on the calling thread see the data kept aside by prepareCache() (off by default).
+		 * A background materialization turns it on, so a genotype it prepared is not replayed again for the
+		 * genotypes prepared after it.
+		 */
+		static void setReadingPrepared(bool b);
+		static bool readingPrepared();
+		
+		/** Lets a reader on another thread (e.g. an exporter) read single items of the cached forms, which
+		 * take no lock, while the policy drops caches.  Forms dropped while any reader is pinned are only
+		 * freed, by reclaimCaches(), once every reader that could have picked them up has unpinned.
+		 * Returns the slot to unpin with.
+		 */
+		static int pinCaches();
+		static void unpinCaches(int slot);
+		
+		/** Frees the dropped forms no pinned reader can still hold.
+		 */
+		static void reclaimCaches();
 		
 		void setCompressed( bool c );
 		
-		const char* exportFormat();
+		std::string exportFormat();
 		/**
 		 * The cost of applying the operation
 		 */
 		int cost() const;
 		void setCost(int v);
 		
+		/** The CostModel class this operation is timed and priced by (-1 for the configured cost only).
+		 */
+		int costClass() const;
+		void setCostClass(int c);
+		
+		const Fingerprint& fingerprint() const;
+		
 		std::string toString() const;
 		
 	protected:
+		void setFingerprint(const Fingerprint& f);
+		
+		/** Guards the links between parents and children, which the simulator may add while defunct
+		 * operations are deleted on another thread.
+		 */
+		static Mutex _links;
+		
+		/** Guards the cached forms of operations, so a reader on another thread (e.g. an exporter) can
+		 * evaluate operations while the policy fills and drops caches.  It is only held to swap a cache, or
+		 * to read one that has no shared handle (the encoding), never for a whole evaluation.  Single items
+		 * are read without it, as the forms swapped out are retired (see retire()).
+		 */
+		static Mutex _caches;
+		
+		/** Frees \param form, a cached form just swapped out, or keeps it until reclaimCaches() if a
+		 * reader is pinned (see pinCaches()).
+		 */
+		template <class X> static void retire(X* form) {
+			if (!form) return;
+			if (_readers.numPinned() == 0) delete form;
+			else defer( new Retired<X>( form ) );
+		}
+		
+		Fingerprint _fingerprint;
 		double _freq, _total, _fitness;
-		int _index, _order, _key, _state, _requests;
+		int _index, _order, _key, _state;
+		long long _requests;	/* Reads times cost: 64 bits, as a calibrated cost times the reads of a few generations can pass 2^31 */
+		long long _reads;		/* Reads alone */
 		unsigned short _touch;
 		double _load, _loadFreq, _loadCost;
-		int _cost;
+		int _cost, _costClass;
+		
+	private:
+		static void defer(RetiredForm* form);
+		
+		static Epochs _readers;
 	};
 	
 	
 	template <typename T, class P> class Operation : public BaseOperation, public P {
 			
 	public:
-		Operation<T,P>(int cost): BaseOperation(cost), _data(0) { innerConstructor( 0, 0); }
-		Operation<T,P>(int cost, Operation<T,P> &parent) : BaseOperation(cost), _data(0) { innerConstructor( &parent, 0); }
-		Operation<T,P>(int cost, Operation<T,P> &parent1, Operation<T,P> &parent2): BaseOperation(cost), _data(0) { innerConstructor( &parent1, &parent2); }
+		Operation<T,P>(int cost): BaseOperation(cost) { innerConstructor( 0, 0); }
+		Operation<T,P>(int cost, Operation<T,P> &parent) : BaseOperation(cost) { innerConstructor( &parent, 0); }
+		Operation<T,P>(int cost, Operation<T,P> &parent1, Operation<T,P> &parent2): BaseOperation(cost) { innerConstructor( &parent1, &parent2); }
 		
 		~Operation<T,P>() {
-			if (_data) {
-				delete _data;
-			}
+			// Outstanding views keep the data alive
+			_cache.reset();
+			delete _encoded;
 			
 			// Remove from parents
 			if(_parent1) _parent1->removeChild( this );
@@ -230,22 +389,97 @@ namespace GPPG {
 			if (compress && !isCompressed()) {
 				setData(0);
 			} else if (!compress && isCompressed()) {
-				// Fill the cache
-				_data = evaluate();
+				// Fill the cache (decoding it if this is encoded)
+				setData( evaluate() );
 			}
+			setEncoded(false);
 		}
 		
+		void setEncoded(bool encode) {
+			if (!encode) {
+				std::vector<unsigned char>* blob = _encoded;
+				{
+					ScopedLock lock( _caches );
+					_encoded = 0;
+				}
+				retire( blob );
+				return;
+			}
+			if (_encoded && isCompressed()) return;
+			
+			std::vector<unsigned char>* blob = _encoded;
+			if (!blob) {
+				DataView<T> d = view();
+				blob = new std::vector<unsigned char>();
+				encodeData( *d, *blob );
+			}
+			_encoded = 0;
+			// Drop the full data, then keep the encoding
+			setCompressed(true);
+			ScopedLock lock( _caches );
+			_encoded = blob;
+		}
+		
+		bool isEncoded() const { return _encoded != 0; }
+		
+		int encodedSize() const { return _encoded ? _encoded->capacity() : 0; }
+		
+		void prepareCache() {
+			if (!_staged.isNull() || !isCompressed()) return;
+			DataView<T> d( evaluate() );
+			ScopedLock lock( _caches );
+			_staged = d;
+		}
+		
+		void publishCache() {
+			DataView<T> d;
+			{
+				ScopedLock lock( _caches );
+				d = _staged;
+				_staged.reset();
+			}
+			if (d.isNull()) {
+				setCompressed(false);
+				return;
+			}
+			if (!isCompressed()) return;
+			BaseOperation::setCompressed(false);
+			setData(d.release());
+			setEncoded(false);
+		}
+		
+		/** Builds on BatchEvaluator, with this as the only target (see BatchEvaluator.h).
+		 */
+		void uncompressByReplay();
+		
+		void attach() {
+			if (_attached) return;
+			_attached = true;
+			if(_parent1) _parent1->addChild( this );
+			if(_parent2) _parent2->addChild( this );
+		}
+		
+		void detach() {
+			_attached = false;
+			if(_parent1) _parent1->removeChild( this );
+			if(_parent2) _parent2->removeChild( this );
+		}
+		
+		/** Returns the encoded form, or NULL if this is not encoded.
+		 */
+		const std::vector<unsigned char>* encoded() const { return _encoded; }
+		
 		/** Returns the data cache.
 		 * It may return a NULL pointer.
 		 */
-		virtual T* data() const { return _data; }
+		virtual T* data() const { return (T*)_cache.get(); }
 		
 		/** Returns the data cache.
 		 * This function will NOT return a NULL pointer.  However, it may cause an evaluation of the operation.  
 		 * If an evaluation occurs, then \param isCopy is set to 1 and the data should be deleted by the caller.
 		 */
 		T* data(int& isCopy) {
-			if (isCompressed()) {
+			if (_cache.isNull()) {
 				isCopy = 1;
 				return evaluate();
 			} 
@@ -254,13 +488,17 @@ namespace GPPG {
 		}
 		
 		void setData(T* d) {
-			if (_data) {
-				delete _data;
+			DataView<T> v( d ), old;
+			{
+				ScopedLock lock( _caches );
+				old = _cache;
+				_cache = v;
 			}
-			_data = d;
+			// The old data is dropped outside the lock, once no reader of single items can be using it
+			if (!old.isNull()) retire( new DataView<T>( old ) );
 		}
 		
-		bool isCompressed() const { return _data == 0; }
+		bool isCompressed() const { return _cache.isNull(); }
 		
 		// Data Size
 		int dataSize() const { return 1; }
@@ -271,13 +509,68 @@ namespace GPPG {
 		 */
 		virtual T* evaluate() {
 			incrRequests(1);
-			if (isCompressed()) {
-				return NULL;
+			DataView<T> c = cached();
+			if (c.isNull()) {
+				ScopedLock lock( _caches );
+				return _encoded ? decodeData( *_encoded ) : NULL;
 			}
 			//return data()->copy();	
-			return _data->copy();
+			return c->copy();
+		}
+		
+		/** Returns a read-only view of the data produced by this Operation.
+		 * If the cache is full, the view shares it without a copy; otherwise the operation is evaluated
+		 * and the view owns the result.  Use DataView::mutate() or DataView::release() to write to it.
+		 */
+		DataView<T> view() {
+			DataView<T> c = cached();
+			if (c.isNull()) {
+				return DataView<T>( evaluate() );
+			}
+			incrRequests(1);
+			return c;
+		}
+
+		/** Applies only this Operation's own change to the data of its parents, \param p1 and \param p2
+		 * (empty for a single parent), and returns the result, which the caller must delete.  The data of
+		 * either parent may be taken over (see DataView::release()) and written in place, so the caller
+		 * must not use them afterwards.  Operations that do not override it evaluate themselves.
+		 */
+		virtual T* replay(DataView<T>& /* p1 */, DataView<T>& /* p2 */) { return evaluate(); }
+
+		/** True if this Operation keeps its data in some form (full, encoded, or a form of the model's),
+		 * so reading it does not replay its parents.  It may be called while another thread changes the caches.
+		 */
+		virtual bool isMaterialized() const {
+			ScopedLock lock( _caches );
+			return !_cache.isNull() || _encoded != 0;
+		}
+
+		/** Returns the export format of \param d, the data of this Operation, as exportFormat() would.
+		 */
+		virtual std::string exportData(const T& /* d */) { return exportFormat(); }
+
+	protected:
+		/** Takes a handle on the cache, which stays valid when the cache is dropped.
+		 */
+		DataView<T> cached() const {
+			ScopedLock lock( _caches );
+			if (_cache.isNull() && readingPrepared()) return _staged;
+			return _cache;
+		}
+		
+		/** Encodes \param d into \param out for the warm tier.
+		 * Models that support encoding override this and decodeData().
+		 */
+		virtual void encodeData(const T& /* d */, std::vector<unsigned char>& /* out */) const {
+			throw "Operation: encoding is not supported";
+		}
+		
+		/** Decodes \param in (from encodeData()) into new data.
+		 */
+		virtual T* decodeData(const std::vector<unsigned char>& /* in */) const {
+			throw "Operation: encoding is not supported";
 		}
-	
 		
 		
 	private:
@@ -288,29 +581,31 @@ namespace GPPG {
 			_parent1 = parent1;
 			_parent2 = parent2;
 			
-			if (_parent1 != 0) {
-				_parent1->addChild( this );
-			}
-			if (_parent2 != 0) {
-				_parent2->addChild( this );
-			}
+			_attached = false;
+			if (!staging()) attach();
 			
 			_load = 0;
+			_encoded = 0;
 		}
 		
 		void addChild(Operation<T,P>* op) {
+			ScopedLock lock( _links );
 			_children.insert(op);
 		}
 		
 		void removeChild(Operation<T,P>* op) {
+			ScopedLock lock( _links );
 			_children.erase( op );
 		}
 		
 		std::set< Operation<T,P> *> _children;
 		
-		T* _data;
+		DataView<T> _cache;
+		std::vector<unsigned char>* _encoded;	/* Warm tier */
+		DataView<T> _staged;	/* Prepared by prepareCache() */
 		
 		Operation<T,P> *_parent1, *_parent2;
+		bool _attached;	/* Listed among the children of its parents */
 		
 		
 	};
@@ -323,6 +618,8 @@ namespace GPPG {
 			BaseOperation::setCompressed( false );
 		}
 		
+		void setEncoded(bool) {}
+		
 		bool isCompressed() { return false; }
 		
 		std::string toString() const { return "OperationRoot"; }
@@ -338,7 +635,9 @@ namespace GPPG {
 	template <typename T>
 	class OperationMutator : public IMutator {
 	public:
-		OperationMutator(int cost): _cost(cost) {}
+		/** The Operations this creates are of \param kind, which names their cost class (see CostModel).
+		 */
+		OperationMutator(int cost, const std::string& kind): _cost(cost), _costClass( CostModel::instance().addClass(kind, cost) ) {}
 		
 		IGenotype* mutate(IGenotype& geno) const {
 			return mutate( (T&)geno );
@@ -354,14 +653,20 @@ namespace GPPG {
 		
 		int cost() const { return _cost; }
 		
+		/** The CostModel class of the operations this creates.
+		 */
+		int costClass() const { return _costClass; }
+		
 	private:
-		int _cost;
+		int _cost, _costClass;
 	};
 	
 	template <typename T>
 	class OperationRecombinator : public IRecombinator {
 	public:
-		OperationRecombinator(int cost) : _cost(cost) {}
+		/** The Operations this creates are of \param kind, which names their cost class (see CostModel).
+		 */
+		OperationRecombinator(int cost, const std::string& kind) : _cost(cost), _costClass( CostModel::instance().addClass(kind, cost) ) {}
 		
 		IGenotype* recombine(IGenotype& geno1, IGenotype& geno2) const {
 			return recombine( (T&)geno1, (T&)geno2 );
@@ -377,13 +682,20 @@ namespace GPPG {
 		
 		int cost() const {return _cost; }
 		
+		/** The CostModel class of the operations this creates.
+		 */
+		int costClass() const { return _costClass; }
+		
 	private:
-		int _cost;
+		int _cost, _costClass;
 	};
 }
 
 std::ostream& operator<<(std::ostream& output, const GPPG::IOperation& op);
 
+// Defines Operation::uncompressByReplay()
+#include "Operation/BatchEvaluator.h"
+
 template <typename T, class P>
 std::ostream& operator<<(std::ostream& output, const GPPG::Operation<T,P>& op) {
 	// Print the Operation
@@ -393,9 +705,8 @@ std::ostream& operator<<(std::ostream& output, const GPPG::Operation<T,P>& op) {
 	}
 	
 	output << "\tContent: " << op.toString() << std::endl;
-	T* data = op.evaluate();
+	GPPG::DataView<T> data = ((GPPG::Operation<T,P>&)op).view();
 	output << "\tData: " << *data << std::endl;
-	delete data;
 	return output;
 }
 
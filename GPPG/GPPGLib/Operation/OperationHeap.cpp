@@ -12,6 +12,9 @@
 #include "Operation/Operation.h"
 #include "Base/Genotype.h"
 #include "Operation/CompressionPolicy.h"
+#include "Util/BufferPool.h"
+#include "Util/CostModel.h"
+#include "Util/MemoryMonitor.h"
 
 #include <iostream>
 #include <list>
@@ -27,7 +30,9 @@ using std::cout;
 using std::endl;
 using std::list;
 
-OperationGraph::OperationGraph(ICompressionPolicy* p) : _policy(p) {
+typedef std::map<Fingerprint, IOperation*>::iterator InternIter;
+
+OperationGraph::OperationGraph(ICompressionPolicy* p) : _policy(p), _interning(false), _memoryEvents(0) {
 	
 #ifdef UBIGRAPH
 	ubigraph_clear();
@@ -57,7 +62,9 @@ OperationGraph::OperationGraph(ICompressionPolicy* p) : _policy(p) {
 }
 
 OperationGraph::~OperationGraph() {
+	// The policy waits for its background work, which reads the graph, before anything is deleted
 	delete _policy;
+	for (int i=0; i<(int)_limbo.size(); i++) delete _limbo[i].second;
 }
 
 ICompressionPolicy& OperationGraph::compressionPolicy() {
@@ -86,10 +93,44 @@ void OperationGraph::addOperation(IOperation* op) {
 #ifdef UBIGRAPH
 	//ubigraph_change_vertex_style( (long)op, 0);
 #endif
+	// Staged operations are linked to their parents here
+	op->attach();
 	_policy->operationAdded( op );
 	_operations.insert(op);
+	// The first operation with a fingerprint represents it
+	if (_interning) _interned.insert( std::make_pair(op->fingerprint(), op) );
+	
+	// New genotypes are where memory grows between runs of the policy
+	if (MemoryMonitor::instance().check()) relieveMemory();
+}
+
+void OperationGraph::relieveMemory() {
+	_memoryEvents++;
+	// Dead operations go before any live cache: removed ones no reader holds anymore, then their buffers
+	reclaim();
+	BufferPool::instance().trim();
+	if (MemoryMonitor::instance().overLimit()) _policy->memoryPressure( this );
+}
+
+IGenotype* OperationGraph::findDuplicate(IGenotype* g) {
+	if (!_interning) return 0;
+	IOperation* op = (IOperation*)g;
+	InternIter it = _interned.find( op->fingerprint() );
+	if (it == _interned.end() || it->second == op) return 0;
+	return it->second;
+}
+
+void OperationGraph::genotypeActivated(IGenotype* g) {
+	_policy->operationActivated( (IOperation*)g );
 }
 
+void OperationGraph::setInterning(bool b) {
+	_interning = b;
+	if (!b) _interned.clear();
+}
+
+bool OperationGraph::interning() const { return _interning; }
+
 void OperationGraph::clearRequests() {
 	for(std::set<IOperation*>::iterator sit=_operations.begin(); sit!=_operations.end(); sit++)
 		(*sit)->clearRequests();
@@ -97,6 +138,8 @@ void OperationGraph::clearRequests() {
 
 const std::set<IOperation*>& OperationGraph::operations() const { return _operations; }
 
+long OperationGraph::numMemoryEvents() const { return _memoryEvents; }
+
 /*
 void OperationGraph::removeOperation(IOperation* op) {
 	_policy->operationRemoved( op );
@@ -136,9 +179,23 @@ void OperationGraph::removeOperation(IOperation* op) {
 #define QUEUED -2
 #define INACTIVE -1
 
+void OperationGraph::retireGenotype(IGenotype* g) {
+	IOperation* op = (IOperation*)g;
+	_policy->operationRemoved( op );
+	// Left to its own collectGenotype(), so the removal of another one cannot delete it first
+	op->setState(QUEUED);
+}
+
+void OperationGraph::collectGenotype(IGenotype* g) {
+	collect( (IOperation*)g );
+}
+
 void OperationGraph::removeOperation(IOperation* op) {
 	_policy->operationRemoved( op );
-	
+	collect( op );
+}
+
+void OperationGraph::collect(IOperation* op) {
 	list<IOperation*> ops;
 	ops.push_front(op);
 	op->setState(QUEUED);
@@ -155,7 +212,9 @@ void OperationGraph::removeOperation(IOperation* op) {
 #endif
 		// If this operation has children, is active, or is the root, bail!
 		//if (wop != 0 && wop->numChildren() == 0 && !wop->isActive() && wop->numParents() > 0) {		
-		if (wop != 0 && wop->numChildren() == 0 && wop->index() < 0 && wop->numParents() > 0) {
+		// The index is checked first: operations gaining children while the simulator produces offspring
+		// are active, or new and never reached from here
+		if (wop != 0 && wop->index() < 0 && wop->numChildren() == 0 && wop->numParents() > 0) {
 			for (int i=0; i<wop->numParents(); i++) {
 				pop = wop->parent(i);
 				if (pop->state() != QUEUED) {
@@ -166,17 +225,52 @@ void OperationGraph::removeOperation(IOperation* op) {
 			
 			_policy->decompressionReleased(wop);
 			_operations.erase(wop);
-			delete wop;
+			InternIter it = _interned.find( wop->fingerprint() );
+			if (it != _interned.end() && it->second == wop) _interned.erase(it);
+			wop->detach();
+			dispose( wop );
 		}
 	}	
 }
 
+void OperationGraph::dispose(IOperation* op) {
+	// The operation is unreachable by now, so a reader pinning after this check cannot pick it up
+	if (_epochs.numPinned() == 0 && _limbo.empty()) delete op;
+	else _limbo.push_back( std::make_pair( _epochs.current(), op ) );
+}
+
+int OperationGraph::pinEpoch() {
+	return _epochs.pin();
+}
+
+void OperationGraph::unpinEpoch(int slot) {
+	_epochs.unpin( slot );
+}
+
+void OperationGraph::reclaim() {
+	BaseOperation::reclaimCaches();
+	if (_limbo.empty()) return;
+	// Removed operations go in the order they were removed: children before the parents they still point to
+	long oldest = _epochs.advance();
+	while (!_limbo.empty() && _limbo.front().first < oldest) {
+		delete _limbo.front().second;
+		_limbo.pop_front();
+	}
+}
+
+int OperationGraph::numRetained() const {
+	return _limbo.size();
+}
+
 void OperationGraph::generationFinished(const std::vector<IGenotype*>& genos) {
 	//_policy->generationFinished( (const std::vector<IOperation*>&) genos );
 	// Convert vector to set...
 }
 
 void OperationGraph::generationFinished(const std::set<IGenotype*>& genos) {
+	// The policies see this generation's measured costs
+	CostModel::instance().update();
 	_policy->generationFinished( this, (const std::set<IOperation*>&) genos );
+	reclaim();
 	//clearRequests();
 }
@@ -14,6 +14,10 @@
 //#include "Operation/CompressionPolicy.h"
 //#include "Operation/Operation.h"
 #include "Base/GenotypeHeap.h"
+#include "Util/Epochs.h"
+#include "Util/Fingerprint.h"
+#include <deque>
+#include <map>
 #include <set>
 
 namespace GPPG {
@@ -44,11 +48,29 @@ namespace GPPG {
 		 */
 		void removeGenotype(IGenotype* g);
 		
+		/** Notifies the compression policy that \param g was removed; collectGenotype() removes it.
+		 */
+		void retireGenotype(IGenotype* g);
+		
+		/** Removes \param g, retired earlier, like removeOperation().  Only operations no genotype in the
+		 * population descends from are deleted, and the policy is only told about those, so this may run
+		 * while the simulator produces offspring from the population.
+		 */
+		void collectGenotype(IGenotype* g);
+		
+		/** Looks up an operation with the same fingerprint as \param g.
+		 */
+		IGenotype* findDuplicate(IGenotype* g);
+		
+		/** Forwards the activation to the compression policy.
+		 */
+		void genotypeActivated(IGenotype* g);
+		
 		void generationFinished(const std::vector<IGenotype*>&);
 		
 		void generationFinished(const std::set<IGenotype*>&);
 		
-		/** Sets this IOperation to be owned by the graph
+		/** Sets this IOperation to be owned by the graph, and links it to its parents if it was staged.
 		 */
 		virtual void addOperation(IOperation* op);
 		
@@ -59,7 +81,37 @@ namespace GPPG {
 		
 		void clearRequests();
 		
+		/** Keep a table of operations by fingerprint, so identical genotypes can be merged (off by default).
+		 * Point changes update fingerprints by content, but indels and crossovers mix in their own
+		 * parameters (see Fingerprint), so identical sequences reached by different indel or crossover
+		 * paths are not found and stay separate genotypes.
+		 */
+		void setInterning(bool b);
+		bool interning() const;
+		
 		const std::set<IOperation*>& operations() const;
+		
+		/** Lets a reader on another thread hold on to operations while the simulation goes on.
+		 * Operations removed while any reader is pinned are unlinked at once but only deleted, by
+		 * reclaim(), once every reader that could have picked them up has unpinned.  The reader has to
+		 * pick up its pointers (e.g. a copy of operations()) while the graph is not being changed; after
+		 * that it may read their data and follow their parents.  Returns the slot to unpin with.
+		 */
+		int pinEpoch();
+		void unpinEpoch(int slot);
+		
+		/** Deletes the removed operations, and frees the dropped caches (see BaseOperation::reclaimCaches()),
+		 * no pinned reader can still hold; called after each generation, and when memory runs over its limit.
+		 */
+		void reclaim();
+		
+		/** Number of removed operations waiting for readers to unpin.
+		 */
+		int numRetained() const;
+		
+		/** Number of times memory crossed the soft limit of the MemoryMonitor and cached data was shed.
+		 */
+		long numMemoryEvents() const;
 			
 		//void operationAttached(IOperation& parent, IOperation& child);
 		//void operationRemoved(IOperation& parent, IOperation& child);
@@ -67,8 +119,28 @@ namespace GPPG {
 	private:
 		OperationGraph(OperationGraph const&);
 		OperationGraph& operator=(OperationGraph const&);
+		
+		/** Deletes the dead operations (see reclaim()), frees the pooled buffers and, if that is not
+		 * enough, lets the policy shed cached data.  Like collectGenotype(), it runs under the simulator's
+		 * lock on the graph.
+		 */
+		void relieveMemory();
+		
+		/** Deletes \param op if it is defunct, then the ancestors left defunct by that.
+		 */
+		void collect(IOperation* op);
+		
+		/** Deletes the unlinked \param op, or keeps it until reclaim() if a reader is pinned.
+		 */
+		void dispose(IOperation* op);
+		
 		std::set<IOperation*> _operations;
+		std::map<Fingerprint, IOperation*> _interned;
+		Epochs _epochs;
+		std::deque< std::pair<long, IOperation*> > _limbo;	/* Removed operations, oldest first, by epoch */
 		ICompressionPolicy* _policy;
+		bool _interning;
+		long _memoryEvents;
 	};
 }
 #endif
@@ -0,0 +1,362 @@
+/*
+ *  OptimalLoad.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "OptimalLoad.h"
+#include "Operation/Operation.h"
+#include <map>
+
+using namespace GPPG;
+
+using std::set;
+using std::map;
+using std::vector;
+
+typedef set<IOperation*>::const_iterator OpIter;
+typedef map<IOperation*, double>::const_iterator WeightIter;
+
+#define INF 1e300
+
+/* A node of the reduced tree, its nearest uncompressed ancestor and its budget, while walking back down */
+struct Choice {
+	int v, anc, budget;
+};
+
+OptimalLoad::OptimalLoad(int maxExplicit, int numGens, bool baseline, double maxWork) :
+	GreedyLoad(maxExplicit, numGens), _K(0), _maxWork(maxWork), _baseline(baseline), _solved(0), _mixed(0), _fallbacks(0), _placed(0), _optimal(0) {}
+
+void OptimalLoad::apply( const std::set<IOperation*>& active ) {
+	set<IOperation*> best, part, kept;
+	map<IOperation*, double> weights;
+	double cost;
+	bool tree = active.size() > 0 && !recombinantPart( active, part );
+	if (tree) weigh( active, part, kept, weights );
+
+	if (_baseline) {
+		GreedyLoad::apply( active );
+		if (tree && solve( weights, effectiveMaxUncompressed()-1, best, cost )) {
+			_solved++;
+			_placed += placementCost( active, _U );
+			_optimal += cost;
+		} else {
+			_fallbacks++;
+		}
+		return;
+	}
+
+	if (!tree) {
+		// GreedyLoad places the recombinant part; the tree gets the slots it leaves
+		place( active );
+		for (OpIter it=_U.begin(); it!=_U.end(); it++)
+			if (part.count( *it ) > 0) kept.insert( *it );
+		weigh( active, part, kept, weights );
+		if (solve( weights, effectiveMaxUncompressed()-1-(int)kept.size(), best, cost )) {
+			_U = best;
+			_U.insert( kept.begin(), kept.end() );
+			_mixed++;
+		} else {
+			_fallbacks++;
+		}
+		commit();
+		clearLoadMap();
+		_runs++;
+		return;
+	}
+
+	if (!solve( weights, effectiveMaxUncompressed()-1, best, cost )) {
+		_fallbacks++;
+		GreedyLoad::apply( active );
+		return;
+	}
+
+	_elapsedGens = 0;
+	_V = _U;
+	_U = best;
+	commit();
+	clearLoadMap();
+	_runs++;
+
+	_solved++;
+	_placed += cost;
+	_optimal += cost;
+}
+
+bool OptimalLoad::recombinantPart( const std::set<IOperation*>& active, std::set<IOperation*>& part ) {
+	// The whole ancestry, through every parent
+	set<IOperation*> seen;
+	vector<IOperation*> pending( active.begin(), active.end() );
+	while (!pending.empty()) {
+		IOperation* op = pending.back();
+		pending.pop_back();
+		if (!seen.insert( op ).second) continue;
+		for (int i=0; i<op->numParents(); i++) pending.push_back( op->parent(i) );
+		if (op->numParents() > 1) part.insert( op );
+	}
+	if (part.empty()) return false;
+
+	// Down from the recombinants, within the ancestry
+	pending.assign( part.begin(), part.end() );
+	while (!pending.empty()) {
+		IOperation* op = pending.back();
+		pending.pop_back();
+		const set<IOperation*>& children = op->children();
+		for (OpIter it=children.begin(); it!=children.end(); it++) {
+			if (seen.count( *it ) > 0 && part.insert( *it ).second) pending.push_back( *it );
+		}
+	}
+	return true;
+}
+
+void OptimalLoad::weigh( const std::set<IOperation*>& active, const std::set<IOperation*>& part,
+	const std::set<IOperation*>& kept, std::map<IOperation*, double>& weights ) {
+	weights.clear();
+	for (OpIter it=active.begin(); it!=active.end(); it++) {
+		// Charged along the first parent, as placementCost() does, until the replay stops or leaves the part
+		IOperation* op = *it;
+		while (part.count( op ) > 0 && kept.count( op ) == 0) op = op->parent(0);
+		if (part.count( op ) > 0) continue;
+		weights[op] += (*it)->frequency();
+	}
+}
+
+double OptimalLoad::placementCost( const std::set<IOperation*>& active, const std::set<IOperation*>& uncompressed ) const {
+	double total = 0;
+	for (OpIter it=active.begin(); it!=active.end(); it++) {
+		IOperation* op = *it;
+		double c = 0;
+		while (uncompressed.count(op) == 0 && op->numParents() > 0) {
+			c += op->cost();
+			op = op->parent(0);
+		}
+		total += (*it)->frequency() * c;
+	}
+	return total;
+}
+
+bool OptimalLoad::buildTree( const std::map<IOperation*, double>& weights ) {
+	_nodes.clear();
+
+	// The ancestry of the weighted genotypes, with the number of its children in it
+	map<IOperation*, int> childCount;
+	set<IOperation*> seen;
+	IOperation* root = 0;
+	for (WeightIter it=weights.begin(); it!=weights.end(); it++) {
+		IOperation* op = it->first;
+		while (seen.insert( op ).second) {
+			if (op->numParents() > 1) return false;
+			if (op->numParents() == 0) {
+				root = op;
+				break;
+			}
+			op = op->parent(0);
+			childCount[op]++;
+		}
+	}
+	if (root == 0) return false;
+	if (_root == 0) _root = root;
+	if (root != _root) return false;
+
+	// Keep the root, the weighted genotypes and the branch points; a compressed chain between them
+	// is never worth uncompressing anywhere but at its lower end
+	map<IOperation*, int> index;
+	for (OpIter it=seen.begin(); it!=seen.end(); it++) {
+		IOperation* op = *it;
+		WeightIter w = weights.find( op );
+		if (op == root || w != weights.end() || childCount[op] > 1) {
+			index[op] = _nodes.size();
+			Node n;
+			n.op = op;
+			n.parent = -1;
+			n.weight = (w != weights.end()) ? w->second : 0;
+			n.depth = 0;
+			n.level = 0;
+			_nodes.push_back( n );
+		}
+	}
+
+	// Link each kept node to the nearest kept ancestor; the edge carries the cost of the chain
+	vector<double> length( _nodes.size(), 0 );
+	for (int v=0; v<(int)_nodes.size(); v++) {
+		IOperation* op = _nodes[v].op;
+		if (op == root) continue;
+		double len = op->cost();
+		op = op->parent(0);
+		while (index.count(op) == 0) {
+			len += op->cost();
+			op = op->parent(0);
+		}
+		_nodes[v].parent = index[op];
+		_nodes[ index[op] ].children.push_back( v );
+		length[v] = len;
+	}
+
+	// Depths and levels, parents first
+	vector<int> order( 1, index[root] );
+	for (int i=0; i<(int)order.size(); i++) {
+		Node& n = _nodes[ order[i] ];
+		for (int c=0; c<(int)n.children.size(); c++) {
+			Node& child = _nodes[ n.children[c] ];
+			child.depth = n.depth + length[ n.children[c] ];
+			child.level = n.level + 1;
+			order.push_back( n.children[c] );
+		}
+	}
+
+	// Renumber in that order, so parents come before their children
+	vector<int> rank( _nodes.size() );
+	for (int i=0; i<(int)order.size(); i++) rank[ order[i] ] = i;
+	vector<Node> sorted( _nodes.size() );
+	for (int v=0; v<(int)_nodes.size(); v++) {
+		Node n = _nodes[v];
+		if (n.parent >= 0) n.parent = rank[ n.parent ];
+		for (int c=0; c<(int)n.children.size(); c++) n.children[c] = rank[ n.children[c] ];
+		sorted[ rank[v] ] = n;
+	}
+	_nodes.swap( sorted );
+	return true;
+}
+
+double& OptimalLoad::cell( int v, int i, int j ) {
+	return _f[v][ i*(_K+1) + j ];
+}
+
+/* Best cost of the subtrees of v's children for each budget, when their nearest uncompressed ancestor
+ * is v (anc < 0) or v's ancestor anc levels up; prefix receives the budget given to each child */
+void OptimalLoad::merge( int v, int anc, std::vector<double>& out, std::vector< std::vector<int> >* prefix ) {
+	int K = _K;
+	out.assign( K+1, 0.0 );
+	if (prefix) prefix->clear();
+
+	vector<double> next( K+1 );
+	const vector<int>& children = _nodes[v].children;
+	for (int m=0; m<(int)children.size(); m++) {
+		int c = children[m];
+		int idx = (anc < 0) ? 0 : anc+1;
+		const double* t = &_f[c][ idx*(K+1) ];
+		vector<int> pick( K+1, 0 );
+		for (int j=0; j<=K; j++) {
+			double best = INF;
+			for (int a=0; a<=j; a++) {
+				double val = out[j-a] + t[a];
+				if (val < best) {
+					best = val;
+					pick[j] = a;
+				}
+			}
+			next[j] = best;
+		}
+		out.swap( next );
+		if (prefix) prefix->push_back( pick );
+	}
+}
+
+bool OptimalLoad::solve( const std::map<IOperation*, double>& weights, int budget, std::set<IOperation*>& best, double& cost ) {
+	if (weights.size() == 0 || !buildTree( weights )) return false;
+
+	int n = _nodes.size();
+	_K = budget;
+	if (_K > n-1) _K = n-1;
+	if (_K < 0) _K = 0;
+
+	// Bound the work before committing to it
+	double work = 0;
+	for (int v=0; v<n; v++) {
+		int c = _nodes[v].children.size();
+		work += (double)(_nodes[v].level+1) * (c > 0 ? c : 1) * (_K+1) * (_K+2) / 2;
+	}
+	if (work > _maxWork) {
+		_nodes.clear();
+		return false;
+	}
+
+	// Children before parents
+	_f.assign( n, vector<double>() );
+	vector<double> mat, notMat;
+	for (int v=n-1; v>0; v--) {
+		Node& node = _nodes[v];
+		_f[v].assign( node.level*(_K+1), INF );
+		merge( v, -1, mat, 0 );
+		int a = node.parent;
+		for (int i=0; i<node.level; i++, a = _nodes[a].parent) {
+			merge( v, i, notMat, 0 );
+			double replay = node.weight * (node.depth - _nodes[a].depth);
+			for (int j=0; j<=_K; j++) {
+				double val = replay + notMat[j];
+				if (j > 0 && mat[j-1] < val) val = mat[j-1];
+				if (j > 0 && cell(v,i,j-1) < val) val = cell(v,i,j-1);
+				cell(v,i,j) = val;
+			}
+		}
+	}
+
+	// Walk the choices back down from the root, which is always uncompressed
+	vector< vector<int> > prefix;
+	merge( 0, -1, mat, &prefix );
+	cost = mat[_K];
+	best.clear();
+	best.insert( _nodes[0].op );
+
+	vector<Choice> pending;
+	Choice root = { 0, -1, _K };
+	pending.push_back( root );
+	while (!pending.empty()) {
+		Choice ch = pending.back();
+		pending.pop_back();
+		int v = ch.v;
+		int budget = ch.budget;
+		int anc = ch.anc;
+
+		if (v != 0) {
+			// Find the smallest budget reaching the cell's value, and whether v is uncompressed there
+			Node& node = _nodes[v];
+			int a = node.parent;
+			for (int i=0; i<anc; i++) a = _nodes[a].parent;
+			double replay = node.weight * (node.depth - _nodes[a].depth);
+			merge( v, -1, mat, 0 );
+			merge( v, anc, notMat, 0 );
+			double target = cell(v, anc, budget);
+			bool found = false;
+			for (int j=0; j<=budget && !found; j++) {
+				if (replay + notMat[j] <= target) {
+					budget = j;
+					found = true;
+				} else if (j > 0 && mat[j-1] <= target) {
+					best.insert( node.op );
+					anc = -1;
+					budget = j-1;
+					found = true;
+				}
+			}
+			merge( v, anc, mat, &prefix );
+		}
+
+		// Split the budget over the children, last child first
+		const vector<int>& children = _nodes[v].children;
+		for (int m=children.size()-1; m>=0; m--) {
+			int give = prefix[m][budget];
+			Choice c = { children[m], (anc < 0) ? 0 : anc+1, give };
+			pending.push_back( c );
+			budget -= give;
+		}
+	}
+
+	_f.clear();
+	_nodes.clear();
+	return true;
+}
+
+bool OptimalLoad::isBaseline() const { return _baseline; }
+
+int OptimalLoad::numSolved() const { return _solved; }
+
+int OptimalLoad::numMixed() const { return _mixed; }
+
+int OptimalLoad::numFallbacks() const { return _fallbacks; }
+
+double OptimalLoad::placedCost() const { return _placed; }
+
+double OptimalLoad::optimalCost() const { return _optimal; }
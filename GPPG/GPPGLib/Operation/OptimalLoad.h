@@ -0,0 +1,103 @@
+/*
+ *  OptimalLoad.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef OPERATION_OPTIMAL_LOAD_
+#define OPERATION_OPTIMAL_LOAD_
+
+#include "Operation/GreedyLoad.h"
+#include <map>
+#include <set>
+#include <vector>
+
+namespace GPPG {
+
+	/** OptimalLoad places the k uncompressed genotypes exactly, when the operation graph is a tree.
+	 * The placement minimises the expected replay cost: the sum over active genotypes of their frequency
+	 * times the cost of the operations between them and their nearest uncompressed ancestor.  The root is
+	 * always uncompressed and counts towards k.  The tree is reduced to the active genotypes and the
+	 * branch points between them, and solved by dynamic programming over (node, nearest uncompressed
+	 * ancestor, budget), which takes O(n d k^2) time for n reduced nodes of depth at most d.
+	 *
+	 * Recombinants make the graph a DAG.  When the ancestry of the active genotypes contains some, it is
+	 * split into the recombinant part (the recombinants and their descendants) and the tree around it:
+	 * GreedyLoad places the recombinant part, and the program places the slots it leaves in the tree,
+	 * where the replays of the recombinants not covered in their part are charged to the genotype they
+	 * enter the tree through.  When the program would exceed its work limit, the GreedyLoad placement is
+	 * used as a whole.  As a baseline, the policy can also keep the GreedyLoad placement and only measure
+	 * its cost against the optimum, on trees.
+	 */
+	class OptimalLoad : public GreedyLoad {
+	public:
+		/** Create an OptimalLoad policy with the GreedyLoad parameters \param maxExplicit and \param numGens.
+		 * If \param baseline is true, GreedyLoad places the genotypes and the optimum is only measured.
+		 * \param maxWork bounds the number of steps of the dynamic program.
+		 */
+		OptimalLoad(int maxExplicit, int numGens, bool baseline = false, double maxWork = 2e8);
+
+		void apply( const std::set<IOperation*>& active );
+
+		/** Expected replay cost of \param active if the genotypes \param uncompressed (and the root) are uncompressed.
+		 * Recombinants are charged along their first parent.
+		 */
+		double placementCost( const std::set<IOperation*>& active, const std::set<IOperation*>& uncompressed ) const;
+
+		/** True if this only measures the GreedyLoad placement.
+		 */
+		bool isBaseline() const;
+
+		/** Number of runs solved exactly, solved around a recombinant part, and falling back to GreedyLoad.
+		 */
+		int numSolved() const;
+		int numMixed() const;
+		int numFallbacks() const;
+
+		/** Sums, over the runs solved exactly, of the cost of the placement used and of the optimal one.
+		 */
+		double placedCost() const;
+		double optimalCost() const;
+
+	private:
+		struct Node {
+			IOperation* op;
+			int parent;
+			std::vector<int> children;
+			double weight, depth;
+			int level;
+		};
+
+		/** Finds the optimal set of at most \param budget uncompressed genotypes besides the root for the
+		 * replay \param weights, by genotype; returns false (and leaves \param best alone) if their ancestry
+		 * is not a tree or the program is too large.
+		 */
+		bool solve( const std::map<IOperation*, double>& weights, int budget, std::set<IOperation*>& best, double& cost );
+
+		/** Collects the recombinants in the ancestry of \param active and their descendants there into
+		 * \param part; returns false if there are none.
+		 */
+		bool recombinantPart( const std::set<IOperation*>& active, std::set<IOperation*>& part );
+
+		/** The replay weights of \param active in the tree around the recombinant \param part, in which the
+		 * genotypes \param kept are uncompressed.
+		 */
+		void weigh( const std::set<IOperation*>& active, const std::set<IOperation*>& part,
+			const std::set<IOperation*>& kept, std::map<IOperation*, double>& weights );
+
+		bool buildTree( const std::map<IOperation*, double>& weights );
+		double& cell( int v, int i, int j );
+		void merge( int v, int anc, std::vector<double>& out, std::vector< std::vector<int> >* prefix );
+
+		std::vector<Node> _nodes;
+		std::vector< std::vector<double> > _f;	/* _f[v][i*(K+1)+j]: nearest uncompressed ancestor i levels up, budget j */
+		int _K;
+		double _maxWork;
+		bool _baseline;
+		int _solved, _mixed, _fallbacks;
+		double _placed, _optimal;
+	};
+}
+#endif
@@ -0,0 +1,104 @@
+/*
+ *  TieredLoad.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "TieredLoad.h"
+#include "Operation/Operation.h"
+#include "Util/MemoryMonitor.h"
+#include <algorithm>
+#include <vector>
+
+using namespace GPPG;
+
+typedef std::map<IOperation*, int>::iterator WarmIter;
+
+/* Orders warm genotypes by last request, oldest first (then by key, for determinism) */
+struct WarmOrder {
+	bool operator()(const std::pair<int, IOperation*>& a, const std::pair<int, IOperation*>& b) const {
+		if (a.first != b.first) return a.first < b.first;
+		return a.second->key() < b.second->key();
+	}
+};
+
+TieredLoad::TieredLoad(int maxExplicit, int numGens, int maxWarm, int maxAge) :
+	GreedyLoad(maxExplicit, numGens), _maxWarm(maxWarm), _maxAge(maxAge), _generation(0) {}
+
+void TieredLoad::decompressionReleased( IOperation* op ) {
+	GreedyLoad::decompressionReleased( op );
+	_warm.erase( op );
+}
+
+void TieredLoad::generationFinished( OperationGraph* heap, const std::set<IOperation*>& active ) {
+	_generation++;
+	GreedyLoad::generationFinished( heap, active );
+}
+
+void TieredLoad::apply( const std::set<IOperation*>& active ) {
+	// Requests are cleared by GreedyLoad, so record which warm genotypes were used first
+	for (WarmIter it=_warm.begin(); it!=_warm.end(); it++) {
+		if (it->first->requests() > 0) it->second = _generation;
+	}
+	
+	GreedyLoad::apply( active );
+	
+	// Drop genotypes that went hot, and cool the stale ones
+	std::vector< std::pair<int, IOperation*> > order;
+	WarmIter it = _warm.begin();
+	while (it != _warm.end()) {
+		IOperation* op = it->first;
+		int last = it->second;
+		it++;
+		if (!op->isEncoded()) {
+			_warm.erase( op );
+		} else if (_generation - last > _maxAge) {
+			evict( op );
+		} else {
+			order.push_back( std::make_pair(last, op) );
+		}
+	}
+	
+	// Enforce the budget, least recently requested first
+	if ((int)order.size() > _maxWarm) {
+		std::sort( order.begin(), order.end(), WarmOrder() );
+		for (int i=0; i<(int)order.size()-_maxWarm; i++) evict( order[i].second );
+	}
+}
+
+void TieredLoad::memoryPressure( OperationGraph* heap ) {
+	// A hot genotype frees several times the bytes of a warm one for the same lost replay
+	GreedyLoad::memoryPressure( heap );
+	
+	// Encodings are not pool buffers, so dropping them only shows in a cgroup reading
+	MemoryMonitor& monitor = MemoryMonitor::instance();
+	if (monitor.cgroupFile().empty() || !monitor.overLimit()) return;
+	
+	std::vector< std::pair<int, IOperation*> > order;
+	for (WarmIter it=_warm.begin(); it!=_warm.end(); it++)
+		order.push_back( std::make_pair( (it->first->requests() > 0) ? _generation : it->second, it->first ) );
+	std::sort( order.begin(), order.end(), WarmOrder() );
+	for (int i=0; i<(int)order.size() && monitor.overLimit(); i++) evict( order[i].second );
+}
+
+void TieredLoad::release(IOperation* op) {
+	if (_maxWarm <= 0) {
+		op->setCompressed(true);
+		return;
+	}
+	op->setEncoded(true);
+	_warm[op] = _generation;
+}
+
+void TieredLoad::evict(IOperation* op) {
+	op->setCompressed(true);
+	_warm.erase( op );
+}
+
+int TieredLoad::maxWarm() const { return _maxWarm; }
+
+int TieredLoad::maxAge() const { return _maxAge; }
+
+int TieredLoad::numWarm() const { return _warm.size(); }
@@ -0,0 +1,62 @@
+/*
+ *  TieredLoad.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef OPERATION_TIERED_LOAD_
+#define OPERATION_TIERED_LOAD_
+
+#include "Operation/GreedyLoad.h"
+#include <map>
+
+namespace GPPG {
+	
+	/** TieredLoad extends GreedyLoad with a warm tier between uncompressed (hot) and compressed (cold).
+	 * GreedyLoad picks the k hot genotypes as before, but a genotype leaving the hot set is encoded
+	 * (see IOperation::setEncoded) instead of compressed.  Warm genotypes become cold once they go
+	 * unrequested for a number of generations, or when the warm tier is over budget (least recently
+	 * requested first).
+	 */
+	class TieredLoad : public GreedyLoad {
+	public:
+		/** Create a TieredLoad policy with the GreedyLoad parameters \param maxExplicit and \param numGens,
+		 * keeping at most \param maxWarm encoded genotypes for at most \param maxAge generations without requests.
+		 */
+		TieredLoad(int maxExplicit, int numGens, int maxWarm, int maxAge);
+		
+		void decompressionReleased( IOperation* op );
+		
+		void generationFinished( OperationGraph* heap, const std::set<IOperation*>& active );
+		
+		void apply( const std::set<IOperation*>& active );
+		
+		/** Sheds hot genotypes as GreedyLoad does, then warm ones, least recently requested first.
+		 */
+		void memoryPressure( OperationGraph* heap );
+		
+		/** Retrieve the maximum number of encoded genotypes.
+		 */
+		int maxWarm() const;
+		
+		/** Retrieve the number of generations a warm genotype is kept without requests.
+		 */
+		int maxAge() const;
+		
+		/** Retrieve the current number of encoded genotypes.
+		 */
+		int numWarm() const;
+		
+	protected:
+		void release(IOperation* op);
+		
+	private:
+		void evict(IOperation* op);
+		
+		std::map<IOperation*, int> _warm;	/* Warm genotype -> generation it was last requested */
+		int _maxWarm, _maxAge, _generation;
+	};
+}
+#endif
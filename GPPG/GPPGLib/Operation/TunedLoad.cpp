@@ -0,0 +1,90 @@
+/*
+ *  TunedLoad.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "TunedLoad.h"
+#include "Util/MemoryMonitor.h"
+#include <ctime>
+
+using namespace GPPG;
+
+/* Measurements this far under a target leave room to trade against it */
+#define TUNE_SLACK 0.25
+
+/* Factors by which k is raised or lowered */
+#define TUNE_GROW 1.25
+#define TUNE_SHRINK 0.8
+
+/* Shares of the time spent in GreedyLoad beyond which t is raised or lowered */
+#define TUNE_MAX_APPLY 0.5
+#define TUNE_MIN_APPLY 0.1
+
+/* Wall-clock seconds: worker threads and waits for I/O count, which CPU time of the process would not */
+static double wallSeconds() {
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + 1e-9*t.tv_nsec;
+}
+
+TunedLoad::TunedLoad(int maxExplicit, int numGens, double maxBytes, double maxSeconds, int minK, int maxK, int minT, int maxT) :
+	GreedyLoad(maxExplicit, numGens), _maxBytes(maxBytes), _maxSeconds(maxSeconds), _minK(minK), _maxK(maxK), _minT(minT), _maxT(maxT),
+	_gens(0), _adjustments(0), _start(wallSeconds()), _applySeconds(0) {}
+
+void TunedLoad::generationFinished( OperationGraph* heap, const std::set<IOperation*>& active ) {
+	_gens++;
+	GreedyLoad::generationFinished( heap, active );
+}
+
+void TunedLoad::apply( const std::set<IOperation*>& active ) {
+	double start = wallSeconds();
+	GreedyLoad::apply( active );
+	_applySeconds += wallSeconds() - start;
+	tune();
+}
+
+void TunedLoad::tune() {
+	double now = wallSeconds();
+	double total = now - _start;
+	double seconds = (_gens > 0) ? total / _gens : 0;
+	double applyShare = (total > 0) ? _applySeconds / total : 0;
+	double bytes = MemoryMonitor::instance().usage();
+
+	int k = maxUncompressed();
+	int t = numGenerations();
+	bool overBytes = _maxBytes > 0 && bytes > _maxBytes;
+	bool overTime = _maxSeconds > 0 && seconds > _maxSeconds;
+
+	// Memory comes first: uncompressed genotypes are what holds it
+	int nk = k;
+	if (overBytes) nk = (int)(k*TUNE_SHRINK);
+	else if (overTime) nk = (int)(k*TUNE_GROW) + 1;
+	else if (_maxSeconds > 0 && seconds < (1-TUNE_SLACK)*_maxSeconds) nk = (int)(k*TUNE_SHRINK);
+	else if (_maxSeconds <= 0 && _maxBytes > 0 && bytes < (1-TUNE_SLACK)*_maxBytes) nk = (int)(k*TUNE_GROW) + 1;
+	if (nk < _minK) nk = _minK;
+	if (nk > _maxK) nk = _maxK;
+
+	// Runs that dominate the time are made rarer, cheap ones more frequent
+	int nt = t;
+	if (applyShare > TUNE_MAX_APPLY) nt = 2*t + 1;
+	else if (applyShare < TUNE_MIN_APPLY) nt = t/2;
+	if (nt < _minT) nt = _minT;
+	if (nt > _maxT) nt = _maxT;
+
+	if (nk != k || nt != t) _adjustments++;
+	setMaxUncompressed( nk );
+	setNumGenerations( nt );
+
+	_gens = 0;
+	_applySeconds = 0;
+	_start = now;
+}
+
+double TunedLoad::maxBytes() const { return _maxBytes; }
+
+double TunedLoad::maxSeconds() const { return _maxSeconds; }
+
+int TunedLoad::numAdjustments() const { return _adjustments; }
@@ -0,0 +1,58 @@
+/*
+ *  TunedLoad.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef OPERATION_TUNED_LOAD_
+#define OPERATION_TUNED_LOAD_
+
+#include "Operation/GreedyLoad.h"
+
+namespace GPPG {
+
+	/** TunedLoad is a GreedyLoad policy that adjusts its own k and t to meet a memory or time target.
+	 * After each run of GreedyLoad it looks at the wall-clock seconds per generation since the previous
+	 * run, the share of them spent in the run itself, and the memory in use as the MemoryMonitor reads it
+	 * (the cgroup's use if it is set, the genome buffers in use and cached otherwise), and then
+	 * - lowers k if the memory is over its target, or raises it if the time is over its target;
+	 * - otherwise lowers k when the time is well under its target (saving memory), or raises it when
+	 *   there is only a memory target and the memory is well under it (saving time);
+	 * - raises t when the runs take more than half of the time, and lowers it when they take very little.
+	 * k and t stay within the given bounds.  A target of 0 is not used.
+	 */
+	class TunedLoad : public GreedyLoad {
+	public:
+		/** Create a TunedLoad policy starting from the GreedyLoad parameters \param maxExplicit and \param numGens.
+		 * \param maxBytes is the target for the memory in use and \param maxSeconds the one for the
+		 * wall-clock seconds per generation; k is kept in [\param minK, \param maxK] and t in [\param minT, \param maxT].
+		 */
+		TunedLoad(int maxExplicit, int numGens, double maxBytes, double maxSeconds, int minK, int maxK, int minT, int maxT);
+
+		void apply( const std::set<IOperation*>& active );
+
+		void generationFinished( OperationGraph* heap, const std::set<IOperation*>& active );
+
+		/** Retrieve the memory (bytes) and time (seconds per generation) targets.
+		 */
+		double maxBytes() const;
+		double maxSeconds() const;
+
+		/** Number of times k or t was changed.
+		 */
+		int numAdjustments() const;
+
+	private:
+		/** Adjusts k and t from the measurements since the previous call.
+		 */
+		void tune();
+
+		double _maxBytes, _maxSeconds;
+		int _minK, _maxK, _minT, _maxT;
+		int _gens, _adjustments;
+		double _start, _applySeconds;	/* Monotonic wall clock */
+	};
+}
+#endif
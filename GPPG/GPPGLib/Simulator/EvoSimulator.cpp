@@ -13,6 +13,8 @@
 #include "Base/Mutator.h"
 #include "Base/GenotypeHeap.h"
 #include "Base/Recombinator.h"
+#include "Operation/Operation.h"
+#include "Operation/BatchEvaluator.h"
 
 //#include <omp.h>
 
@@ -38,6 +40,9 @@ using std::vector;
 
 typedef set<IGenotype*>::iterator GIter;
 
+/* Individuals bred from one random stream; the blocks are the items of the ThreadPool */
+#define BREED_GRAIN 16
+
 template <class T> std::string TToStr( const T &t )
 {
     std::ostringstream oss;
@@ -97,12 +102,78 @@ void samplePopulation( set<IGenotype*>& genos, long N) {
 	
 }
 
+/* Removes the genotypes retired at the end of the previous generation, one at a time between the
+ * additions of the current one */
+class EvoSimulator::Collector : public Runnable {
+public:
+	Collector(EvoSimulator* sim) : _sim(sim) {}
+	
+	void run() {
+		for (int i=0; i<(int)_sim->_retired.size(); i++) {
+			ScopedLock lock( _sim->_heapMutex );
+			_sim->_heap->collectGenotype( _sim->_retired[i] );
+		}
+	}
+	
+private:
+	EvoSimulator* _sim;
+};
+
+/* Produces the offspring of a range of blocks of individuals; the operations created are staged.  Each
+ * block draws from a stream of its own, numbered by the generation and the block, so a seeded run breeds
+ * the same offspring whichever thread takes the block */
+class EvoSimulator::Breeder : public ParallelTask {
+public:
+	Breeder(EvoSimulator* sim, const vector<IGenotype*>& indIn, IRecombinator* recombinator) :
+		_sim(sim), _indIn(indIn), _recombinator(recombinator) {}
+	
+	void run(int begin, int end, int) {
+		BaseOperation::setStaging( true );
+		RandomStream stream;
+		int N = _indIn.size();
+		int last = (int)_sim->_offspring.size();
+		if (end*BREED_GRAIN < last) last = end*BREED_GRAIN;
+		for (int i=begin*BREED_GRAIN; i<last; i++) {
+			if (i % BREED_GRAIN == 0) stream.seed( _sim->_curr_gen, i / BREED_GRAIN );
+			Offspring& o = _sim->_offspring[i];
+			o.made.clear();
+			o.g1 = _indIn[(int)(random01()*N)];
+			o.g2 = 0;
+			IGenotype* gOut = o.g1;
+			if (_recombinator) {
+				o.g2 = _indIn[(int)(random01()*N)];
+				gOut = _recombinator->recombine(*o.g1, *o.g2);
+				if (gOut != o.g1 && gOut != o.g2) o.made.push_back( gOut );
+			}
+			for (std::set<IMutator*>::iterator it = _sim->_mutators.begin(); it!=_sim->_mutators.end(); it++) {
+				IGenotype* gIn = gOut;
+				gOut = (*it)->mutate( *gIn );
+				if (gOut != gIn) o.made.push_back( gOut );
+			}
+			o.child = gOut;
+		}
+		BaseOperation::setStaging( false );
+	}
+	
+private:
+	EvoSimulator* _sim;
+	const vector<IGenotype*>& _indIn;
+	IRecombinator* _recombinator;
+};
+
 EvoSimulator::EvoSimulator(IGenotypeHeap* h): 
-	GenotypeSimulator(h), _curr_gen(0), _indDirty(true), _indIn(0), _indOut(0) {
+	GenotypeSimulator(h), _curr_gen(0), _indIn(0), _indOut(0), _indDirty(true), _merged(0), _pipelined(false), _parallel(false), _exporter(0) {
 	
+	_collector = new Collector(this);
 	initRandom();
 }
 
+EvoSimulator::~EvoSimulator() {
+	waitRetired();
+	delete _collector;
+	delete _exporter;
+}
+
 void EvoSimulator::addGenotype(IGenotype* g) {
 	addGenotype(g, 0.0);
 }
@@ -131,6 +202,10 @@ int EvoSimulator::clock() const {
 	return _curr_gen;
 }
 
+long EvoSimulator::mergedCount() const {
+	return _merged;
+}
+
 void EvoSimulator::checkIndividuals(long N) {
 	if (!_indDirty) return;
 
@@ -208,46 +283,76 @@ void EvoSimulator::evolve(long N, long G) {
 #ifdef DEBUG_0
 		cout <<	_curr_gen << " Resampling " << N << " individuals.\n";
 #endif
+		if (_parallel) breed( N, indIn, recombinator );
+		
 		//#pragma omp parallel for private(p1,p2,g1,g2,gOut,gIn) num_threads(4)
 		for (int i=0; i<N; i++) {
-			// For each individual in the next generation, select a random parent
-			//#pragma omp critical
-			//{
-			//	cout << "Thread " << omp_get_thread_num() << " of " << omp_get_num_threads() << ": " << i << endl;
-			//}
-			p1 = (int)(random01()*N); //randomParent();
-			g1 = indIn[p1];
-			gOut_=0;
-
-			if (recombinator) {
-				// If recombination, select another parent, and perform a recombination (maybe)
-				p2 = (int)(random01()*N); //randomParent();
-				g2 = indIn[p2];
-				gOut = recombinator->recombine(*g1, *g2);
-				if (gOut != g1 && gOut != g2) {
-					gOut_ = gOut;
-					//GenotypeSimulator::addGenotype(gOut);
-				}
-
+			if (_parallel) {
+				Offspring& o = _offspring[i];
+				g1 = o.g1;
+				g2 = o.g2;
+				gOut = o.child;
+				// The genotypes made on the way to the child are recorded first, as they were made
+				ScopedLock lock( _heapMutex );
+				for (int j=0; j+1<(int)o.made.size(); j++) GenotypeSimulator::addGenotype( o.made[j] );
 			} else {
-				// If no recombination, directly inherit from the parent				
-				gOut = g1;
-				g2 = 0;
-			}
+				// For each individual in the next generation, select a random parent
+				//#pragma omp critical
+				//{
+				//	cout << "Thread " << omp_get_thread_num() << " of " << omp_get_num_threads() << ": " << i << endl;
+				//}
+				p1 = (int)(random01()*N); //randomParent();
+				g1 = indIn[p1];
+				gOut_=0;
+
+				if (recombinator) {
+					// If recombination, select another parent, and perform a recombination (maybe)
+					p2 = (int)(random01()*N); //randomParent();
+					g2 = indIn[p2];
+					gOut = recombinator->recombine(*g1, *g2);
+					if (gOut != g1 && gOut != g2) {
+						gOut_ = gOut;
+						//GenotypeSimulator::addGenotype(gOut);
+					}
+
+				} else {
+					// If no recombination, directly inherit from the parent				
+					gOut = g1;
+					g2 = 0;
+				}
 
-			// Mutate the zygote
-			for (std::set<IMutator*>::iterator it = _mutators.begin(); it!=_mutators.end(); it++) {
-				IMutator* mutator = *it;
-				gIn = gOut;
-				gOut = mutator->mutate( *gIn );
-				if (gOut != gIn) {
-					if(gOut_)
-						GenotypeSimulator::addGenotype(gOut_);
-					gOut_ = gOut;
+				// Mutate the zygote
+				for (std::set<IMutator*>::iterator it = _mutators.begin(); it!=_mutators.end(); it++) {
+					IMutator* mutator = *it;
+					gIn = gOut;
+					gOut = mutator->mutate( *gIn );
+					if (gOut != gIn) {
+						if(gOut_) {
+							ScopedLock lock( _heapMutex );
+							GenotypeSimulator::addGenotype(gOut_);
+						}
+						gOut_ = gOut;
+					}
 				}
+			
+				if(gOut_) gOut = gOut_;
 			}
 			
-			if(gOut_) gOut = gOut_;
+			// The Heap may be removing the previous generation's genotypes meanwhile
+			ScopedLock lock( _heapMutex );
+			if (gOut != g1 && gOut != g2) {
+				// Merge a new genotype into an identical one that already exists
+				IGenotype* same = _heap->findDuplicate( gOut );
+				if (same) {
+					// Activate it first, so discarding gOut cannot cascade into it
+					activateGenotype( same, one_individual );
+					GenotypeSimulator::addGenotype( gOut );
+					removeGenotype( gOut );
+					_merged++;
+					indOut[i] = same;
+					continue;
+				}
+			}
 			
 			if (gOut != g1 && gOut != g2) {
 				// A new genotype has been created, so we need to record it
@@ -268,7 +373,8 @@ void EvoSimulator::evolve(long N, long G) {
 		}
 		
 		// Get rid of genotypes which are not present in the subsequent generation
-		compactActive(N);
+		if (_pipelined) retireBehind();
+		else compactActive(N);
 
 		
 		// Swap references to the array
@@ -276,9 +382,13 @@ void EvoSimulator::evolve(long N, long G) {
 		
 		finishGeneration();
 		
+		// Their removal overlaps the next generation
+		if (_pipelined) _collectorThread.start( _collector );
+		
 		_curr_gen++;
 		
 	}
+	waitRetired();
 	_indIn = &indIn;
 	_indOut = &indOut;
 	
@@ -416,6 +526,49 @@ void EvoSimulator::compactActive(long N) {
 	
 }
 
+void EvoSimulator::retireBehind() {
+	waitRetired();
+	_retired.clear();
+	GIter git = _active.begin();
+	while (git != _active.end()) {
+		IGenotype* g = *git;
+		git++;
+		if (g->frequency() <= 0) {
+			retireGenotype( g );
+			_heap->retireGenotype( g );
+			_retired.push_back( g );
+		}
+	}
+}
+
+void EvoSimulator::waitRetired() {
+	_collectorThread.join();
+}
+
+void EvoSimulator::breed(long N, const vector<IGenotype*>& indIn, IRecombinator* recombinator) {
+	_offspring.resize( N );
+	Breeder task( this, indIn, recombinator );
+	ThreadPool::instance().parallelFor( (N + BREED_GRAIN-1) / BREED_GRAIN, task );
+}
+
+void EvoSimulator::setParallelOffspring(bool b) { _parallel = b; }
+
+bool EvoSimulator::parallelOffspring() const { return _parallel; }
+
+void EvoSimulator::setBatchExporter(IBatchExporter* e) {
+	if (e != _exporter) delete _exporter;
+	_exporter = e;
+}
+
+IBatchExporter* EvoSimulator::batchExporter() const { return _exporter; }
+
+void EvoSimulator::setPipelined(bool b) {
+	waitRetired();
+	_pipelined = b;
+}
+
+bool EvoSimulator::pipelined() const { return _pipelined; }
+
 const set<IGenotype*>& EvoSimulator::activeGenotypes() const { return _active; }
 
 IGenotype* EvoSimulator::activateGenotype(IGenotype* g, double freq) {
@@ -431,6 +584,7 @@ IGenotype* EvoSimulator::activateGenotype(IGenotype* g, double freq) {
 		g->setIndex(1);
 		g->setState(1);
 		_active.insert( g );
+		_heap->genotypeActivated( g );
 	} else {
 		g->setIndex(-1);
 		g->setState(-1);
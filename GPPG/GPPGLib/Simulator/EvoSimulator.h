@@ -11,13 +11,20 @@
 #define EVO_SIMULATOR_
 
 #include <Base/Simulator.h>
+#include <Util/Thread.h>
+#include <vector>
 
 namespace GPPG {
+	class IBatchExporter;
 	
 	class EvoSimulator : public GenotypeSimulator {
 	public:
 		EvoSimulator(IGenotypeHeap* heap);
 		
+		/** Waits for the genotypes still being removed.
+		 */
+		~EvoSimulator();
+		
 		void addGenotype(IGenotype* g);
 		
 		void addGenotype(IGenotype* g, double freq);
@@ -32,11 +39,40 @@ namespace GPPG {
 		 */
 		int clock() const;
 		
+		/** Returns the number of new genotypes merged into an identical existing one.
+		 */
+		long mergedCount() const;
+		
 		/** Evolve the population of size \param N for \param G generations.
 		 */
 		void evolve2(long N, long G);
 		void evolve(long N, long G);
 		
+		/** Remove the genotypes that left the population behind the next generation (in evolve()).
+		 * The genotypes are retired at the end of each generation as usual, but the Heap removes them, and
+		 * the ancestors only they kept alive, on a helper thread while the next generation is produced;
+		 * the removal is waited for before that generation is retired in turn.  The compression policy
+		 * still runs at the end of each generation, between the two.
+		 */
+		void setPipelined(bool b);
+		bool pipelined() const;
+		
+		/** Produce the offspring of a generation on the ThreadPool (in evolve()).  The parents are drawn,
+		 * recombined and mutated for all individuals at once, each thread staging the operations it
+		 * creates (see BaseOperation::setStaging()); each block of individuals draws from its own random
+		 * stream (see RandomStream), so a seeded run gives the same population on any number of threads.
+		 * The new genotypes are then recorded in the Heap, which links them to their parents, merged and
+		 * activated one individual after the other as usual.
+		 */
+		void setParallelOffspring(bool b);
+		bool parallelOffspring() const;
+		
+		/** Sets the exporter that writes the genotypes of the model in batches (see BatchEvaluator), which the
+		 * simulator then owns; without one (the default), genotypes are exported one by one.
+		 */
+		void setBatchExporter(IBatchExporter* e);
+		IBatchExporter* batchExporter() const;
+		
 	protected:
 		IGenotype* activateGenotype(IGenotype* g, double freq);
 		
@@ -53,14 +89,51 @@ namespace GPPG {
 		int randomParent();
 		
 	private:
+		class Collector;
+		friend class Collector;
+		class Breeder;
+		friend class Breeder;
+		
+		/** The parents of an individual and the genotypes made from them, the last one being the child.
+		 */
+		struct Offspring {
+			IGenotype *g1, *g2, *child;
+			std::vector<IGenotype*> made;
+		};
+		
 		void checkIndividuals(long N);
 		IGenotype* primeGenotype(IGenotype* g);
 		
+		/** Retires the genotypes that left the population and starts removing them behind the next generation.
+		 */
+		void retireBehind();
+		
+		/** Waits for the removal started by retireBehind().
+		 */
+		void waitRetired();
+		
+		/** Produces the Offspring of \param N individuals from \param indIn in parallel.
+		 */
+		void breed(long N, const std::vector<IGenotype*>& indIn, IRecombinator* recombinator);
+		
 		int _curr_gen;
 		std::set<IGenotype*> _active;
 		std::vector<IGenotype*> _ind1, _ind2;
 		std::vector<IGenotype*> *_indIn, *_indOut;
 		bool _indDirty;
+		long _merged;
+		
+		// Pipelined removal: the Heap is shared with the helper thread under _heapMutex
+		bool _pipelined;
+		std::vector<IGenotype*> _retired;
+		Collector* _collector;
+		Thread _collectorThread;
+		Mutex _heapMutex;
+		
+		bool _parallel;
+		std::vector<Offspring> _offspring;
+		
+		IBatchExporter* _exporter;
 	};
 	
 }
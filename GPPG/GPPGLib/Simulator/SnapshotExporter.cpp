@@ -0,0 +1,114 @@
+/*
+ *  SnapshotExporter.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "SnapshotExporter.h"
+#include "Simulator/EvoSimulator.h"
+#include "Operation/Operation.h"
+#include "Operation/BatchEvaluator.h"
+#include "Operation/OperationHeap.h"
+
+#include <fstream>
+
+using namespace GPPG;
+
+/** Writes the records of the captured genotypes as a batch exporter produces them.
+ */
+class SnapshotExporter::Writer : public IBatchExporter::Sink {
+public:
+	Writer(const std::vector<Entry>& entries, std::ostream& out) : _entries(entries), _out(out) {}
+	
+	void write(int i, const std::string& text) {
+		const Entry& e = _entries[i];
+		_out << ">g"<<i<<"|"<<e.key << "|" <<e.frequency<<"|"<<e.order<<std::endl;
+		_out << text;
+		_out << std::endl << std::endl;
+	}
+	
+private:
+	const std::vector<Entry>& _entries;
+	std::ostream& _out;
+};
+
+SnapshotExporter::SnapshotExporter() : _graph(0), _batch(0), _slot(-1), _cacheSlot(-1), _exports(0), _busy(false) {}
+
+SnapshotExporter::~SnapshotExporter() {
+	_thread.join();
+}
+
+void SnapshotExporter::capture(EvoSimulator* sim, const std::string& path) {
+	wait();
+	
+	// Pinned before the genotypes are picked up
+	_graph = dynamic_cast<OperationGraph*>( sim->heap() );
+	if (_graph) {
+		_slot = _graph->pinEpoch();
+		_cacheSlot = BaseOperation::pinCaches();
+	}
+	_batch = sim->batchExporter();
+	
+	const std::set<IGenotype*>& active = sim->activeGenotypes();
+	_entries.clear();
+	_entries.reserve( active.size() );
+	for (std::set<IGenotype*>::const_iterator git=active.begin(); git!=active.end(); git++) {
+		Entry e;
+		e.genotype = *git;
+		e.key = e.genotype->key();
+		e.order = e.genotype->order();
+		e.frequency = e.genotype->frequency();
+		_entries.push_back( e );
+	}
+	
+	_path = path;
+	_error.clear();
+	_busy = true;
+	if (_graph) _thread.start( this );
+	else run();
+}
+
+bool SnapshotExporter::busy() const { return _busy; }
+
+void SnapshotExporter::wait() {
+	if (!_busy) return;
+	_thread.join();
+	_busy = false;
+	if (!_error.empty()) {
+		// The message must outlive this call
+		static std::string message;
+		message = _error;
+		throw message.c_str();
+	}
+}
+
+long SnapshotExporter::numExports() const { return _exports; }
+
+void SnapshotExporter::run() {
+	BaseOperation::setCountingRequests( false );
+	try {
+		std::ofstream out( _path.c_str() );
+		if (!out) throw "SnapshotExporter: cannot open the output file";
+		Writer writer( _entries, out );
+		if (_batch) {
+			std::vector<IGenotype*> targets( _entries.size() );
+			for (int i=0; i<(int)_entries.size(); i++) targets[i] = _entries[i].genotype;
+			_batch->exportBatch( targets, writer );
+		} else {
+			for (int i=0; i<(int)_entries.size(); i++) writer.write( i, _entries[i].genotype->exportFormat() );
+		}
+		_exports++;
+	} catch (const char* e) {
+		_error = e;
+	}
+	BaseOperation::setCountingRequests( true );
+	_entries.clear();
+	if (_graph) {
+		_graph->unpinEpoch( _slot );
+		BaseOperation::unpinCaches( _cacheSlot );
+	}
+	_slot = -1;
+	_cacheSlot = -1;
+}
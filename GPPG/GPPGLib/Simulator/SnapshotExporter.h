@@ -0,0 +1,82 @@
+/*
+ *  SnapshotExporter.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef SNAPSHOT_EXPORTER_
+#define SNAPSHOT_EXPORTER_
+
+#include <Util/Thread.h>
+#include <string>
+#include <vector>
+
+namespace GPPG {
+	class EvoSimulator;
+	class IGenotype;
+	class IBatchExporter;
+	class OperationGraph;
+
+	/** SnapshotExporter writes the population of a simulation while it keeps evolving.
+	 * capture() takes the active genotypes with their keys, frequencies and orders at a generation
+	 * boundary, which costs O(active), and pins an epoch of the OperationGraph so none of them, nor their
+	 * ancestors, is deleted meanwhile; the caches the policy drops are kept as well (see
+	 * BaseOperation::pinCaches()).  The genomes are then evaluated and written on a thread of its own,
+	 * in the format of the individuals output, and the epochs are unpinned when the file is done.  Reads
+	 * made by the export are not counted as requests.  With a batch exporter set on the simulator, the
+	 * genomes are materialized together, and still written in the order of the genotypes.
+	 * Without an OperationGraph, or without thread support, capture() writes the file before it returns.
+	 */
+	class SnapshotExporter : public Runnable {
+	public:
+		SnapshotExporter();
+
+		/** Waits for the export still running.
+		 */
+		~SnapshotExporter();
+
+		/** Captures the active genotypes of \param sim, which must be between generations, and starts
+		 * writing them to \param path.  Waits for the previous export first.
+		 */
+		void capture(EvoSimulator* sim, const std::string& path);
+
+		/** True from capture() until wait().
+		 */
+		bool busy() const;
+
+		/** Waits for the export to finish.  An error thrown while writing is thrown again here.
+		 */
+		void wait();
+
+		/** Number of snapshots written.
+		 */
+		long numExports() const;
+
+		void run();
+
+	private:
+		SnapshotExporter(SnapshotExporter const&);
+		SnapshotExporter& operator=(SnapshotExporter const&);
+
+		class Writer;
+		friend class Writer;
+
+		struct Entry {
+			IGenotype* genotype;
+			int key, order;
+			double frequency;
+		};
+
+		Thread _thread;
+		std::vector<Entry> _entries;
+		OperationGraph* _graph;
+		IBatchExporter* _batch;
+		std::string _path, _error;
+		int _slot, _cacheSlot;	/* Pinned in the graph, and for the cached forms */
+		long _exports;
+		bool _busy;
+	};
+}
+#endif
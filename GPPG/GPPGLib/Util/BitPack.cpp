@@ -0,0 +1,80 @@
+/*
+ *  BitPack.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "BitPack.h"
+#include <cstring>
+
+using namespace GPPG;
+
+/* The first byte holds the width; the packed symbols follow (none for an empty sequence, so the
+ * payload is addressed from the header rather than indexed) */
+#define HEADER_BYTES 1
+
+void GPPG::packSymbols(const unsigned short* in, int n, std::vector<unsigned char>& out) {
+	unsigned short maxSymbol = 0;
+	for (int i=0; i<n; i++) if (in[i] > maxSymbol) maxSymbol = in[i];
+	int width = 1;
+	while (width < 16 && (maxSymbol >> width) != 0) width <<= 1;
+	
+	int bytes = (width >= 8) ? n*(width >> 3) : (n*width + 7) >> 3;
+	out.assign(HEADER_BYTES + bytes, 0);
+	out[0] = (unsigned char)width;
+	unsigned char* p = &out[0] + HEADER_BYTES;
+	
+	if (width == 16) {
+		memcpy(p, in, sizeof(unsigned short)*n);
+	} else if (width == 8) {
+		for (int i=0; i<n; i++) p[i] = (unsigned char)in[i];
+	} else {
+		int perByte = 8 / width;
+		for (int i=0; i<n; i++) p[i / perByte] |= (unsigned char)(in[i] << ((i % perByte)*width));
+	}
+}
+
+/* Byte to four 2-bit symbols; a constant table, so parallel decodes only ever read it */
+#define TWO_BIT_4(b) ((b) & 3), (((b) >> 2) & 3), (((b) >> 4) & 3), (((b) >> 6) & 3)
+#define TWO_BIT_16(b) TWO_BIT_4(b), TWO_BIT_4((b)+1), TWO_BIT_4((b)+2), TWO_BIT_4((b)+3)
+#define TWO_BIT_64(b) TWO_BIT_16(b), TWO_BIT_16((b)+4), TWO_BIT_16((b)+8), TWO_BIT_16((b)+12)
+#define TWO_BIT_256(b) TWO_BIT_64(b), TWO_BIT_64((b)+16), TWO_BIT_64((b)+32), TWO_BIT_64((b)+48)
+
+static const unsigned short TWO_BIT_TABLE[256*4] = {
+	TWO_BIT_256(0), TWO_BIT_256(64), TWO_BIT_256(128), TWO_BIT_256(192)
+};
+
+void GPPG::unpackSymbols(const std::vector<unsigned char>& in, unsigned short* out, int n) {
+	int width = in[0];
+	const unsigned char* p = &in[0] + HEADER_BYTES;
+	
+	if (width == 16) {
+		memcpy(out, p, sizeof(unsigned short)*n);
+	} else if (width == 8) {
+		for (int i=0; i<n; i++) out[i] = p[i];
+	} else if (width == 2) {
+		const unsigned short* table = TWO_BIT_TABLE;
+		int full = n >> 2;
+		for (int i=0; i<full; i++) memcpy(&out[i << 2], &table[p[i]*4], 4*sizeof(unsigned short));
+		for (int i=full << 2; i<n; i++) out[i] = table[p[full]*4 + (i & 3)];
+	} else {
+		int perByte = 8 / width;
+		unsigned short mask = (1 << width) - 1;
+		for (int i=0; i<n; i++) out[i] = (p[i / perByte] >> ((i % perByte)*width)) & mask;
+	}
+}
+
+unsigned short GPPG::unpackSymbol(const std::vector<unsigned char>& in, int i) {
+	int width = in[0];
+	const unsigned char* p = &in[0] + HEADER_BYTES;
+	if (width == 16) {
+		unsigned short v;
+		memcpy(&v, p + 2*i, sizeof(v));
+		return v;
+	}
+	if (width == 8) return p[i];
+	int perByte = 8 / width;
+	return (p[i / perByte] >> ((i % perByte)*width)) & ((1 << width) - 1);
+}
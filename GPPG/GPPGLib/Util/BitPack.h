@@ -0,0 +1,29 @@
+/*
+ *  BitPack.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+#ifndef BIT_PACK_
+#define BIT_PACK_
+
+#include <vector>
+
+namespace GPPG {
+
+	/** Packs \param n symbols into \param out using 1, 2, 4, 8 or 16 bits each, whichever is the
+	 * smallest that holds the largest symbol.  Fixed widths keep both random access and bulk
+	 * decoding cheap (a 4-letter sequence decodes from a byte table, 4 symbols at a time).
+	 */
+	void packSymbols(const unsigned short* in, int n, std::vector<unsigned char>& out);
+
+	/** Unpacks the \param n symbols in \param in into \param out.
+	 */
+	void unpackSymbols(const std::vector<unsigned char>& in, unsigned short* out, int n);
+
+	/** Unpacks the \param i'th symbol of \param in.
+	 */
+	unsigned short unpackSymbol(const std::vector<unsigned char>& in, int i);
+}
+#endif
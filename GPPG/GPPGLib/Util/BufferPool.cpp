@@ -0,0 +1,159 @@
+/*
+ *  BufferPool.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "BufferPool.h"
+#include "Numa.h"
+#include <cstdlib>
+#include <sys/mman.h>
+
+using namespace GPPG;
+
+#define BUFFER_ALIGN 64
+#define HUGE_PAGE_SIZE (2*1024*1024)
+#define SMALL_PAGE_SIZE 4096
+#define NUMA_MIN_SIZE (64*1024)
+
+typedef std::map< size_t, std::vector<void*> >::iterator PoolIter;
+
+BufferPool& BufferPool::instance() {
+	static BufferPool pool;
+	return pool;
+}
+
+BufferPool::BufferPool() : _free(1),
+	_maxCached(256*1024*1024), _cached(0), _used(0), _hits(0), _misses(0), _hugePages(false), _numa(NUMA_FIRST_TOUCH) {}
+
+BufferPool::~BufferPool() {
+	trim();
+}
+
+size_t BufferPool::roundSize(size_t bytes) const {
+	if (bytes == 0) bytes = 1;
+	if (_hugePages && bytes >= HUGE_PAGE_SIZE)
+		return (bytes + HUGE_PAGE_SIZE-1) & ~((size_t)HUGE_PAGE_SIZE-1);
+	// Placement policies apply to whole pages
+	if (_numa != NUMA_FIRST_TOUCH && bytes >= NUMA_MIN_SIZE)
+		return (bytes + SMALL_PAGE_SIZE-1) & ~((size_t)SMALL_PAGE_SIZE-1);
+	return (bytes + BUFFER_ALIGN-1) & ~((size_t)BUFFER_ALIGN-1);
+}
+
+void* BufferPool::allocateNew(size_t size) {
+	void* p = 0;
+	size_t align = BUFFER_ALIGN;
+	if (_hugePages && size >= HUGE_PAGE_SIZE) align = HUGE_PAGE_SIZE;
+	else if (_numa != NUMA_FIRST_TOUCH && size >= NUMA_MIN_SIZE) align = SMALL_PAGE_SIZE;
+	if (posix_memalign(&p, align, size) != 0) {
+		// Give back what we are holding and try once more
+		trim();
+		if (posix_memalign(&p, align, size) != 0) throw "BufferPool: out of memory";
+	}
+#ifdef MADV_HUGEPAGE
+	if (align == HUGE_PAGE_SIZE) madvise(p, size, MADV_HUGEPAGE);
+#endif
+	// Placement is best effort; without NUMA support the pages are simply first-touch
+	if (size >= NUMA_MIN_SIZE) {
+		if (_numa == NUMA_INTERLEAVE) numaInterleave(p, size);
+		else if (_numa == NUMA_LOCAL) numaBindLocal(p, size);
+	}
+	return p;
+}
+
+int BufferPool::nodeOf(size_t size, void* p) const {
+	if (_free.size() < 2 || size < NUMA_MIN_SIZE) return 0;
+	int node = p ? numaNodeOf(p) : -1;
+	if (node < 0 || node >= (int)_free.size()) node = numaCurrentNode() % _free.size();
+	return node;
+}
+
+void* BufferPool::allocate(size_t bytes) {
+	size_t size = roundSize(bytes);
+	int node = nodeOf(size, 0);
+	{
+		ScopedLock lock( _mutex );
+		PoolIter it = _free[node].find(size);
+		if (it != _free[node].end() && it->second.size() > 0) {
+			void* p = it->second.back();
+			it->second.pop_back();
+			_cached -= size;
+			_used += size;
+			_hits++;
+			return p;
+		}
+	}
+
+	// Fresh buffers are allocated and placed outside the lock, so parallel waves do not queue on it;
+	// they only count once the allocation has succeeded
+	void* p = allocateNew(size);
+	ScopedLock lock( _mutex );
+	_used += size;
+	_misses++;
+	return p;
+}
+
+void BufferPool::release(void* p, size_t bytes) {
+	if (p == 0) return;
+	size_t size = roundSize(bytes);
+	int node = nodeOf(size, p);
+	ScopedLock lock( _mutex );
+	_used -= size;
+
+	if (_cached + size > _maxCached) {
+		free(p);
+		return;
+	}
+	_free[node][size].push_back(p);
+	_cached += size;
+}
+
+void BufferPool::trim() {
+	ScopedLock lock( _mutex );
+	freeCached();
+}
+
+void BufferPool::freeCached() {
+	for (size_t n=0; n<_free.size(); n++) {
+		for (PoolIter it=_free[n].begin(); it!=_free[n].end(); it++) {
+			std::vector<void*>& bufs = it->second;
+			for (size_t i=0; i<bufs.size(); i++) free(bufs[i]);
+		}
+		_free[n].clear();
+	}
+	_cached = 0;
+}
+
+void BufferPool::setHugePages(bool b) {
+	// Rounding depends on this flag, so it cannot change under outstanding buffers
+	if (b == _hugePages) return;
+	if (_used > 0) throw "BufferPool: page mode must be set before buffers are allocated";
+	trim();
+	_hugePages = b;
+}
+
+bool BufferPool::hugePages() const { return _hugePages; }
+
+void BufferPool::setNumaPolicy(NumaPolicy p) {
+	if (p == _numa) return;
+	if (_used > 0) throw "BufferPool: NUMA policy must be set before buffers are allocated";
+	trim();
+	_numa = p;
+	_free.assign( (p == NUMA_LOCAL) ? numaNodes() : 1, FreeLists() );
+}
+
+BufferPool::NumaPolicy BufferPool::numaPolicy() const { return _numa; }
+
+void BufferPool::setMaxCached(size_t bytes) { _maxCached = bytes; }
+
+size_t BufferPool::maxCached() const { return _maxCached; }
+
+long BufferPool::hits() const { return _hits; }
+
+long BufferPool::misses() const { return _misses; }
+
+size_t BufferPool::cachedBytes() const { return _cached; }
+
+size_t BufferPool::usedBytes() const { return _used; }
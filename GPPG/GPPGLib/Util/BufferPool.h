@@ -0,0 +1,109 @@
+/*
+ *  BufferPool.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef BUFFER_POOL_
+#define BUFFER_POOL_
+
+#include "Util/Thread.h"
+#include <cstddef>
+#include <map>
+#include <vector>
+
+namespace GPPG {
+
+	/** BufferPool recycles the genome-sized buffers used by the data classes.
+	 * Evaluating an Operation allocates and frees whole genomes at a high rate, so released buffers
+	 * are kept on a free list per (rounded) size and handed back out on the next request of that size.
+	 * All buffers are 64-byte aligned; large buffers may optionally be backed by huge pages and placed
+	 * on NUMA nodes by a placement policy.  Buffers may be taken and given back on any thread.
+	 */
+	class BufferPool {
+	public:
+		/** Where large buffers are placed on NUMA hosts.
+		 * NUMA_FIRST_TOUCH leaves it to the kernel, NUMA_INTERLEAVE spreads each buffer over all nodes
+		 * (for genomes read from every node), and NUMA_LOCAL keeps it on the allocating thread's node.
+		 * Under NUMA_LOCAL released buffers are kept apart per node and only reused on the same node.
+		 */
+		enum NumaPolicy { NUMA_FIRST_TOUCH, NUMA_INTERLEAVE, NUMA_LOCAL };
+
+		/** Retrieves the process-wide pool.
+		 */
+		static BufferPool& instance();
+
+		BufferPool();
+
+		~BufferPool();
+
+		/** Returns a buffer of at least \param bytes bytes.
+		 * The buffer must be given back with release() using the same size.
+		 */
+		void* allocate(size_t bytes);
+
+		/** Returns the buffer \param p of \param bytes bytes to the pool.
+		 */
+		void release(void* p, size_t bytes);
+
+		/** Frees all buffers held on the free lists.
+		 */
+		void trim();
+
+		/** Back buffers of at least 2MB with (transparent) huge pages.
+		 * This must be set before any buffer is handed out.
+		 */
+		void setHugePages(bool b);
+		bool hugePages() const;
+
+		/** Sets the NUMA placement of buffers of at least 64KB, which are then page aligned.
+		 * Like the page mode, this must be set before any buffer is handed out.
+		 */
+		void setNumaPolicy(NumaPolicy p);
+		NumaPolicy numaPolicy() const;
+
+		/** Sets the maximum number of bytes kept on the free lists.
+		 */
+		void setMaxCached(size_t bytes);
+		size_t maxCached() const;
+
+		/** Number of requests served from (hits) or missing (misses) the free lists.
+		 */
+		long hits() const;
+		long misses() const;
+
+		/** Bytes currently held on the free lists.
+		 */
+		size_t cachedBytes() const;
+
+		/** Bytes currently handed out to callers.
+		 */
+		size_t usedBytes() const;
+
+	private:
+		BufferPool(BufferPool const&);
+		BufferPool& operator=(BufferPool const&);
+
+		size_t roundSize(size_t bytes) const;
+		/** Allocates and places a fresh buffer of \param size; called without holding the lock.
+		 */
+		void* allocateNew(size_t size);
+		void freeCached();
+
+		/** Index of the free lists for a buffer of \param size on the calling thread's node (allocating) or
+		 * placed at \param p (releasing).
+		 */
+		int nodeOf(size_t size, void* p) const;
+
+		typedef std::map< size_t, std::vector<void*> > FreeLists;
+		std::vector<FreeLists> _free;	/* One per node under NUMA_LOCAL */
+		size_t _maxCached, _cached, _used;
+		long _hits, _misses;
+		bool _hugePages;
+		NumaPolicy _numa;
+		Mutex _mutex;
+	};
+}
+#endif
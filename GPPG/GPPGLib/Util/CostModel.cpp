@@ -0,0 +1,110 @@
+/*
+ *  CostModel.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "CostModel.h"
+
+using namespace GPPG;
+
+/* Weight of the latest generation in the running means */
+#define COST_ALPHA 0.25
+
+/* Classes with fewer samples keep their configured cost */
+#define COST_MIN_SAMPLES 16
+
+/* Bounds the calibrated costs, so one noisy class cannot swamp the loads; the request counters are
+ * 64 bits, which holds reads times this cost for any run */
+#define COST_MAX 100000
+
+CostModel& CostModel::instance() {
+	static CostModel model;
+	return model;
+}
+
+CostModel::CostModel() : _period(0), _overhead(0) {
+	// The cheapest of a few back to back readings is the cost of timing nothing
+	for (int i=0; i<32; i++) {
+		unsigned long long start = ticks();
+		unsigned long long t = ticks() - start;
+		if (i == 0 || t < _overhead) _overhead = t;
+	}
+}
+
+int CostModel::addClass(int cost) {
+	if (cost <= 0) cost = 1;
+	Class c;
+	c.configured = cost;
+	c.cost = cost;
+	c.calls = 0;
+	c.samples = 0;
+	c.pending = 0;
+	c.pendingTicks = 0;
+	c.mean = 0;
+	_classes.push_back( c );
+	return _classes.size()-1;
+}
+
+int CostModel::addClass(const std::string& kind, int cost) {
+	std::map<std::string, int>::iterator it = _kinds.find( kind );
+	if (it != _kinds.end()) return it->second;
+	int c = addClass( cost );
+	_kinds[kind] = c;
+	return c;
+}
+
+int CostModel::numClasses() const { return _classes.size(); }
+
+void CostModel::setSampling(int period) {
+	if (period <= 0) {
+		_period = 0;
+		return;
+	}
+	_period = 1;
+	while (_period < period) _period <<= 1;
+}
+
+int CostModel::sampling() const { return _period; }
+
+void CostModel::record(int c, unsigned long long t) {
+	Class& cl = _classes[c];
+	atomicAdd( &cl.pendingTicks, (t > _overhead) ? t - _overhead : 0ULL );
+	atomicAdd( &cl.pending, 1L );
+}
+
+void CostModel::update() {
+	if (_period == 0) return;
+
+	// Fold the new samples into the running means
+	int ref = -1;
+	for (int i=0; i<(int)_classes.size(); i++) {
+		Class& c = _classes[i];
+		if (c.pending > 0) {
+			double m = (double)c.pendingTicks / c.pending;
+			c.mean = (c.samples == 0) ? m : (1-COST_ALPHA)*c.mean + COST_ALPHA*m;
+			c.samples += c.pending;
+			c.pending = 0;
+			c.pendingTicks = 0;
+		}
+		if (c.samples >= COST_MIN_SAMPLES && c.mean > 0 && (ref < 0 || c.samples > _classes[ref].samples)) ref = i;
+	}
+	if (ref < 0) return;
+
+	// The most sampled class sets the scale
+	double unit = _classes[ref].mean / _classes[ref].configured;
+	for (int i=0; i<(int)_classes.size(); i++) {
+		Class& c = _classes[i];
+		if (c.samples < COST_MIN_SAMPLES || c.mean <= 0) continue;
+		double v = c.mean / unit + 0.5;
+		c.cost = (v < 1) ? 1 : (v > COST_MAX) ? COST_MAX : (int)v;
+	}
+}
+
+int CostModel::configuredCost(int c) const { return _classes[c].configured; }
+
+double CostModel::ticksPerCall(int c) const { return _classes[c].mean; }
+
+long CostModel::samples(int c) const { return _classes[c].samples; }
@@ -0,0 +1,137 @@
+/*
+ *  CostModel.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef COST_MODEL_
+#define COST_MODEL_
+
+#include "Util/Thread.h"
+#include <map>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+namespace GPPG {
+
+	/** CostModel calibrates the cost of each kind of Operation from the CPU time it actually takes.
+	 * The configured costs (1 for a point mutation, 10 for an indel, ...) are guesses; the real cost of a
+	 * replay step depends on the genome length, the size of the change and the state of the caches.
+	 * Each kind of Operation has a cost class, which the mutators and recombinators creating it share, and
+	 * its Operations time their own work in evaluate() (not the work of their parents) with the time
+	 * stamp counter.  Single-item reads (proxyGet()) are not timed: they cost an index lookup, which says
+	 * nothing of what replaying the change costs.  Only one in a number of evaluations is timed, so the
+	 * overhead stays negligible.
+	 *
+	 * Once per generation the samples are folded into a running mean per class, and the costs are
+	 * rescaled so that the most sampled class keeps its configured cost.  BaseOperation::cost() returns
+	 * the calibrated cost, so the request counters and the compression policies follow it.  Calibration
+	 * is off until setSampling() is given a period.
+	 */
+	class CostModel {
+	public:
+		/** Retrieves the process-wide model.
+		 */
+		static CostModel& instance();
+
+		CostModel();
+
+		/** Registers a class with the configured \param cost and returns it.
+		 * Classes must be registered before the simulation starts.
+		 */
+		int addClass(int cost);
+		
+		/** Returns the class of the Operations of \param kind, registering it with the configured \param cost
+		 * the first time; later registrations of the kind share the class and its first cost.
+		 */
+		int addClass(const std::string& kind, int cost);
+		int numClasses() const;
+
+		/** Time one in \param period calls of each class (rounded up to a power of two); 0 turns calibration off.
+		 */
+		void setSampling(int period);
+		int sampling() const;
+
+		/** Returns true if this call of class \param c should be timed.
+		 */
+		bool sample(int c) {
+			return _period > 0 && (atomicAdd( &_classes[c].calls, 1L ) & (_period-1)) == 0;
+		}
+
+		/** Adds a timed call of class \param c that took \param ticks.
+		 */
+		void record(int c, unsigned long long ticks);
+
+		/** Folds the samples taken since the last update into the costs.
+		 */
+		void update();
+
+		/** Retrieves the current cost of class \param c.
+		 */
+		int cost(int c) const { return _classes[c].cost; }
+
+		/** Retrieves the configured cost, the mean measured ticks per call and the number of samples of class \param c.
+		 */
+		int configuredCost(int c) const;
+		double ticksPerCall(int c) const;
+		long samples(int c) const;
+
+		/** Reads the time stamp counter (a monotonic clock in nanoseconds where there is none).
+		 */
+		static unsigned long long ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+			return __rdtsc();
+#else
+			timespec t;
+			clock_gettime(CLOCK_MONOTONIC, &t);
+			return (unsigned long long)t.tv_sec*1000000000ULL + t.tv_nsec;
+#endif
+		}
+
+	private:
+		CostModel(CostModel const&);
+		CostModel& operator=(CostModel const&);
+
+		struct Class {
+			int configured, cost;
+			long calls, samples, pending;
+			unsigned long long pendingTicks;
+			double mean;
+		};
+
+		std::vector<Class> _classes;
+		std::map<std::string, int> _kinds;	/* Class of each kind of Operation */
+		int _period;
+		unsigned long long _overhead;	/* Ticks taken by the timing itself */
+	};
+
+	/** Times the enclosing scope for class \param c, if the call is sampled.
+	 * A negative class (the roots) is never timed.
+	 */
+	class CostTimer {
+	public:
+		CostTimer(int c) : _class(c), _start(0) {
+			if (c >= 0 && CostModel::instance().sample(c)) _start = CostModel::ticks();
+		}
+
+		~CostTimer() {
+			if (_start) CostModel::instance().record( _class, CostModel::ticks() - _start );
+		}
+
+	private:
+		CostTimer(CostTimer const&);
+		CostTimer& operator=(CostTimer const&);
+
+		int _class;
+		unsigned long long _start;
+	};
+}
+#endif
@@ -0,0 +1,50 @@
+/*
+ *  Epochs.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "Epochs.h"
+
+using namespace GPPG;
+
+Epochs::Epochs() : _epoch(1), _pinned(0) {
+	for (int i=0; i<EPOCH_SLOTS; i++) _slots[i] = 0;
+}
+
+int Epochs::pin() {
+	// Counted first, so a writer that finds no reader pinned never misses one about to pick up pointers
+	atomicAdd( &_pinned, 1 );
+	long e = current();
+	for (int i=0; i<EPOCH_SLOTS; i++) {
+		if (atomicCompareAndSwap( &_slots[i], 0L, e )) return i;
+	}
+	atomicAdd( &_pinned, -1 );
+	throw "Too many readers pinned";
+}
+
+void Epochs::unpin(int slot) {
+	// Only the reader that pinned the slot changes it
+	long e = atomicAdd( &_slots[slot], 0L );
+	atomicCompareAndSwap( &_slots[slot], e, 0L );
+	atomicAdd( &_pinned, -1 );
+}
+
+int Epochs::numPinned() const {
+	return atomicAdd( (int*)&_pinned, 0 );
+}
+
+long Epochs::current() const {
+	return atomicAdd( (long*)&_epoch, 0L );
+}
+
+long Epochs::advance() {
+	long oldest = atomicAdd( &_epoch, 1L );
+	for (int i=0; i<EPOCH_SLOTS; i++) {
+		long e = atomicAdd( &_slots[i], 0L );
+		if (e != 0 && e < oldest) oldest = e;
+	}
+	return oldest;
+}
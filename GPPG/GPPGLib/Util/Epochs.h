@@ -0,0 +1,56 @@
+/*
+ *  Epochs.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef EPOCHS_
+#define EPOCHS_
+
+#include "Util/Thread.h"
+
+/* Number of readers that may pin an epoch at the same time */
+#define EPOCH_SLOTS 64
+
+namespace GPPG {
+
+	/** Epochs tells a writer when objects it unlinked can no longer be seen by readers on other threads.
+	 * A reader pins the current epoch before it picks up pointers and unpins it when done.  The writer
+	 * tags each object it unlinks with the current epoch, and may free it once advance() returns a later
+	 * epoch: every reader still pinned then started after the object was unlinked.
+	 * Pinning and unpinning take no lock; only the writer advances the epoch.
+	 */
+	class Epochs {
+	public:
+		Epochs();
+
+		/** Pins the current epoch and returns the slot to unpin it with.  Throws if all slots are taken.
+		 */
+		int pin();
+		void unpin(int slot);
+
+		/** Number of readers pinned.
+		 */
+		int numPinned() const;
+
+		/** The epoch objects unlinked now are tagged with.
+		 */
+		long current() const;
+
+		/** Starts the next epoch and returns the oldest one still pinned (the new one if none is):
+		 * objects tagged with an earlier epoch may be freed.
+		 */
+		long advance();
+
+	private:
+		Epochs(Epochs const&);
+		Epochs& operator=(Epochs const&);
+
+		long _epoch;
+		int _pinned;
+		long _slots[EPOCH_SLOTS];	/* Pinned epoch, 0 if free */
+	};
+}
+#endif
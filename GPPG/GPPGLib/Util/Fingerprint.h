@@ -0,0 +1,64 @@
+/*
+ *  Fingerprint.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+#ifndef FINGERPRINT_
+#define FINGERPRINT_
+
+namespace GPPG {
+
+	/** A 128-bit genotype fingerprint.
+	 * A genotype's fingerprint is the XOR of the keys of its (site, symbol) pairs (Zobrist hashing), so a
+	 * point change updates it in O(changes): XOR out the old pair, XOR in the new one.  Changes that move
+	 * sites (indels, crossovers) instead mix their parameters into the parents' fingerprints; two genotypes
+	 * reached that way only compare equal if they were built the same way.
+	 */
+	struct Fingerprint {
+		unsigned long long hi, lo;
+		
+		Fingerprint() : hi(0), lo(0) {}
+		Fingerprint(unsigned long long h, unsigned long long l) : hi(h), lo(l) {}
+		
+		bool operator==(const Fingerprint& f) const { return hi == f.hi && lo == f.lo; }
+		bool operator!=(const Fingerprint& f) const { return !(*this == f); }
+		bool operator<(const Fingerprint& f) const { return hi < f.hi || (hi == f.hi && lo < f.lo); }
+		
+		Fingerprint& operator^=(const Fingerprint& f) {
+			hi ^= f.hi;
+			lo ^= f.lo;
+			return *this;
+		}
+	};
+	
+	/** The splitmix64 finalizer.
+	 */
+	inline unsigned long long mix64(unsigned long long z) {
+		z += 0x9E3779B97F4A7C15ULL;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+	
+	/** The key of \param symbol at \param site.
+	 */
+	inline Fingerprint siteFingerprint(int site, unsigned int symbol) {
+		unsigned long long v = ((unsigned long long)(unsigned int)site << 20) ^ symbol;
+		return Fingerprint( mix64(v ^ 0x243F6A8885A308D3ULL), mix64(v ^ 0x13198A2E03707344ULL) );
+	}
+	
+	/** Mixes \param v into \param f (order dependent).
+	 */
+	inline Fingerprint mixFingerprint(const Fingerprint& f, unsigned long long v) {
+		unsigned long long hi = mix64(f.hi ^ mix64(v ^ 0xA4093822299F31D0ULL));
+		unsigned long long lo = mix64(f.lo ^ mix64(v ^ 0x082EFA98EC4E6C89ULL) ^ hi);
+		return Fingerprint(hi, lo);
+	}
+	
+	inline Fingerprint mixFingerprint(const Fingerprint& f, const Fingerprint& g) {
+		return mixFingerprint( mixFingerprint(f, g.hi), g.lo );
+	}
+}
+#endif
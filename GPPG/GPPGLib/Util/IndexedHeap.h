@@ -0,0 +1,121 @@
+/*
+ *  IndexedHeap.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+#ifndef INDEXED_HEAP_
+#define INDEXED_HEAP_
+
+#include <map>
+#include <vector>
+
+namespace GPPG {
+
+	/** IndexedHeap is a binary max-heap of items keyed by a long long (a load), which also knows where each item is.
+	 * That allows changing the key of (or removing) any item in O(log n).  Items with equal keys come
+	 * out smallest item first, so the order does not depend on the insertion order.
+	 */
+	template <typename T> class IndexedHeap {
+	public:
+		int size() const { return _heap.size(); }
+		bool empty() const { return _heap.empty(); }
+		bool contains(const T& item) const { return _pos.count(item) > 0; }
+
+		/** The item with the largest key, and its key.  The heap must not be empty.
+		 */
+		const T& top() const { return _heap[0].item; }
+		long long topKey() const { return _heap[0].key; }
+
+		/** Inserts \param item with \param key, or changes its key if it is already in the heap.
+		 */
+		void push(const T& item, long long key) {
+			typename std::map<T,int>::iterator it = _pos.find(item);
+			if (it != _pos.end()) {
+				update(it->second, key);
+				return;
+			}
+			Entry e = { item, key };
+			_heap.push_back(e);
+			_pos[item] = _heap.size()-1;
+			up(_heap.size()-1);
+		}
+
+		/** Removes \param item, if it is in the heap.
+		 */
+		void erase(const T& item) {
+			typename std::map<T,int>::iterator it = _pos.find(item);
+			if (it == _pos.end()) return;
+			int i = it->second;
+			_pos.erase(it);
+			int last = _heap.size()-1;
+			if (i != last) {
+				_heap[i] = _heap[last];
+				_pos[_heap[i].item] = i;
+			}
+			_heap.pop_back();
+			if (i < last) {
+				up(i);
+				down(i);
+			}
+		}
+
+		void pop() { erase(top()); }
+
+		void clear() {
+			_heap.clear();
+			_pos.clear();
+		}
+
+	private:
+		struct Entry {
+			T item;
+			long long key;
+		};
+
+		bool before(const Entry& a, const Entry& b) const {
+			return a.key > b.key || (a.key == b.key && a.item < b.item);
+		}
+
+		void update(int i, long long key) {
+			long long old = _heap[i].key;
+			_heap[i].key = key;
+			if (key > old) up(i);
+			else if (key < old) down(i);
+		}
+
+		void swap(int i, int j) {
+			Entry e = _heap[i];
+			_heap[i] = _heap[j];
+			_heap[j] = e;
+			_pos[_heap[i].item] = i;
+			_pos[_heap[j].item] = j;
+		}
+
+		void up(int i) {
+			while (i > 0) {
+				int p = (i-1)/2;
+				if (!before(_heap[i], _heap[p])) break;
+				swap(i, p);
+				i = p;
+			}
+		}
+
+		void down(int i) {
+			int n = _heap.size();
+			while (true) {
+				int l = 2*i+1, r = l+1, m = i;
+				if (l < n && before(_heap[l], _heap[m])) m = l;
+				if (r < n && before(_heap[r], _heap[m])) m = r;
+				if (m == i) break;
+				swap(i, m);
+				i = m;
+			}
+		}
+
+		std::vector<Entry> _heap;
+		std::map<T,int> _pos;
+	};
+}
+#endif
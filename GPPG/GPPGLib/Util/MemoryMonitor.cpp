@@ -0,0 +1,95 @@
+/*
+ *  MemoryMonitor.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "MemoryMonitor.h"
+#include "Util/BufferPool.h"
+#include <fstream>
+
+using namespace GPPG;
+
+/* Share of the limit under which a cap on k grows back */
+#define CAP_HEADROOM 0.75
+
+MemoryMonitor& MemoryMonitor::instance() {
+	static MemoryMonitor monitor;
+	return monitor;
+}
+
+MemoryMonitor::MemoryMonitor() : _limit(0), _last(0), _interval(64), _countdown(0), _quiet(0), _crossings(0) {}
+
+void MemoryMonitor::setSoftLimit(size_t bytes) { _limit = bytes; }
+
+size_t MemoryMonitor::softLimit() const { return _limit; }
+
+bool MemoryMonitor::setCgroupFile(const std::string& path) {
+	size_t bytes;
+	std::string previous = _cgroup;
+	_cgroup = path;
+	if (!path.empty() && !readCgroup( bytes )) {
+		_cgroup = previous;
+		return false;
+	}
+	_countdown = 0;
+	return true;
+}
+
+const std::string& MemoryMonitor::cgroupFile() const { return _cgroup; }
+
+void MemoryMonitor::setInterval(int n) { _interval = (n < 1) ? 1 : n; }
+
+int MemoryMonitor::interval() const { return _interval; }
+
+bool MemoryMonitor::readCgroup(size_t& bytes) const {
+	std::ifstream in( _cgroup.c_str() );
+	unsigned long long v;
+	if (!(in >> v)) return false;
+	bytes = (size_t)v;
+	return true;
+}
+
+size_t MemoryMonitor::usage() {
+	if (!_cgroup.empty()) {
+		size_t bytes;
+		if (readCgroup( bytes )) _last = bytes;
+		return _last;
+	}
+	const BufferPool& pool = BufferPool::instance();
+	_last = pool.usedBytes() + pool.cachedBytes();
+	return _last;
+}
+
+bool MemoryMonitor::check() {
+	if (_limit == 0) return false;
+	if (_quiet > 0) {
+		_quiet--;
+		return false;
+	}
+	// The file is read every interval checks; the accounting every time
+	if (!_cgroup.empty()) {
+		if (_countdown-- > 0) return false;
+		_countdown = _interval;
+	}
+	if (usage() <= _limit) return false;
+
+	_quiet = _interval;
+	_crossings++;
+	return true;
+}
+
+bool MemoryMonitor::overLimit() {
+	return _limit > 0 && usage() > _limit;
+}
+
+int MemoryMonitor::relaxCap(int cap, int k) {
+	// Near a limit k does not fit under, growing would uncompress genotypes only to shed them again
+	if (cap <= 0 || _limit == 0 || usage() > _limit*CAP_HEADROOM) return cap;
+	cap += cap/4 + 1;
+	return (cap >= k) ? 0 : cap;
+}
+
+long MemoryMonitor::numCrossings() const { return _crossings; }
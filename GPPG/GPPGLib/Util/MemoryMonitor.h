@@ -0,0 +1,83 @@
+/*
+ *  MemoryMonitor.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef MEMORY_MONITOR_
+#define MEMORY_MONITOR_
+
+#include <cstddef>
+#include <string>
+
+namespace GPPG {
+
+	/** MemoryMonitor watches the memory use of the simulation against a soft limit.
+	 * By default the use is the genome buffers handed out or cached by the BufferPool, which is
+	 * cheap to read on every check.  It can also be read from a cgroup file (memory.current), which
+	 * covers the whole process as the OOM killer sees it; the file is only read every few checks.
+	 * After the limit has been crossed, checks stay quiet for as many calls, so shedding has a chance
+	 * to work before it is triggered again.
+	 */
+	class MemoryMonitor {
+	public:
+		/** Retrieves the process-wide monitor.
+		 */
+		static MemoryMonitor& instance();
+
+		MemoryMonitor();
+
+		/** Sets the soft limit in bytes; 0 (the default) turns the monitor off.
+		 */
+		void setSoftLimit(size_t bytes);
+		size_t softLimit() const;
+
+		/** Reads the use from the cgroup file \param path (empty for the BufferPool accounting).
+		 * Returns false, and keeps the current source, if the file cannot be read.
+		 */
+		bool setCgroupFile(const std::string& path);
+		const std::string& cgroupFile() const;
+
+		/** Sets the number of checks between reads of the cgroup file, which is also the number of checks
+		 * that stay quiet after the limit was crossed.
+		 */
+		void setInterval(int n);
+		int interval() const;
+
+		/** Cheap check for the hot path: true if the limit was crossed.
+		 */
+		bool check();
+
+		/** Reads the current use and returns true if it is over the limit.
+		 */
+		bool overLimit();
+
+		/** Reads the current use in bytes.
+		 */
+		size_t usage();
+
+		/** The next value of a cap \param cap that shedding put on a policy's \param k: while the use is
+		 * well under the limit it grows back by a quarter (and one) per call, and it is lifted (0) once it
+		 * reaches k.  Policies call it once per generation, so a spike lowers k only for a while.
+		 */
+		int relaxCap(int cap, int k);
+
+		/** Number of times check() found the limit crossed.
+		 */
+		long numCrossings() const;
+
+	private:
+		MemoryMonitor(MemoryMonitor const&);
+		MemoryMonitor& operator=(MemoryMonitor const&);
+
+		bool readCgroup(size_t& bytes) const;
+
+		size_t _limit, _last;
+		std::string _cgroup;
+		int _interval, _countdown, _quiet;
+		long _crossings;
+	};
+}
+#endif
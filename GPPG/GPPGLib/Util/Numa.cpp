@@ -0,0 +1,147 @@
+/*
+ *  Numa.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "Numa.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+/* Memory policies from linux/mempolicy.h */
+#define GPPG_MPOL_PREFERRED 1
+#define GPPG_MPOL_INTERLEAVE 3
+#define GPPG_MPOL_MF_MOVE (1<<1)
+#define GPPG_MPOL_F_NODE (1<<0)
+#define GPPG_MPOL_F_ADDR (1<<1)
+
+#define NUMA_MAX_NODES 64
+
+using namespace GPPG;
+
+/** Parses a kernel list such as "0-3,8-11" into \param ids.
+ */
+static void parseList(const std::string& list, std::vector<int>& ids) {
+	std::stringstream ss(list);
+	std::string range;
+	while (std::getline(ss, range, ',')) {
+		int a, b;
+		int n = sscanf(range.c_str(), "%d-%d", &a, &b);
+		if (n < 1) continue;
+		if (n == 1) b = a;
+		for (int i=a; i<=b; i++) ids.push_back(i);
+	}
+}
+
+static bool readList(const char* path, std::vector<int>& ids) {
+	std::ifstream in(path);
+	std::string line;
+	if (!in || !std::getline(in, line)) return false;
+	parseList(line, ids);
+	return true;
+}
+
+/** Node ids that have memory (node ids need not be contiguous).
+ */
+static const std::vector<int>& memoryNodes() {
+	static std::vector<int> ids;
+	static bool read = false;
+	if (!read) {
+		readList("/sys/devices/system/node/has_memory", ids);
+		if (ids.size() == 0) ids.push_back(0);
+		read = true;
+	}
+	return ids;
+}
+
+int GPPG::numaNodes() {
+	const std::vector<int>& ids = memoryNodes();
+	int nodes = ids.back()+1;
+	return (nodes > NUMA_MAX_NODES) ? NUMA_MAX_NODES : nodes;
+}
+
+int GPPG::numaCurrentNode() {
+#if defined(__linux__) && defined(SYS_getcpu)
+	unsigned int cpu, node;
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0) return node;
+#endif
+	return 0;
+}
+
+int GPPG::numaNodeOf(const void* p) {
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+	int node;
+	if (memoryNodes().size() > 1 && syscall(SYS_get_mempolicy, &node, NULL, 0, p, GPPG_MPOL_F_NODE | GPPG_MPOL_F_ADDR) == 0) return node;
+#endif
+	return -1;
+}
+
+static bool setPolicy(void* p, size_t bytes, int mode, unsigned long mask, unsigned int flags) {
+#if defined(__linux__) && defined(SYS_mbind)
+	if (memoryNodes().size() < 2) return false;
+	return syscall(SYS_mbind, p, bytes, mode, mask ? &mask : NULL, mask ? NUMA_MAX_NODES+1 : 0, flags) == 0;
+#else
+	return false;
+#endif
+}
+
+bool GPPG::numaInterleave(void* p, size_t bytes) {
+	unsigned long mask = 0;
+	const std::vector<int>& ids = memoryNodes();
+	for (int i=0; i<(int)ids.size(); i++) if (ids[i] < NUMA_MAX_NODES) mask |= 1UL << ids[i];
+	return setPolicy(p, bytes, GPPG_MPOL_INTERLEAVE, mask, 0);
+}
+
+bool GPPG::numaBindLocal(void* p, size_t bytes) {
+	// A preferred policy with an empty node mask means "the local node"
+	return setPolicy(p, bytes, GPPG_MPOL_PREFERRED, 0, GPPG_MPOL_MF_MOVE);
+}
+
+bool GPPG::numaPinThread(int node) {
+#ifdef __linux__
+	char path[128];
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+	std::vector<int> cpus;
+	if (!readList(path, cpus) || cpus.size() == 0) return false;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int i=0; i<(int)cpus.size(); i++) CPU_SET(cpus[i], &set);
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
+
+void GPPG::numaResidentBytes(std::vector<size_t>& bytes) {
+	bytes.assign(numaNodes(), 0);
+
+	// Each mapping lists its pages per node as "N<node>=<pages>"
+	std::ifstream in("/proc/self/numa_maps");
+	std::string line, field;
+	while (std::getline(in, line)) {
+		size_t pageKB = 4;
+		size_t pos = line.find("kernelpagesize_kB=");
+		if (pos != std::string::npos) pageKB = atol(line.c_str() + pos + 18);
+
+		std::stringstream ss(line);
+		while (ss >> field) {
+			int node;
+			long pages;
+			if (field[0] == 'N' && sscanf(field.c_str(), "N%d=%ld", &node, &pages) == 2 && node >= 0 && node < (int)bytes.size())
+				bytes[node] += (size_t)pages * pageKB * 1024;
+		}
+	}
+}
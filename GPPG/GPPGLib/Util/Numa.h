@@ -0,0 +1,51 @@
+/*
+ *  Numa.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+#ifndef NUMA_
+#define NUMA_
+
+#include <cstddef>
+#include <vector>
+
+namespace GPPG {
+
+	/** Memory placement helpers for NUMA hosts.
+	 * These talk to the kernel directly (mbind, sched_setaffinity) so there is no libnuma dependency.
+	 * On single-node hosts, or where the calls are not supported, they fall back to doing nothing
+	 * (memory stays wherever it is first touched).
+	 */
+
+	/** Number of NUMA node ids in use, i.e. the highest node with memory plus one (1 if unknown).
+	 */
+	int numaNodes();
+
+	/** Node of the CPU the calling thread is running on (0 if unknown).
+	 */
+	int numaCurrentNode();
+
+	/** Node the page holding \param p is placed on (-1 if unknown or not yet touched).
+	 */
+	int numaNodeOf(const void* p);
+
+	/** Spreads the pages of \param p (\param bytes long, page aligned) round-robin over all nodes.
+	 * Returns false if the placement could not be applied.
+	 */
+	bool numaInterleave(void* p, size_t bytes);
+
+	/** Places the pages of \param p on the node of the calling thread.
+	 */
+	bool numaBindLocal(void* p, size_t bytes);
+
+	/** Restricts the calling thread to the CPUs of \param node.
+	 */
+	bool numaPinThread(int node);
+
+	/** Fills \param bytes with the resident memory of this process on each node.
+	 */
+	void numaResidentBytes(std::vector<size_t>& bytes);
+}
+#endif
@@ -9,6 +9,7 @@
 
 
 #include "Random.h"
+#include <cstring>
 
 //#include <boost/random/mersenne_twister.hpp>
 //#include <boost/random/binomial_distribution.hpp>
@@ -17,6 +18,16 @@
 // Seed for RNG
 		
 //boost::mt19937 gen2;
+
+/* Seeds of the first generator; other threads derive theirs from these */
+static int seedA = 0, seedB = 0, streams = 0;
+
+/* Seeds the generator of a thread that has not drawn yet */
+static inline void seedThread() {
+	if (seed_state()) return;
+	int s = GPPG::atomicAdd( &streams, 1 );
+	rmarin( seedA + 7919*s, seedB + 104729*s );
+}
 	
 int GPPG::binomialb(int n, double r) {
 	//boost::random::binomial_distribution<> dist( n, r );
@@ -25,15 +36,56 @@ int GPPG::binomialb(int n, double r) {
 	return 0;
 }
 	
-double GPPG::random01() { return ranmar(); }
+double GPPG::random01() {
+	seedThread();
+	return ranmar();
+}
 
-long GPPG::binomial(long n, double pp) { return ignbin(n, pp); }
+long GPPG::binomial(long n, double pp) {
+	seedThread();
+	return ignbin(n, pp);
+}
 
 void GPPG::initRandom2(int a, int b) { 
+	seedA = a;
+	seedB = b;
 	rmarin(a,b); 
 }
 
 void GPPG::initRandom() {
+	seedA = seedB = (int)time(0);
 	rmarin((int)time(0), (int)time(0));
 	//gen2.seed((unsigned int)time(0));
 }
+
+
+/* Folds \param v into the hash \param h */
+static inline unsigned long mixSeed(unsigned long h, unsigned long v) {
+	return h ^ (v + 0x9e3779b9UL + (h << 6) + (h >> 2));
+}
+
+GPPG::RandomStream::RandomStream() {
+	memcpy( _u, u, sizeof(_u) );
+	_c = c;
+	_cd = cd;
+	_cm = cm;
+	_i97 = i97;
+	_j97 = j97;
+	_test = test;
+}
+
+GPPG::RandomStream::~RandomStream() {
+	memcpy( u, _u, sizeof(_u) );
+	c = _c;
+	cd = _cd;
+	cm = _cm;
+	i97 = _i97;
+	j97 = _j97;
+	test = _test;
+}
+
+void GPPG::RandomStream::seed(long a, long b) {
+	unsigned long h = mixSeed( mixSeed( mixSeed( (unsigned long)seedA, (unsigned long)seedB ), (unsigned long)a ), (unsigned long)b );
+	// rmarin() takes seeds up to 31328 and 30081
+	rmarin( (int)(h % 31329), (int)((h / 31329) % 30082) );
+}
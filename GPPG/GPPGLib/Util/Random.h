@@ -15,9 +15,34 @@ namespace GPPG {
 
 	int binomialb(int n, double r);
 	
+	/** Draws from the generator of the calling thread.  Threads other than the first one are seeded
+	 * from its seed the first time they draw.
+	 */
 	double random01();
 	long binomial(long n, double pp);
 	void initRandom2(int a, int b);
 	void initRandom();
+	
+	/** Lets the calling thread draw from numbered streams while in scope, and gives it back its own
+	 * generator afterwards.  A stream depends only on the seed of the run (see initRandom2()) and its
+	 * number, so work split over threads draws the same numbers however it is scheduled.
+	 */
+	class RandomStream {
+	public:
+		RandomStream();
+		~RandomStream();
+		
+		/** Restarts the stream numbered \param a, \param b from its beginning.
+		 */
+		void seed(long a, long b);
+		
+	private:
+		RandomStream(RandomStream const&);
+		RandomStream& operator=(RandomStream const&);
+		
+		/* The thread's generator, as ranmar() keeps it */
+		double _u[98], _c, _cd, _cm;
+		int _i97, _j97, _test;
+	};
 }
 #endif
@@ -0,0 +1,264 @@
+/*
+ *  SitePayload.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "SitePayload.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+using namespace GPPG;
+
+#define MAX_SITES 0xFFFFFF
+
+/** Reads one varint from \param p, advancing it.
+ * Most deltas fit in a single byte, so that case is tested first.
+ */
+static inline unsigned int readVarint(const unsigned char*& p) {
+	unsigned int v = *p++;
+	if (v < 0x80) return v;
+	v &= 0x7F;
+	int shift = 7;
+	unsigned char b;
+	do {
+		b = *p++;
+		v |= (unsigned int)(b & 0x7F) << shift;
+		shift += 7;
+	} while (b & 0x80);
+	return v;
+}
+
+static inline int writeVarint(unsigned char* p, unsigned int v) {
+	int n = 0;
+	while (v >= 0x80) {
+		p[n++] = (unsigned char)(v | 0x80);
+		v >>= 7;
+	}
+	p[n++] = (unsigned char)v;
+	return n;
+}
+
+static inline int varintSize(unsigned int v) {
+	int n = 1;
+	while (v >= 0x80) { v >>= 7; n++; }
+	return n;
+}
+
+static inline unsigned short readSymbol(const unsigned char* p, int i, int bits) {
+	// Symbols are at most 16 bits, so they span at most 3 bytes
+	int bit = i*bits;
+	const unsigned char* b = p + (bit >> 3);
+	unsigned int w = b[0];
+	if ((bit & 7) + bits > 8) w |= (unsigned int)b[1] << 8;
+	if ((bit & 7) + bits > 16) w |= (unsigned int)b[2] << 16;
+	return (unsigned short)((w >> (bit & 7)) & ((1u << bits) - 1));
+}
+
+/* Orders (site, input order) pairs so the last write of a site comes last */
+typedef std::pair<int,int> SiteOrder;
+
+SitePayload::SitePayload() : _count(0), _bits(1), _size(0) {}
+
+SitePayload::SitePayload(const int* sites, const unsigned short* symbols, int n) : _count(0), _bits(1), _size(0) {
+	if (n <= 0) return;
+
+	std::vector<SiteOrder> order(n);
+	for (int i=0; i<n; i++) order[i] = SiteOrder(sites[i], i);
+	std::sort(order.begin(), order.end());
+
+	// Keep the last write of each site
+	std::vector<int> keep;
+	keep.reserve(n);
+	unsigned short maxSymbol = 0;
+	for (int i=0; i<n; i++) {
+		if (i+1 < n && order[i+1].first == order[i].first) continue;
+		keep.push_back(order[i].second);
+		if (symbols[order[i].second] > maxSymbol) maxSymbol = symbols[order[i].second];
+	}
+	if (keep.size() > MAX_SITES) throw "SitePayload: too many sites";
+
+	int bits = 1;
+	while (bits < 16 && (maxSymbol >> bits) != 0) bits++;
+	_bits = bits;
+	_count = keep.size();
+
+	int symBytes = symbolBytes();
+	int size = symBytes;
+	int prev = 0;
+	for (int i=0; i<(int)keep.size(); i++) {
+		size += varintSize(sites[keep[i]] - prev);
+		prev = sites[keep[i]];
+	}
+	// The index is aligned after the sites
+	int k = numIndexed();
+	if (k > 0) size = ((size + 3) & ~3) + 2*k*sizeof(int);
+
+	unsigned char* p = allocate(size);
+	memset(p, 0, size);
+	for (int i=0; i<(int)keep.size(); i++) {
+		unsigned int w = (unsigned int)symbols[keep[i]] << ((i*bits) & 7);
+		unsigned char* b = p + ((i*bits) >> 3);
+		for (; w != 0; w >>= 8) *b++ |= (unsigned char)w;
+	}
+
+	unsigned char* q = p + symBytes;
+	int* indexed = (int*)indexSites();
+	int* offsets = (int*)indexOffsets();
+	prev = 0;
+	for (int i=0; i<(int)keep.size(); i++) {
+		q += writeVarint(q, sites[keep[i]] - prev);
+		prev = sites[keep[i]];
+		if (i > 0 && i % INDEX_STRIDE == 0) {
+			*indexed++ = prev;
+			*offsets++ = q - (p + symBytes);
+		}
+	}
+}
+
+SitePayload::SitePayload(SitePayload const& p) : _count(p._count), _bits(p._bits), _size(0) {
+	memcpy(allocate(p._size), p.bytes(), p._size);
+}
+
+SitePayload::~SitePayload() { release(); }
+
+SitePayload& SitePayload::operator=(SitePayload const& p) {
+	if (this == &p) return *this;
+	release();
+	_count = p._count;
+	_bits = p._bits;
+	memcpy(allocate(p._size), p.bytes(), p._size);
+	return *this;
+}
+
+int SitePayload::size() const { return _count; }
+
+int SitePayload::encodedSize() const { return _size; }
+
+int SitePayload::symbolBytes() const { return (_count*_bits + 7) >> 3; }
+
+const unsigned char* SitePayload::bytes() const {
+	return (_size > INLINE_BYTES) ? _heap : _inline;
+}
+
+int SitePayload::numIndexed() const { return (_count > INDEX_STRIDE) ? (_count-1)/INDEX_STRIDE : 0; }
+
+const int* SitePayload::indexSites() const {
+	return (const int*)(bytes() + _size - 2*numIndexed()*sizeof(int));
+}
+
+const int* SitePayload::indexOffsets() const { return indexSites() + numIndexed(); }
+
+unsigned char* SitePayload::allocate(int size) {
+	_size = size;
+	if (size > INLINE_BYTES) {
+		_heap = (unsigned char*) malloc(size);
+		if (_heap == 0) throw "SitePayload: out of memory";
+		return _heap;
+	}
+	return _inline;
+}
+
+void SitePayload::release() {
+	if (_size > INLINE_BYTES) free(_heap);
+	_size = 0;
+	_count = 0;
+}
+
+void SitePayload::decode(int* sites, unsigned short* symbols) const {
+	const unsigned char* p = bytes();
+	int n = _count;
+	int bits = _bits;
+	if (symbols) {
+		for (int i=0; i<n; i++) symbols[i] = readSymbol(p, i, bits);
+	}
+	if (sites) {
+		const unsigned char* q = p + symbolBytes();
+		int site = 0;
+		for (int i=0; i<n; i++) {
+			site += readVarint(q);
+			sites[i] = site;
+		}
+	}
+}
+
+bool SitePayload::find(int site, unsigned short& symbol) const {
+	const unsigned char* p = bytes();
+	const unsigned char* q = p + symbolBytes();
+	int n = _count;
+	int s = 0, i = 0;
+	int k = numIndexed();
+	if (k > 0) {
+		// Find the last indexed site up to the one looked up; the steps compile to conditional moves
+		const int* indexed = indexSites();
+		const int* it = indexed;
+		for (int len = k; len > 1; ) {
+			int half = len >> 1;
+			it = (it[half] <= site) ? it + half : it;
+			len -= half;
+		}
+		if (*it <= site) {
+			int e = it - indexed;
+			i = (e+1)*INDEX_STRIDE;
+			if (*it == site) {
+				symbol = readSymbol(p, i, _bits);
+				return true;
+			}
+			s = *it;
+			q += indexOffsets()[e];
+			i++;
+		}
+	}
+	for (; i<n; i++) {
+		s += readVarint(q);
+		if (s >= site) {
+			if (s != site) return false;
+			symbol = readSymbol(p, i, _bits);
+			return true;
+		}
+	}
+	return false;
+}
+
+int SitePayload::site(int i) const {
+	const unsigned char* q = bytes() + symbolBytes();
+	int s = 0, j = 0;
+	int e = i/INDEX_STRIDE - 1;
+	if (e >= numIndexed()) e = numIndexed()-1;
+	if (e >= 0) {
+		// Start from the closest indexed site
+		s = indexSites()[e];
+		q += indexOffsets()[e];
+		j = (e+1)*INDEX_STRIDE + 1;
+	}
+	for (; j<=i; j++) s += readVarint(q);
+	return s;
+}
+
+unsigned short SitePayload::symbol(int i) const { return readSymbol(bytes(), i, _bits); }
+
+Fingerprint SitePayload::fingerprintDelta(const int* sites, const unsigned short* prev, int n) const {
+	// All entries of a site carry the same previous symbol, so any one will do
+	std::vector< std::pair<int, unsigned short> > before(n);
+	for (int i=0; i<n; i++) before[i] = std::make_pair(sites[i], prev[i]);
+	std::sort(before.begin(), before.end());
+	
+	Fingerprint f;
+	const unsigned char* p = bytes();
+	const unsigned char* q = p + symbolBytes();
+	int site = 0;
+	for (int i=0, j=0; i<_count; i++) {
+		site += readVarint(q);
+		while (before[j].first < site) j++;
+		unsigned short symbol = readSymbol(p, i, _bits);
+		if (before[j].second == symbol) continue;
+		f ^= siteFingerprint(site, before[j].second);
+		f ^= siteFingerprint(site, symbol);
+	}
+	return f;
+}
@@ -0,0 +1,91 @@
+/*
+ *  SitePayload.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef SITE_PAYLOAD_
+#define SITE_PAYLOAD_
+
+#include "Util/Fingerprint.h"
+
+namespace GPPG {
+
+	/** SitePayload is a compact, immutable list of (site, symbol) changes.
+	 * Sites are kept sorted and unique (when a site is given more than once, the last symbol wins).
+	 * The encoding is: the symbols bit-packed with the fewest bits that hold the largest symbol,
+	 * followed by the sites delta-encoded as varints.  Small payloads (a few sites) are stored inline,
+	 * so a point change costs no allocation beyond its Operation.  Payloads of more sites than
+	 * INDEX_STRIDE also keep every INDEX_STRIDE'th site with its position in the varints, so find() and
+	 * site() search them before they decode at most INDEX_STRIDE varints.
+	 */
+	class SitePayload {
+	public:
+		SitePayload();
+
+		/** Builds the payload from \param n sites and their symbols, in any order.
+		 */
+		SitePayload(const int* sites, const unsigned short* symbols, int n);
+
+		SitePayload(SitePayload const& p);
+
+		~SitePayload();
+
+		SitePayload& operator=(SitePayload const& p);
+
+		/** Number of (unique) sites.
+		 */
+		int size() const;
+
+		/** Encoded size in bytes, with the index (excluding the object itself).
+		 */
+		int encodedSize() const;
+
+		/** Decodes the sites and the symbols into \param sites and \param symbols (either may be NULL).
+		 * Both arrays must hold size() items; sites are returned in increasing order.
+		 */
+		void decode(int* sites, unsigned short* symbols) const;
+
+		/** Looks up \param site; returns true and sets \param symbol if it is in the payload.
+		 */
+		bool find(int site, unsigned short& symbol) const;
+
+		/** Retrieves the \param i'th site and symbol (in site order).
+		 * This decodes the payload up to \param i, so prefer decode() for full scans.
+		 */
+		int site(int i) const;
+		unsigned short symbol(int i) const;
+
+		/** Returns the fingerprint change of moving the sites from \param prev to the payload's symbols.
+		 * \param sites and \param prev (\param n items) are given as at construction.
+		 */
+		Fingerprint fingerprintDelta(const int* sites, const unsigned short* prev, int n) const;
+
+	private:
+		enum { INLINE_BYTES = 16, INDEX_STRIDE = 16 };
+
+		const unsigned char* bytes() const;
+		
+		/** The index: the site at each multiple of INDEX_STRIDE (from INDEX_STRIDE on), and the offset of the
+		 * varint following it from the start of the sites.
+		 */
+		int numIndexed() const;
+		const int* indexSites() const;
+		const int* indexOffsets() const;
+
+		unsigned char* allocate(int size);
+		void release();
+		int symbolBytes() const;
+
+		unsigned int _count : 24;	/* Number of sites */
+		unsigned int _bits : 8;		/* Bits per symbol */
+		int _size;					/* Encoded bytes */
+		union {
+			unsigned char _inline[INLINE_BYTES];
+			unsigned char* _heap;
+		};
+	};
+}
+#endif
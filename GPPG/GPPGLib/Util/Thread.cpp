@@ -0,0 +1,271 @@
+/*
+ *  Thread.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "Thread.h"
+#include "Numa.h"
+#include <new>
+#include <stdexcept>
+#include <unistd.h>
+
+using namespace GPPG;
+
+Mutex::Mutex() {
+#ifdef USE_THREADS
+	pthread_mutex_init(&_mutex, 0);
+#endif
+}
+
+Mutex::~Mutex() {
+#ifdef USE_THREADS
+	pthread_mutex_destroy(&_mutex);
+#endif
+}
+
+void Mutex::lock() {
+#ifdef USE_THREADS
+	pthread_mutex_lock(&_mutex);
+#endif
+}
+
+void Mutex::unlock() {
+#ifdef USE_THREADS
+	pthread_mutex_unlock(&_mutex);
+#endif
+}
+
+Condition::Condition() {
+#ifdef USE_THREADS
+	pthread_cond_init(&_cond, 0);
+#endif
+}
+
+Condition::~Condition() {
+#ifdef USE_THREADS
+	pthread_cond_destroy(&_cond);
+#endif
+}
+
+void Condition::wait(Mutex& m) {
+#ifdef USE_THREADS
+	pthread_cond_wait(&_cond, &m._mutex);
+#endif
+}
+
+void Condition::signal() {
+#ifdef USE_THREADS
+	pthread_cond_signal(&_cond);
+#endif
+}
+
+void Condition::broadcast() {
+#ifdef USE_THREADS
+	pthread_cond_broadcast(&_cond);
+#endif
+}
+
+#ifdef USE_THREADS
+static void* threadMain(void* r) {
+	((Runnable*)r)->run();
+	return 0;
+}
+#endif
+
+Thread::Thread() : _started(false) {}
+
+Thread::~Thread() {
+	join();
+}
+
+void Thread::start(Runnable* r) {
+	if (_started) throw "Thread already started";
+#ifdef USE_THREADS
+	if (pthread_create(&_thread, 0, threadMain, r) != 0) throw "Unable to start thread";
+	_started = true;
+#else
+	r->run();
+#endif
+}
+
+void Thread::join() {
+#ifdef USE_THREADS
+	if (_started) pthread_join(_thread, 0);
+#endif
+	_started = false;
+}
+
+bool Thread::started() const { return _started; }
+
+int Thread::hardwareThreads() {
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0) ? (int)n : 1;
+}
+
+/* A pool thread; waits for each round of work and helps finish it */
+class ThreadPool::Worker : public Runnable {
+public:
+	Worker(ThreadPool* pool, int id, long round, int node) : _pool(pool), _id(id), _seen(round), _node(node) {}
+
+	void run() {
+		if (_node >= 0) numaPinThread( _node );
+		while (true) {
+			_pool->_mutex.lock();
+			while (_pool->_round == _seen && !_pool->_stopping)
+				_pool->_start.wait( _pool->_mutex );
+			if (_pool->_stopping) {
+				_pool->_mutex.unlock();
+				return;
+			}
+			_seen = _pool->_round;
+			_pool->_mutex.unlock();
+
+			_pool->work( _id );
+
+			_pool->_mutex.lock();
+			if (--_pool->_busy == 0) _pool->_done.signal();
+			_pool->_mutex.unlock();
+		}
+	}
+
+private:
+	ThreadPool* _pool;
+	int _id;
+	long _seen;
+	int _node;
+};
+
+ThreadPool& ThreadPool::instance() {
+	static ThreadPool pool;
+	return pool;
+}
+
+ThreadPool::ThreadPool() : _task(0), _threads(1), _n(0), _grain(1), _next(0), _busy(0), _node(NO_NODE), _failed(0), _round(0), _stopping(false), _thrown(NOTHING) {}
+
+ThreadPool::~ThreadPool() {
+	stop();
+}
+
+void ThreadPool::setThreads(int n) {
+	if (n <= 0) n = Thread::hardwareThreads();
+#ifndef USE_THREADS
+	n = 1;
+#endif
+	stop();
+	_threads = n;
+	for (int i=1; i<n; i++) {
+		int node = (_node == ALL_NODES) ? i % numaNodes() : _node;
+		Worker* w = new Worker(this, i, _round, node);
+		Thread* t = new Thread();
+		_runners.push_back( w );
+		_workers.push_back( t );
+		t->start( w );
+	}
+}
+
+int ThreadPool::threads() const { return _threads; }
+
+void ThreadPool::setNode(int node) {
+	_node = node;
+	if (_workers.size() > 0) setThreads( _threads );
+}
+
+int ThreadPool::node() const { return _node; }
+
+void ThreadPool::stop() {
+	_mutex.lock();
+	_stopping = true;
+	_start.broadcast();
+	_mutex.unlock();
+	for (int i=0; i<(int)_workers.size(); i++) {
+		_workers[i]->join();
+		delete _workers[i];
+		delete _runners[i];
+	}
+	_workers.clear();
+	_runners.clear();
+	_stopping = false;
+	_threads = 1;
+}
+
+void ThreadPool::parallelFor(int n, ParallelTask& task, int grain) {
+	if (n <= 0) return;
+	if (grain < 1) grain = 1;
+	if (_workers.size() == 0 || n <= grain) {
+		task.run(0, n, 0);
+		return;
+	}
+
+	// A few chunks per thread balances the load without much contention on _next
+	int chunk = n / (8*_threads);
+	if (chunk < grain) chunk = grain;
+
+	_mutex.lock();
+	if (_task) {
+		// The workers are taken by the running round, which may be waiting for this very call
+		_mutex.unlock();
+		task.run(0, n, 0);
+		return;
+	}
+	_task = &task;
+	_n = n;
+	_grain = chunk;
+	_next = 0;
+	_busy = _workers.size();
+	_failed = 0;
+	_thrown = NOTHING;
+	_round++;
+	_start.broadcast();
+	_mutex.unlock();
+
+	work(0);
+
+	_mutex.lock();
+	while (_busy > 0) _done.wait( _mutex );
+	_task = 0;
+	Thrown thrown = _thrown;
+	_mutex.unlock();
+
+	switch (thrown) {
+		case NOTHING:
+			return;
+		case MESSAGE:
+			_message = _error;
+			throw _message.c_str();
+		case BAD_ALLOC:
+			throw std::bad_alloc();
+		case EXCEPTION:
+			throw std::runtime_error( _error );
+	}
+}
+
+void ThreadPool::work(int thread) {
+	try {
+		while (atomicAdd( &_failed, 0 ) == 0) {
+			int end = atomicAdd( &_next, _grain );
+			int begin = end - _grain;
+			if (begin >= _n) return;
+			if (end > _n) end = _n;
+			_task->run(begin, end, thread);
+		}
+	} catch (const char* e) {
+		fail( MESSAGE, e );
+	} catch (const std::bad_alloc&) {
+		fail( BAD_ALLOC, "" );
+	} catch (const std::exception& e) {
+		fail( EXCEPTION, e.what() );
+	} catch (...) {
+		fail( MESSAGE, "ThreadPool: a task threw an unknown exception" );
+	}
+}
+
+void ThreadPool::fail(Thrown kind, const char* what) {
+	atomicAdd( &_failed, 1 );
+	ScopedLock lock( _mutex );
+	if (_thrown != NOTHING) return;
+	_thrown = kind;
+	_error = what;
+}
@@ -0,0 +1,217 @@
+/*
+ *  Thread.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef THREAD_
+#define THREAD_
+
+#include "GPPG.h"
+#include <string>
+#include <vector>
+
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif
+
+/** Gives each thread its own instance of a static variable (a plain static without thread support).
+ */
+#ifdef USE_THREADS
+#define THREAD_LOCAL __thread
+#else
+#define THREAD_LOCAL
+#endif
+
+namespace GPPG {
+
+	/** Atomically sets \param *p to \param v if it equals \param expected; returns true if it did.
+	 */
+	template <typename T> inline bool atomicCompareAndSwap(T* p, T expected, T v) {
+#ifdef USE_THREADS
+		return __sync_bool_compare_and_swap(p, expected, v);
+#else
+		if (*p != expected) return false;
+		*p = v;
+		return true;
+#endif
+	}
+
+	/** Atomically adds \param v to \param *p and returns the new value.
+	 */
+	template <typename T> inline T atomicAdd(T* p, T v) {
+#ifdef USE_THREADS
+		return __sync_add_and_fetch(p, v);
+#else
+		return *p += v;
+#endif
+	}
+
+	/** A mutual exclusion lock.  Without thread support (USE_THREADS), it does nothing.
+	 */
+	class Mutex {
+	public:
+		Mutex();
+		~Mutex();
+		void lock();
+		void unlock();
+
+	private:
+		Mutex(Mutex const&);
+		Mutex& operator=(Mutex const&);
+		friend class Condition;
+#ifdef USE_THREADS
+		pthread_mutex_t _mutex;
+#endif
+	};
+
+	/** Holds a Mutex for the lifetime of the object.
+	 */
+	class ScopedLock {
+	public:
+		ScopedLock(Mutex& m) : _mutex(m) { _mutex.lock(); }
+		~ScopedLock() { _mutex.unlock(); }
+
+	private:
+		ScopedLock(ScopedLock const&);
+		ScopedLock& operator=(ScopedLock const&);
+		Mutex& _mutex;
+	};
+
+	/** A condition variable, used with a locked Mutex.
+	 */
+	class Condition {
+	public:
+		Condition();
+		~Condition();
+		void wait(Mutex& m);
+		void signal();
+		void broadcast();
+
+	private:
+		Condition(Condition const&);
+		Condition& operator=(Condition const&);
+#ifdef USE_THREADS
+		pthread_cond_t _cond;
+#endif
+	};
+
+	class Runnable {
+	public:
+		virtual ~Runnable() {}
+		virtual void run() = 0;
+	};
+
+	/** A thread of execution running a Runnable.
+	 * Without thread support, start() runs the Runnable to completion before returning.
+	 */
+	class Thread {
+	public:
+		Thread();
+
+		/** Joins the thread if it is still running.
+		 */
+		~Thread();
+
+		/** Runs \param r (owned by the caller) on this thread.
+		 */
+		void start(Runnable* r);
+
+		/** Waits for the Runnable to finish.
+		 */
+		void join();
+
+		bool started() const;
+
+		/** Number of hardware threads available to the process.
+		 */
+		static int hardwareThreads();
+
+	private:
+		Thread(Thread const&);
+		Thread& operator=(Thread const&);
+#ifdef USE_THREADS
+		pthread_t _thread;
+#endif
+		bool _started;
+	};
+
+	/** Work that can be split into ranges of independent items.
+	 */
+	class ParallelTask {
+	public:
+		virtual ~ParallelTask() {}
+
+		/** Processes the items [\param begin, \param end) on worker \param thread (0 is the caller).
+		 */
+		virtual void run(int begin, int end, int thread) = 0;
+	};
+
+	/** ThreadPool keeps a set of worker threads for data-parallel loops.
+	 * The calling thread takes part in the work, so a pool of one thread (the default) runs everything
+	 * on the caller, in order.  Workers may be pinned to NUMA nodes, so the buffers they allocate under
+	 * the BufferPool's local placement stay next to them.
+	 */
+	class ThreadPool {
+	public:
+		enum { NO_NODE = -2, ALL_NODES = -1 };
+
+		/** Retrieves the process-wide pool.
+		 */
+		static ThreadPool& instance();
+
+		ThreadPool();
+
+		~ThreadPool();
+
+		/** Sets the number of threads, including the caller; 0 uses all hardware threads.
+		 */
+		void setThreads(int n);
+		int threads() const;
+
+		/** Pins the workers to the CPUs of NUMA node \param node, or round-robin over all nodes for ALL_NODES
+		 * (NO_NODE, the default, leaves them unpinned).  Running workers are restarted.
+		 */
+		void setNode(int node);
+		int node() const;
+
+		/** Runs \param task over the items [0, \param n) in chunks of at least \param grain items
+		 * and returns when all of them are done.  A call made while another one is running, from one of its
+		 * tasks or from another thread, runs all of its items on the calling thread.
+		 * If a task throws, the chunks not started yet are skipped and, once the other threads are done,
+		 * the first error is thrown again on the caller: a message (const char*, valid until the next error
+		 * of the pool), std::bad_alloc, or std::runtime_error with the what() of any other std::exception.
+		 */
+		void parallelFor(int n, ParallelTask& task, int grain = 1);
+
+	private:
+		ThreadPool(ThreadPool const&);
+		ThreadPool& operator=(ThreadPool const&);
+
+		class Worker;
+		friend class Worker;
+
+		enum Thrown { NOTHING, MESSAGE, BAD_ALLOC, EXCEPTION };
+
+		void stop();
+		void work(int thread);
+
+		/** Records the error a task threw, unless an earlier one was, and stops the round.
+		 */
+		void fail(Thrown kind, const char* what);
+
+		std::vector<Thread*> _workers;
+		std::vector<Worker*> _runners;
+		Mutex _mutex;
+		Condition _start, _done;
+		ParallelTask* _task;
+		int _threads, _n, _grain, _next, _busy, _node, _failed;
+		long _round;
+		bool _stopping;
+		Thrown _thrown;
+		std::string _error, _message;	/* The error of the round, and the last one thrown */
+	};
+}
+#endif
@@ -7,6 +7,8 @@
 #include	<stdlib.h>
 #include	<time.h>
 
+#include	"Util/Thread.h"
+
 /* ******************************************************************************************* */
 
 extern "C" {
@@ -28,9 +30,10 @@ extern long ignbin(long n,double pp);
 #define boolean int
 
 
-static double u[98], c, cd, cm;
-static int i97, j97;
-static boolean test = BFALSE;
+/* Each thread draws from a generator of its own */
+static THREAD_LOCAL double u[98], c, cd, cm;
+static THREAD_LOCAL int i97, j97;
+static THREAD_LOCAL boolean test = BFALSE;
 
 int seed_state() {
 	if(test==BFALSE) { return 0; }
@@ -253,10 +256,10 @@ long ignbin(long n,double pp)
  */
 
 {
-	static float psave = -1.0;
-	static long nsave = -1;
-	static long ignbin,i,ix,ix1,k,m,mp,T1;
-	static double al,alv,amaxp,c,f,f1,f2,ffm,fm,g,p,p1,p2,p3,p4,q,qn,r,u,v,w,w2,x,x1,
+	static THREAD_LOCAL float psave = -1.0;
+	static THREAD_LOCAL long nsave = -1;
+	static THREAD_LOCAL long ignbin,i,ix,ix1,k,m,mp,T1;
+	static THREAD_LOCAL double al,alv,amaxp,c,f,f1,f2,ffm,fm,g,p,p1,p2,p3,p4,q,qn,r,u,v,w,w2,x,x1,
     x2,xl,xll,xlr,xm,xnp,xnpq,xr,ynorm,z,z2;
 	
     if(pp != psave) goto S10;
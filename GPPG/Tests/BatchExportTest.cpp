@@ -0,0 +1,60 @@
+/*
+ *  BatchExportTest.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "TestUtil.h"
+#include <Operation/BatchEvaluator.h>
+#include <Util/Random.h>
+
+using namespace GPPG;
+using namespace GPPG::Model;
+using namespace GPPG::Tests;
+
+#define LENGTH 1000
+#define OPERATIONS 200
+
+/* Records the texts it is given, and the order they come in */
+class Recorder : public IBatchExporter::Sink {
+public:
+	void write(int i, const std::string& text) {
+		indices.push_back( i );
+		texts.push_back( text );
+	}
+
+	std::vector<int> indices;
+	std::vector<std::string> texts;
+};
+
+/** The texts of a batch come in the order of the targets, whatever order the walk reaches them in, and
+ * match the genotypes exported one by one.
+ */
+static void order() {
+	std::vector<OpSequence*> ops( 1, sequenceRoot( LENGTH ) );
+	growLineages( ops, OPERATIONS );
+
+	// Shuffled, with a few targets listed twice
+	std::vector<IGenotype*> targets( ops.begin(), ops.end() );
+	for (int i=0; i<10; i++) targets.push_back( ops[ (int)(random01()*ops.size()) ] );
+	for (int i=(int)targets.size()-1; i>0; i--) std::swap( targets[i], targets[(int)(random01()*(i+1))] );
+
+	BatchEvaluator<SequenceData, ISequence> batch;
+	Recorder recorder;
+	batch.exportBatch( targets, recorder );
+	CHECK( recorder.indices.size() == targets.size() );
+	for (int i=0; i<(int)recorder.indices.size(); i++) {
+		CHECK( recorder.indices[i] == i );
+		CHECK( recorder.texts[i] == targets[i]->exportFormat() );
+	}
+	CHECK( batch.numReplayed() < (long)targets.size() );
+}
+
+int main() {
+	initRandom2( 4129, 2281 );
+	order();
+
+	return failures > 0;
+}
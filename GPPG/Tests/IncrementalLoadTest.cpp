@@ -0,0 +1,226 @@
+/*
+ *  IncrementalLoadTest.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "TestUtil.h"
+#include <Operation/IncrementalLoad.h>
+#include <Util/CostModel.h>
+
+using namespace GPPG;
+using namespace GPPG::Model;
+using namespace GPPG::Tests;
+
+/* The placement is capped low enough that the split order matters */
+#define K 3
+
+/** The same ancestry in two graphs: root - a - b (- c), a - d - e (- f).  In the first, c and d are
+ * active genotypes read and then removed; the second never has c and never reads d.
+ */
+struct Population {
+	OpSequence *root, *a, *b, *c, *d, *e, *f;
+	std::vector<IOperation*> active;
+};
+
+static void build(OperationGraph& graph, Population& p, bool withRemoved) {
+	p.root = sequenceRoot( 200 );
+	addGenotype( graph, p.root, false );
+	p.a = pointChange( *p.root, 2 );
+	addGenotype( graph, p.a, false );
+	p.b = pointChange( *p.a, 3 );
+	addGenotype( graph, p.b, true );
+	p.d = pointChange( *p.a, 5 );
+	addGenotype( graph, p.d, withRemoved );
+	p.e = pointChange( *p.d, 7 );
+	addGenotype( graph, p.e, true );
+	p.c = 0;
+	if (withRemoved) {
+		p.c = pointChange( *p.b, 6 );
+		addGenotype( graph, p.c, true );
+	}
+	p.active.push_back( p.b );
+	p.active.push_back( p.e );
+	if (withRemoved) {
+		p.active.push_back( p.c );
+		p.active.push_back( p.d );
+	}
+}
+
+static void removeGenotype(OperationGraph& graph, Population& p, OpSequence* op) {
+	op->setFrequency( 0 );
+	op->setIndex( -1 );
+	graph.removeOperation( op );
+	for (int i=0; i<(int)p.active.size(); i++) {
+		if (p.active[i] == op) p.active.erase( p.active.begin() + i );
+	}
+}
+
+/** root - a - b, a - d - e, and x recombining b and d; x is read and then removed, which a graph that
+ * never had x must match.  Reading x replays a once through each of its parents.
+ */
+static void recombinant() {
+	IncrementalLoad* repaired = new IncrementalLoad( 1, 1000, 16 );
+	IncrementalLoad* recomputed = new IncrementalLoad( 1, 0, 16 );
+	OperationGraph incremental( repaired ), full( recomputed );
+	OpSequence* ops[2][5];
+	OpSequence* x = 0;
+	std::vector<IOperation*> active[2];
+	for (int g=0; g<2; g++) {
+		OperationGraph& graph = (g == 0) ? incremental : full;
+		OpSequence** o = ops[g];
+		o[0] = sequenceRoot( 200 );
+		addGenotype( graph, o[0], false );
+		o[1] = pointChange( *o[0], 2 );
+		addGenotype( graph, o[1], false );
+		o[2] = pointChange( *o[1], 3 );
+		addGenotype( graph, o[2], true );
+		o[3] = pointChange( *o[1], 5 );
+		addGenotype( graph, o[3], false );
+		o[4] = pointChange( *o[3], 7 );
+		addGenotype( graph, o[4], true );
+		active[g].push_back( o[2] );
+		active[g].push_back( o[4] );
+		finishGeneration( graph, active[g] );
+	}
+	std::vector<int> locs( 1, 100 );
+	x = new SequenceCrossover( *ops[0][2], *ops[0][3], locs );
+	addGenotype( incremental, x, true );
+
+	read( x, 3 );
+	int reads[5] = { 0, 0, 2, 0, 1 };
+	for (int g=0; g<2; g++)
+		for (int i=0; i<5; i++) read( ops[g][i], reads[i] );
+
+	x->setFrequency( 0 );
+	x->setIndex( -1 );
+	incremental.removeOperation( x );
+
+	// Both parents and the ancestor they share give back exactly the reads made through x
+	for (int i=0; i<5; i++) CHECK( ops[0][i]->requests() == ops[1][i]->requests() );
+	CHECK( ops[0][1]->requests() > 0 );
+}
+
+/** Times \param samples calls of class \param c at \param ticks each, as the operations' timers would.
+ */
+static void calibrate(int c, int samples, unsigned long long ticks) {
+	for (int i=0; i<samples; i++) CostModel::instance().record( c, ticks );
+}
+
+/** root - a - b - c, a - d - e under calibration: the reads are counted at the configured costs, and c is
+ * removed once the costs have changed; what it gives back must still be exactly the reads it made.
+ */
+static void calibrated() {
+	CostModel& model = CostModel::instance();
+	int cheap = model.addClass( 2 ), dear = model.addClass( 5 );
+	IncrementalLoad* repaired = new IncrementalLoad( 1, 1000, 16 );
+	IncrementalLoad* recomputed = new IncrementalLoad( 1, 0, 16 );
+	OperationGraph incremental( repaired ), full( recomputed );
+	OpSequence* ops[2][6];
+	std::vector<IOperation*> active[2];
+	for (int g=0; g<2; g++) {
+		OperationGraph& graph = (g == 0) ? incremental : full;
+		OpSequence** o = ops[g];
+		o[0] = sequenceRoot( 200 );
+		addGenotype( graph, o[0], false );
+		o[1] = pointChange( *o[0], 2 );
+		o[2] = pointChange( *o[1], 3 );
+		o[3] = pointChange( *o[1], 5 );
+		o[4] = pointChange( *o[3], 7 );
+		o[5] = (g == 0) ? pointChange( *o[2], 6 ) : 0;
+		int classes[6] = { -1, cheap, dear, cheap, dear, dear };
+		for (int i=1; i<6; i++) {
+			if (!o[i]) continue;
+			o[i]->setCostClass( classes[i] );
+			addGenotype( graph, o[i], i == 2 || i == 4 || i == 5 );
+		}
+		active[g].push_back( o[2] );
+		active[g].push_back( o[4] );
+		finishGeneration( graph, active[g] );
+	}
+
+	model.setSampling( 1 );
+	read( ops[0][5], 3 );
+	int reads[5] = { 0, 0, 2, 0, 1 };
+	for (int g=0; g<2; g++)
+		for (int i=0; i<5; i++) read( ops[g][i], reads[i] );
+
+	// The indel-priced class turns out as cheap as the point changes; the many made-up samples drown
+	// the few the reads above timed
+	calibrate( cheap, 200000, 1000 );
+	calibrate( dear, 100000, 1600 );
+	model.update();
+	CHECK( model.cost( cheap ) == 2 );
+	CHECK( model.cost( dear ) == 3 );
+
+	OpSequence* c = ops[0][5];
+	c->setFrequency( 0 );
+	c->setIndex( -1 );
+	incremental.removeOperation( c );
+	model.setSampling( 0 );
+
+	for (int i=0; i<5; i++) {
+		CHECK( ops[0][i]->requests() == ops[1][i]->requests() );
+		CHECK( ops[0][i]->reads() == ops[1][i]->reads() );
+	}
+	CHECK( ops[0][2]->reads() > 0 );
+}
+
+int main() {
+	// The reference recomputes the placement at every generation
+	IncrementalLoad* repaired = new IncrementalLoad( 1, 1000, 16 );
+	IncrementalLoad* recomputed = new IncrementalLoad( 1, 0, 16 );
+	OperationGraph incremental( repaired ), full( recomputed );
+	Population pi, pf;
+	build( incremental, pi, true );
+	build( full, pf, false );
+
+	// Both start from the root alone
+	finishGeneration( incremental, pi.active );
+	finishGeneration( full, pf.active );
+	repaired->setMaxUncompressed( K );
+	recomputed->setMaxUncompressed( K );
+
+	// A genotype added between runs
+	pi.f = pointChange( *pi.e, 4 );
+	addGenotype( incremental, pi.f, true );
+	pi.active.push_back( pi.f );
+	pf.f = pointChange( *pf.e, 4 );
+	addGenotype( full, pf.f, true );
+	pf.active.push_back( pf.f );
+
+	read( pi.c, 3 );
+	read( pi.d, 2 );
+	OpSequence* survivors[2][3] = { { pi.b, pi.e, pi.f }, { pf.b, pf.e, pf.f } };
+	int reads[3] = { 2, 1, 2 };
+	for (int g=0; g<2; g++)
+		for (int i=0; i<3; i++) read( survivors[g][i], reads[i] );
+
+	// c leaves the graph, d stays as the ancestor of e
+	removeGenotype( incremental, pi, pi.c );
+	removeGenotype( incremental, pi, pi.d );
+
+	// The loads are those of the survivors' reads alone
+	OpSequence* ops[2][6] = { { pi.root, pi.a, pi.b, pi.d, pi.e, pi.f }, { pf.root, pf.a, pf.b, pf.d, pf.e, pf.f } };
+	for (int i=0; i<6; i++) CHECK( ops[0][i]->requests() == ops[1][i]->requests() );
+	CHECK( pi.a->requests() > 0 );
+
+	// The repair places the genotypes as a full run does
+	finishGeneration( incremental, pi.active );
+	finishGeneration( full, pf.active );
+	CHECK( repaired->numRepairs() == 1 );
+	CHECK( recomputed->numRepairs() == 0 );
+	int uncompressed = 0;
+	for (int i=0; i<6; i++) {
+		CHECK( ops[0][i]->isCompressed() == ops[1][i]->isCompressed() );
+		if (!ops[1][i]->isCompressed()) uncompressed++;
+	}
+	CHECK( uncompressed > 1 );
+
+	recombinant();
+	calibrated();
+
+	return failures > 0;
+}
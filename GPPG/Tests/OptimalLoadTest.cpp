@@ -0,0 +1,127 @@
+/*
+ *  OptimalLoadTest.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "TestUtil.h"
+#include <Operation/OptimalLoad.h>
+#include <cmath>
+
+using namespace GPPG;
+using namespace GPPG::Model;
+using namespace GPPG::Tests;
+
+/* A small tree, by parent: the point changes' costs and the active genotypes' frequencies (0 if inactive) */
+#define NUM_NODES 11
+static const int PARENT[NUM_NODES] =    { -1, 0,   1,   2,   2,   1,   5,    0,   7,   0,    3 };
+static const int COST[NUM_NODES] =      { 0,  2,   3,   4,   1,   5,   2,    6,   3,   1,    2 };
+static const double FREQ[NUM_NODES] =   { 0,  0,   0.1, 0.3, 0.2, 0.1, 0.25, 0,   0.15, 0.05, 0.05 };
+
+struct Population {
+	std::vector<OpSequence*> ops;
+	std::set<IOperation*> active;
+};
+
+static void build(OperationGraph& graph, Population& p) {
+	for (int i=0; i<NUM_NODES; i++) {
+		OpSequence* op = (i == 0) ? sequenceRoot( 200 ) : pointChange( *p.ops[ PARENT[i] ], COST[i] );
+		addGenotype( graph, op, FREQ[i] > 0 );
+		if (FREQ[i] > 0) {
+			op->setFrequency( FREQ[i] );
+			p.active.insert( op );
+		}
+		p.ops.push_back( op );
+	}
+}
+
+static std::set<IOperation*> uncompressed(const Population& p) {
+	std::set<IOperation*> U;
+	for (int i=0; i<(int)p.ops.size(); i++)
+		if (!p.ops[i]->isCompressed()) U.insert( p.ops[i] );
+	return U;
+}
+
+/** The least placementCost() over the sets of at most \param budget of \param candidates, added to \param fixed.
+ */
+static double exhaustive(const OptimalLoad& policy, const std::set<IOperation*>& active, const std::vector<IOperation*>& candidates,
+	const std::set<IOperation*>& fixed, int budget) {
+	double best = -1;
+	for (long mask=0; mask < (1L << candidates.size()); mask++) {
+		std::set<IOperation*> U = fixed;
+		for (int i=0; i<(int)candidates.size(); i++)
+			if (mask & (1L << i)) U.insert( candidates[i] );
+		if ((int)(U.size() - fixed.size()) > budget) continue;
+		double c = policy.placementCost( active, U );
+		if (best < 0 || c < best) best = c;
+	}
+	return best;
+}
+
+static bool near(double a, double b) {
+	return std::fabs( a - b ) <= 1e-9 * (1 + std::fabs( b ));
+}
+
+int main() {
+	for (int k=1; k<=5; k++) {
+		// The program against every placement of k-1 genotypes besides the root
+		OptimalLoad* policy = new OptimalLoad( k, 0 );
+		OperationGraph graph( policy );
+		Population p;
+		build( graph, p );
+		finishGeneration( graph, std::vector<IOperation*>( p.active.begin(), p.active.end() ) );
+
+		CHECK( policy->numSolved() == 1 );
+		std::set<IOperation*> U = uncompressed( p );
+		CHECK( (int)U.size() <= k && U.count( p.ops[0] ) > 0 );
+		std::set<IOperation*> root( p.ops.begin(), p.ops.begin()+1 );
+		std::vector<IOperation*> candidates( p.ops.begin()+1, p.ops.end() );
+		CHECK( near( policy->placementCost( p.active, U ), exhaustive( *policy, p.active, candidates, root, k-1 ) ) );
+	}
+
+	int recombinantsKept = 0;
+	for (int k=2; k<=8; k++) {
+		// A recombinant of two branches, with a child: the rest of the tree is still placed optimally
+		OptimalLoad* policy = new OptimalLoad( k, 0 );
+		OperationGraph graph( policy );
+		Population p;
+		build( graph, p );
+		std::vector<int> locs( 1, 100 );
+		OpSequence* x = new SequenceCrossover( *p.ops[3], *p.ops[6], locs );
+		addGenotype( graph, x, true );
+		x->setFrequency( 0.3 );
+		OpSequence* y = pointChange( *x, 2 );
+		addGenotype( graph, y, true );
+		y->setFrequency( 0.2 );
+		p.active.insert( x );
+		p.active.insert( y );
+		read( x, 4 );
+		read( y, 6 );
+		finishGeneration( graph, std::vector<IOperation*>( p.active.begin(), p.active.end() ) );
+
+		CHECK( policy->numMixed() == 1 && policy->numFallbacks() == 0 );
+		std::set<IOperation*> U = uncompressed( p );
+		if (!x->isCompressed()) U.insert( x );
+		if (!y->isCompressed()) U.insert( y );
+		CHECK( (int)U.size() <= k && U.count( p.ops[0] ) > 0 );
+
+		std::set<IOperation*> kept;
+		kept.insert( p.ops[0] );
+		int budget = k-1;
+		for (std::set<IOperation*>::iterator it=U.begin(); it!=U.end(); it++) {
+			if (*it == x || *it == y) {
+				kept.insert( *it );
+				budget--;
+				recombinantsKept++;
+			}
+		}
+		std::vector<IOperation*> candidates( p.ops.begin()+1, p.ops.end() );
+		CHECK( near( policy->placementCost( p.active, U ), exhaustive( *policy, p.active, candidates, kept, budget ) ) );
+	}
+	// The larger budgets reach the recombinants
+	CHECK( recombinantsKept > 0 );
+
+	return failures > 0;
+}
@@ -0,0 +1,73 @@
+/*
+ *  ParallelOffspringTest.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "TestUtil.h"
+#include <Operation/GreedyLoad.h>
+#include <Simulator/EvoSimulator.h>
+#include <Util/Random.h>
+#include <Util/Thread.h>
+#include <map>
+#include <string>
+
+using namespace GPPG;
+using namespace GPPG::Model;
+using namespace GPPG::Tests;
+
+/* Population and generations; the population spans many blocks of offspring */
+#define N 300
+#define GENERATIONS 12
+
+struct Population {
+	std::map<std::string, double> genomes;
+	int active;
+	long merged;
+};
+
+/** Evolves a population from a seeded run on \param threads threads, breeding the offspring in parallel,
+ * and records the genomes it ends up with in \param p.
+ */
+static void evolve(int threads, Population& p) {
+	ThreadPool::instance().setThreads( threads );
+	OperationGraph* graph = new OperationGraph( new GreedyLoad( 10, 2 ) );
+	EvoSimulator* sim = new EvoSimulator( graph );
+	sim->setParallelOffspring( true );
+	initRandom2( 2203, 4517 );
+
+	// Mutators are applied in the order of their addresses, which differ between runs, so there is one
+	sim->addMutator( new SequencePointMutator( 1, 1e-3, std::vector<double>(16, 0.25) ) );
+	sim->addRecombinator( new SequenceRecombinator( 100, 1e-3 ) );
+	sim->addGenotype( sequenceRoot( 500 ), 1.0 );
+	sim->evolve( N, GENERATIONS );
+
+	const std::set<IGenotype*>& active = sim->activeGenotypes();
+	for (std::set<IGenotype*>::const_iterator it=active.begin(); it!=active.end(); it++)
+		p.genomes[ (*it)->exportFormat() ] += (*it)->frequency();
+	p.active = sim->activeCount();
+	p.merged = sim->mergedCount();
+
+	delete sim;
+	graph->reclaim();
+	delete graph;
+	ThreadPool::instance().setThreads( 1 );
+}
+
+int main() {
+	// The blocks of offspring go to whichever thread asks first, yet each draws from its own stream
+	Population runs[3];
+	evolve( 4, runs[0] );
+	evolve( 4, runs[1] );
+	evolve( 1, runs[2] );
+	CHECK( runs[0].active > 1 );
+	for (int i=1; i<3; i++) {
+		CHECK( runs[i].genomes == runs[0].genomes );
+		CHECK( runs[i].active == runs[0].active );
+		CHECK( runs[i].merged == runs[0].merged );
+	}
+
+	return failures > 0;
+}
@@ -0,0 +1,124 @@
+/*
+ *  PipelineTest.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "TestUtil.h"
+#include <Operation/GreedyLoad.h>
+#include <Simulator/EvoSimulator.h>
+#include <Simulator/SnapshotExporter.h>
+#include <Util/Random.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+
+using namespace GPPG;
+using namespace GPPG::Model;
+using namespace GPPG::Tests;
+
+#define SNAPSHOT "PipelineTest.snapshot"
+
+/* Population, steps and generations per step; a snapshot is taken after each step */
+#define N 200
+#define STEPS 4
+#define GENERATIONS 5
+
+struct Outcome {
+	int active, operations, reachable, retained;
+	long exports;
+	bool snapshotMatches;
+};
+
+/** Number of operations the active genotypes of \param sim replay from, themselves included: what a
+ * serial collection leaves in the graph.
+ */
+static int reachable(EvoSimulator* sim) {
+	std::set<IOperation*> seen;
+	const std::set<IGenotype*>& active = sim->activeGenotypes();
+	std::vector<IOperation*> pending;
+	for (std::set<IGenotype*>::const_iterator it=active.begin(); it!=active.end(); it++) pending.push_back( (IOperation*)*it );
+	while (!pending.empty()) {
+		IOperation* op = pending.back();
+		pending.pop_back();
+		if (!seen.insert( op ).second) continue;
+		for (int i=0; i<op->numParents(); i++) pending.push_back( op->parent(i) );
+	}
+	return seen.size();
+}
+
+/** True if the last snapshot holds the genomes of the active genotypes of \param sim.
+ */
+static bool snapshotMatches(EvoSimulator* sim) {
+	std::map<int, std::string> genomes;
+	const std::set<IGenotype*>& active = sim->activeGenotypes();
+	for (std::set<IGenotype*>::const_iterator it=active.begin(); it!=active.end(); it++)
+		genomes[ (*it)->key() ] = (*it)->exportFormat();
+
+	std::ifstream in( SNAPSHOT );
+	std::string header, genome, blank;
+	int records = 0;
+	while (std::getline( in, header ) && std::getline( in, genome ) && std::getline( in, blank )) {
+		// >g<i>|<key>|<frequency>|<order>
+		size_t bar = header.find( '|' );
+		if (bar == std::string::npos) return false;
+		int key = atoi( header.c_str() + bar + 1 );
+		if (genomes.count( key ) == 0 || genomes[key] != genome) return false;
+		records++;
+	}
+	return records == (int)genomes.size();
+}
+
+static void evolve(bool pipelined, Outcome& o) {
+	OperationGraph* graph = new OperationGraph( new GreedyLoad( 10, 2 ) );
+	EvoSimulator* sim = new EvoSimulator( graph );
+	sim->setPipelined( pipelined );
+	initRandom2( 1802, 9373 );
+
+	sim->addMutator( new SequencePointMutator( 1, 1e-3, std::vector<double>(16, 0.25) ) );
+	sim->addMutator( new SequenceInsertionMutator( 10, 1e-4, 2, 8, std::vector<double>(4, 0.25) ) );
+	sim->addMutator( new SequenceDeletionMutator( 10, 1e-4, 2, 8 ) );
+	sim->addRecombinator( new SequenceRecombinator( 100, 1e-3 ) );
+	sim->addGenotype( sequenceRoot( 500 ), 1.0 );
+
+	// Each snapshot is written while the next step runs and removes genotypes
+	SnapshotExporter snapshots;
+	for (int i=0; i<STEPS; i++) {
+		sim->evolve( N, GENERATIONS );
+		snapshots.capture( sim, SNAPSHOT );
+	}
+	snapshots.wait();
+	o.exports = snapshots.numExports();
+	o.snapshotMatches = snapshotMatches( sim );
+	o.active = sim->activeCount();
+	o.reachable = reachable( sim );
+
+	// The removal still running is waited for; nothing is pinned after that
+	delete sim;
+	graph->reclaim();
+	o.operations = graph->operations().size();
+	o.retained = graph->numRetained();
+	delete graph;
+	remove( SNAPSHOT );
+}
+
+int main() {
+	// Populations are sampled in the order of the genotypes' addresses, so the runs differ; each is
+	// compared with what a serial collection of its own graph would leave
+	Outcome outcomes[2];
+	for (int i=0; i<2; i++) {
+		evolve( i == 1, outcomes[i] );
+		CHECK( outcomes[i].active > 1 );
+		// Only the active genotypes and their ancestors are left, and none is waiting to be deleted
+		CHECK( outcomes[i].operations == outcomes[i].reachable );
+		CHECK( outcomes[i].retained == 0 );
+		CHECK( outcomes[i].exports == STEPS );
+		CHECK( outcomes[i].snapshotMatches );
+	}
+
+	return failures > 0;
+}
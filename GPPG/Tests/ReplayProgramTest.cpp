@@ -0,0 +1,177 @@
+/*
+ *  ReplayProgramTest.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "TestUtil.h"
+#include <Model/Sequence/ReplayProgram.h>
+#include <Util/Random.h>
+
+using namespace GPPG;
+using namespace GPPG::Model;
+using namespace GPPG::Tests;
+
+#define LENGTH 1000
+#define OPERATIONS 150
+
+/** Returns a change of \param n random sites of \param parent; sites may repeat, the last one listed wins.
+ */
+static OpSequence* pointChanges(OpSequence& parent, int n) {
+	std::vector<int> locs(n);
+	std::vector<STYPE> dest(n), prev(n, 0);
+	for (int i=0; i<n; i++) {
+		locs[i] = (i > 0 && random01() < 0.3) ? locs[i-1] : (int)(random01()*parent.length());
+		dest[i] = (STYPE)(random01()*4);
+	}
+	return new SequencePointChange( parent, &locs[0], n, &dest[0], &prev[0] );
+}
+
+/** Returns a crossover of \param host and \param donor at \param n ascending sites; the result is written
+ * over \param host, so its parents are swapped when \param n is odd.
+ */
+static OpSequence* crossover(OpSequence& host, OpSequence& donor, int n) {
+	int shortest = (host.length() < donor.length()) ? host.length() : donor.length();
+	std::vector<int> locs(n);
+	for (int i=0; i<n; i++) locs[i] = (i+1)*shortest/(n+1);
+	if (n % 2 == 0) return new SequenceCrossover( host, donor, locs );
+	return new SequenceCrossover( donor, host, locs );
+}
+
+/** True if the program compiled for \param op replays \param expected over all of \param length operations.
+ */
+static bool replays(OpSequence* op, int length, const SequenceData& expected) {
+	ReplayProgram* program = ReplayProgram::compile( (OpSequenceBase*)op );
+	if (!program) return false;
+	bool same = program->numOperations() == length && program->isCurrent();
+	SequenceData* sd = program->run();
+	same = same && sameSequence( *sd, expected );
+	delete sd;
+	delete program;
+	return same;
+}
+
+/** Checks the replay of each operation of the chain \param ops (from a root) against its full evaluation.
+ */
+static void checkChain(const std::vector<OpSequence*>& ops) {
+	for (int i=2; i<(int)ops.size(); i++) {
+		SequenceData* full = ops[i]->evaluate();
+		CHECK( replays( ops[i], i, *full ) );
+		delete full;
+	}
+}
+
+/** Point changes replay in place, over the base's own buffer.
+ */
+static void points() {
+	std::vector<OpSequence*> ops( 1, sequenceRoot( LENGTH ) );
+	for (int i=0; i<8; i++) ops.push_back( pointChanges( *ops.back(), 1 + i*5 ) );
+	checkChain( ops );
+	// The parent is materialized, so there is nothing to compile
+	CHECK( ReplayProgram::compile( (OpSequenceBase*)ops[1] ) == NULL );
+}
+
+/** Indels at both ends and in the middle, growing the sequence past the base and shrinking it below.
+ */
+static void indels() {
+	std::vector<OpSequence*> ops( 1, sequenceRoot( LENGTH ) );
+	ops.push_back( insertion( *ops.back(), 0, 30 ) );
+	ops.push_back( pointChanges( *ops.back(), 10 ) );
+	ops.push_back( new SequenceDeletion( *ops.back(), 0, 5 ) );
+	ops.push_back( insertion( *ops.back(), ops.back()->length(), 700 ) );
+	ops.push_back( pointChanges( *ops.back(), 40 ) );
+	ops.push_back( new SequenceDeletion( *ops.back(), 200, 1200 ) );
+	ops.push_back( insertion( *ops.back(), 100, 1 ) );
+	ops.push_back( new SequenceDeletion( *ops.back(), ops.back()->length()-20, 20 ) );
+	ops.push_back( pointChanges( *ops.back(), 25 ) );
+	CHECK( ops.back()->length() < LENGTH );
+	checkChain( ops );
+}
+
+/** Crossovers copy segments from donors that are replayed themselves, whichever parent they write over.
+ */
+static void crossovers() {
+	OpSequence* root = sequenceRoot( LENGTH );
+	std::vector<OpSequence*> donors( 1, root );
+	donors.push_back( pointChanges( *root, 50 ) );
+	donors.push_back( insertion( *donors.back(), 400, 60 ) );
+	donors.push_back( pointChanges( *donors.back(), 50 ) );
+
+	std::vector<OpSequence*> ops( 1, root );
+	ops.push_back( pointChanges( *root, 20 ) );
+	ops.push_back( crossover( *ops.back(), *donors[3], 1 ) );
+	ops.push_back( crossover( *ops.back(), *donors[1], 2 ) );
+	ops.push_back( new SequenceDeletion( *ops.back(), 10, 30 ) );
+	ops.push_back( crossover( *ops.back(), *donors[2], 3 ) );
+	ops.push_back( insertion( *ops.back(), 500, 15 ) );
+	ops.push_back( crossover( *ops.back(), *donors[3], 4 ) );
+	ops.push_back( pointChanges( *ops.back(), 20 ) );
+	checkChain( ops );
+
+	// A donor replays the same once it is materialized
+	SequenceData* full = ops.back()->evaluate();
+	donors[2]->setCompressed( false );
+	CHECK( replays( ops.back(), ops.size()-1, *full ) );
+	donors[2]->setCompressed( true );
+	delete full;
+}
+
+/** Random lineages, replayed directly and through evaluate(); programs stay correct once out of date.
+ */
+static void lineages() {
+	std::vector<OpSequence*> ops( 1, sequenceRoot( LENGTH ) );
+	growLineages( ops, OPERATIONS );
+	std::vector<SequenceData*> full;
+	for (int i=0; i<(int)ops.size(); i++) full.push_back( ops[i]->evaluate() );
+
+	int compiled = 0;
+	for (int i=1; i<(int)ops.size(); i++) {
+		ReplayProgram* program = ReplayProgram::compile( (OpSequenceBase*)ops[i] );
+		if (!program) continue;
+		compiled++;
+		SequenceData* sd = program->run();
+		CHECK( sameSequence( *sd, *full[i] ) );
+		delete sd;
+		delete program;
+	}
+	CHECK( compiled > OPERATIONS/2 );
+
+	// Each evaluation after the first runs the program
+	OpSequenceBase::setReplayPrograms( 1 );
+	for (int k=0; k<3; k++) {
+		for (int i=1; i<(int)ops.size(); i++) {
+			SequenceData* sd = ops[i]->evaluate();
+			CHECK( sameSequence( *sd, *full[i] ) );
+			delete sd;
+		}
+	}
+
+	// Materializing ancestors puts the programs out of date, but not wrong
+	std::vector<ReplayProgram*> programs( ops.size(), (ReplayProgram*)NULL );
+	for (int i=1; i<(int)ops.size(); i++) programs[i] = ReplayProgram::compile( (OpSequenceBase*)ops[i] );
+	for (int i=1; i<(int)ops.size(); i+=4) ops[i]->setCompressed( false );
+	for (int i=1; i<(int)ops.size(); i++) {
+		if (!programs[i]) continue;
+		SequenceData* sd = programs[i]->run();
+		CHECK( sameSequence( *sd, *full[i] ) );
+		delete sd;
+		delete programs[i];
+		sd = ops[i]->evaluate();
+		CHECK( sameSequence( *sd, *full[i] ) );
+		delete sd;
+	}
+	OpSequenceBase::setReplayPrograms( 0 );
+	for (int i=0; i<(int)full.size(); i++) delete full[i];
+}
+
+int main() {
+	initRandom2( 5521, 3187 );
+	points();
+	indels();
+	crossovers();
+	lineages();
+
+	return failures > 0;
+}
@@ -0,0 +1,186 @@
+/*
+ *  SequenceDiffTest.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "TestUtil.h"
+#include <Util/Random.h>
+
+using namespace GPPG;
+using namespace GPPG::Model;
+using namespace GPPG::Tests;
+
+/* Long enough for diffs of a few dozen changes to stay under the size limit */
+#define LENGTH 4000
+#define STEPS 300
+#define OPERATIONS 120
+
+static bool matches(const SequenceDiff& d, const std::vector<STYPE>& expected) {
+	if (d.length() != (int)expected.size()) return false;
+	for (int i=0; i<d.length(); i++)
+		if (d.get(i) != expected[i]) return false;
+	SequenceData* full = d.materialize();
+	bool same = full->length() == (int)expected.size()
+		&& (expected.empty() || memcmp( full->sequence(), &expected[0], sizeof(STYPE)*expected.size() ) == 0);
+	delete full;
+	return same;
+}
+
+/** Two diffs over one root take random edits, the first copying ranges of the second, and are checked
+ * after each against plain sequences taking the same edits.
+ */
+static void pieceTable() {
+	SequenceRoot* root = sequenceRoot( 300 );
+	DataView<SequenceData> base = root->view();
+	SequenceDiff* d[2] = { new SequenceDiff( base ), new SequenceDiff( base ) };
+	std::vector<STYPE> expected[2];
+	for (int k=0; k<2; k++) expected[k].assign( base->sequence(), base->sequence() + base->length() );
+	CHECK( d[0]->sameRoot( *d[1] ) );
+
+	for (int step=0; step<STEPS; step++) {
+		int k = (int)(random01()*2);
+		std::vector<STYPE>& e = expected[k];
+		int length = e.size();
+		int kind = (int)(random01()*4);
+		if (kind == 0 && length > 0) {
+			std::vector<int> sites;
+			std::vector<unsigned short> symbols;
+			for (int i=(int)(random01()*10); i<length; i+=1+(int)(random01()*40)) {
+				sites.push_back( i );
+				symbols.push_back( (unsigned short)(random01()*4) );
+				e[i] = (STYPE)symbols.back();
+			}
+			if (!sites.empty()) d[k]->setSites( &sites[0], &symbols[0], sites.size() );
+		} else if (kind == 1 && length > 0) {
+			int loc = (int)(random01()*length);
+			int span = 1 + (int)(random01()*30);
+			if (loc+span > length) span = length-loc;
+			d[k]->erase( loc, span );
+			e.erase( e.begin()+loc, e.begin()+loc+span );
+		} else if (kind == 2) {
+			int loc = (int)(random01()*(length+1));
+			std::vector<STYPE> s( 1 + (int)(random01()*30) );
+			for (int i=0; i<(int)s.size(); i++) s[i] = (STYPE)(random01()*4);
+			d[k]->insert( loc, &s[0], s.size() );
+			e.insert( e.begin()+loc, s.begin(), s.end() );
+		} else {
+			int shortest = std::min( expected[0].size(), expected[1].size() );
+			if (shortest < 2) continue;
+			int a = (int)(random01()*shortest), b = (int)(random01()*shortest);
+			if (a > b) std::swap( a, b );
+			d[0]->copyRange( *d[1], a, b );
+			std::copy( expected[1].begin()+a, expected[1].begin()+b, expected[0].begin()+a );
+		}
+		CHECK( matches( *d[0], expected[0] ) );
+		CHECK( matches( *d[1], expected[1] ) );
+	}
+
+	// Erased down to nothing and grown back
+	d[0]->erase( 0, d[0]->length() );
+	expected[0].clear();
+	CHECK( matches( *d[0], expected[0] ) );
+	STYPE s[3] = { 1, 2, 3 };
+	d[0]->insert( 0, s, 3 );
+	expected[0].assign( s, s+3 );
+	CHECK( matches( *d[0], expected[0] ) );
+
+	SequenceDiff* copy = d[1]->copy();
+	CHECK( copy->sameRoot( *d[1] ) && matches( *copy, expected[1] ) );
+
+	SequenceRoot* other = sequenceRoot( 300 );
+	SequenceDiff foreign( other->view() );
+	CHECK( !foreign.sameRoot( *d[0] ) );
+	delete copy;
+	delete d[0];
+	delete d[1];
+}
+
+/** Mixed lineages over one root: each genotype's diff, and its reads once some are cached as diffs, must
+ * match its full evaluation.
+ */
+static void lineages() {
+	std::vector<OpSequence*> ops( 1, sequenceRoot( LENGTH ) );
+	growLineages( ops, OPERATIONS );
+	std::vector<SequenceData*> full;
+	for (int i=0; i<(int)ops.size(); i++) full.push_back( ops[i]->evaluate() );
+
+	for (int i=1; i<(int)ops.size(); i++) {
+		SequenceDiff* d = ((OpSequenceBase*)ops[i])->evaluateDiff();
+		CHECK( d != NULL );
+		if (!d) continue;
+		SequenceData* m = d->materialize();
+		CHECK( sameSequence( *m, *full[i] ) );
+		delete m;
+		delete d;
+	}
+
+	// Genotypes cached as diffs are read, and their descendants built, from the cache
+	OpSequenceBase::setDiffCache( true );
+	int diffs = 0;
+	for (int i=1; i<(int)ops.size(); i+=3) {
+		ops[i]->setCompressed( false );
+		// A diff leaves the full data cache empty
+		if (!ops[i]->isCompressed() && ops[i]->OpSequence::isCompressed()) diffs++;
+	}
+	CHECK( diffs > 0 );
+	for (int i=1; i<(int)ops.size(); i++) {
+		SequenceData* sd = ops[i]->evaluate();
+		CHECK( sameSequence( *sd, *full[i] ) );
+		delete sd;
+		bool same = true;
+		for (int j=0; j<full[i]->length(); j+=97) same = same && ops[i]->get(j) == full[i]->get(j);
+		CHECK( same );
+
+		// A descendant of a genotype cached in full has no diff
+		SequenceDiff* d = ((OpSequenceBase*)ops[i])->evaluateDiff();
+		if (!d) continue;
+		SequenceData* m = d->materialize();
+		CHECK( sameSequence( *m, *full[i] ) );
+		delete m;
+		delete d;
+	}
+	OpSequenceBase::setDiffCache( false );
+	for (int i=0; i<(int)full.size(); i++) delete full[i];
+}
+
+/** A crossover of genotypes over different roots has no diff, and is cached in full instead.
+ */
+static void foreignRoots() {
+	OpSequence* a = pointChange( *sequenceRoot( LENGTH ), 5 );
+	OpSequence* b = insertion( *sequenceRoot( LENGTH ), 40, 12 );
+	std::vector<int> locs( 1, 1000 );
+	OpSequenceBase* x = new SequenceCrossover( *a, *b, locs );
+	OpSequence* y = pointChange( *x, 3 );
+	SequenceData* full = x->evaluate();
+	SequenceData* fullY = y->evaluate();
+
+	CHECK( x->evaluateDiff() == NULL );
+	OpSequenceBase::setDiffCache( true );
+	x->setCompressed( false );
+	CHECK( !x->isCompressed() );
+	SequenceData* sd = x->evaluate();
+	CHECK( sameSequence( *sd, *full ) );
+	delete sd;
+
+	// Its descendants are read through the full sequence
+	CHECK( ((OpSequenceBase*)y)->evaluateDiff() == NULL );
+	y->setCompressed( false );
+	sd = y->evaluate();
+	CHECK( sameSequence( *sd, *fullY ) );
+	delete sd;
+	OpSequenceBase::setDiffCache( false );
+	delete full;
+	delete fullY;
+}
+
+int main() {
+	initRandom2( 4111, 2707 );
+	pieceTable();
+	lineages();
+	foreignRoots();
+
+	return failures > 0;
+}
@@ -0,0 +1,185 @@
+/*
+ *  SitePayloadTest.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "TestUtil.h"
+#include <Util/SitePayload.h>
+#include <map>
+
+using namespace GPPG;
+using namespace GPPG::Tests;
+
+/* Sites that fill the index: one under a stride, a stride, one over, and the same two strides on */
+static const int COUNTS[] = { 0, 1, 2, 15, 16, 17, 31, 32, 33, 48, 49, 200 };
+
+typedef std::map<int, unsigned short> Sites;
+
+/** True if \param p holds exactly \param ref, through decode(), site(), symbol() and find().
+ */
+static bool matches(const SitePayload& p, const Sites& ref) {
+	int n = ref.size();
+	if (p.size() != n) return false;
+	std::vector<int> sites(n+1);
+	std::vector<unsigned short> symbols(n+1);
+	p.decode( &sites[0], &symbols[0] );
+
+	int i = 0, prev = -1;
+	for (Sites::const_iterator it=ref.begin(); it!=ref.end(); it++, i++) {
+		if (sites[i] != it->first || symbols[i] != it->second) return false;
+		if (p.site(i) != it->first || p.symbol(i) != it->second) return false;
+		unsigned short symbol = 0;
+		if (!p.find( it->first, symbol ) || symbol != it->second) return false;
+		// The sites between two of the payload are not found
+		for (int s=prev+1; s<it->first; s++) {
+			if (p.find( s, symbol )) return false;
+		}
+		prev = it->first;
+	}
+	unsigned short symbol;
+	return !p.find( prev+1, symbol ) && !p.find( prev+1000, symbol );
+}
+
+/** Draws \param count unique sites, spaced so some deltas take several varint bytes, then writes a few of
+ * them again; the writes go to \param sites and \param symbols in random order, and the last symbol of each
+ * site to \param ref.  Symbols stay under \param maxSymbol.
+ */
+static void draw(int count, int maxSymbol, std::vector<int>& sites, std::vector<unsigned short>& symbols, Sites& ref) {
+	sites.clear();
+	symbols.clear();
+	ref.clear();
+	int site = (int)(random01()*4);
+	for (int i=0; i<count; i++) {
+		sites.push_back( site );
+		site += 1 + (random01() < 0.1 ? (int)(random01()*40000) : (int)(random01()*5));
+	}
+	for (int i=0; i<count/3; i++) sites.push_back( sites[(int)(random01()*count)] );
+	for (int i=(int)sites.size()-1; i>0; i--) std::swap( sites[i], sites[(int)(random01()*(i+1))] );
+	for (int i=0; i<(int)sites.size(); i++) {
+		symbols.push_back( (unsigned short)(random01()*maxSymbol) );
+		ref[sites[i]] = symbols[i];
+	}
+}
+
+/** Payloads around the index strides, with repeated sites, in narrow and wide symbols.
+ */
+static void strides() {
+	const int maxSymbols[] = { 2, 4, 300, 65536 };
+	for (int m=0; m<4; m++) {
+		for (int c=0; c<(int)(sizeof(COUNTS)/sizeof(COUNTS[0])); c++) {
+			std::vector<int> sites;
+			std::vector<unsigned short> symbols;
+			Sites ref;
+			draw( COUNTS[c], maxSymbols[m], sites, symbols, ref );
+			SitePayload p( sites.empty() ? 0 : &sites[0], symbols.empty() ? 0 : &symbols[0], sites.size() );
+			CHECK( matches( p, ref ) );
+		}
+	}
+}
+
+/** Repeated sites keep their last symbol, whether the repeats straddle an index entry or not.
+ */
+static void lastWriteWins() {
+	for (int n=15; n<=33; n++) {
+		std::vector<int> sites;
+		std::vector<unsigned short> symbols;
+		Sites ref;
+		for (int i=0; i<n; i++) {
+			sites.push_back( 3*i );
+			symbols.push_back( 1 );
+		}
+		// Rewrite the site at every index boundary, and its neighbours, twice
+		for (int k=0; k<2; k++) {
+			for (int i=0; i<n; i++) {
+				if (i % 16 > 1 && i % 16 < 15) continue;
+				sites.push_back( 3*i );
+				symbols.push_back( (unsigned short)(2+k+i) );
+			}
+		}
+		for (int i=0; i<(int)sites.size(); i++) ref[sites[i]] = symbols[i];
+		SitePayload p( &sites[0], &symbols[0], sites.size() );
+		CHECK( matches( p, ref ) );
+	}
+}
+
+/** The fingerprint change counts each site once, with the symbol it had and the one it ends with.
+ */
+static void fingerprints() {
+	for (int c=0; c<(int)(sizeof(COUNTS)/sizeof(COUNTS[0])); c++) {
+		std::vector<int> sites;
+		std::vector<unsigned short> symbols;
+		Sites ref;
+		draw( COUNTS[c], 4, sites, symbols, ref );
+		if (sites.empty()) continue;
+		SitePayload p( &sites[0], &symbols[0], sites.size() );
+
+		// Every write of a site sees the symbol the site had before the change
+		Sites before;
+		for (Sites::iterator it=ref.begin(); it!=ref.end(); it++) before[it->first] = (unsigned short)(random01()*4);
+		std::vector<unsigned short> prev( sites.size() );
+		for (int i=0; i<(int)sites.size(); i++) prev[i] = before[sites[i]];
+
+		Fingerprint f;
+		for (Sites::iterator it=ref.begin(); it!=ref.end(); it++) {
+			if (before[it->first] == it->second) continue;
+			f ^= siteFingerprint( it->first, before[it->first] );
+			f ^= siteFingerprint( it->first, it->second );
+		}
+		CHECK( p.fingerprintDelta( &sites[0], &prev[0], sites.size() ) == f );
+
+		// Writing a site back to the symbol it had leaves no trace
+		std::vector<unsigned short> same( sites.size() );
+		for (int i=0; i<(int)sites.size(); i++) same[i] = ref[sites[i]];
+		CHECK( p.fingerprintDelta( &sites[0], &same[0], sites.size() ) == Fingerprint() );
+	}
+}
+
+/** Payloads stored inline and on the heap copy and assign into one another.
+ */
+static void storage() {
+	std::vector<int> sites;
+	std::vector<unsigned short> symbols;
+	Sites small, large;
+	draw( 2, 4, sites, symbols, small );
+	SitePayload a( &sites[0], &symbols[0], sites.size() );
+	draw( 40, 300, sites, symbols, large );
+	SitePayload b( &sites[0], &symbols[0], sites.size() );
+	// A few sites fit in the object; an indexed payload does not
+	CHECK( a.encodedSize() <= 16 );
+	CHECK( b.encodedSize() > 16 );
+
+	SitePayload c( a ), d( b );
+	CHECK( matches( c, small ) );
+	CHECK( matches( d, large ) );
+	c = b;
+	d = a;
+	CHECK( matches( c, large ) );
+	CHECK( matches( d, small ) );
+	c = c;
+	CHECK( matches( c, large ) );
+	c = SitePayload();
+	CHECK( c.size() == 0 && c.encodedSize() == 0 );
+
+	// Payloads on either side of the inline limit
+	for (int n=1; n<=16; n++) {
+		draw( n, 4, sites, symbols, small );
+		SitePayload e( &sites[0], &symbols[0], sites.size() );
+		SitePayload f( e );
+		CHECK( matches( e, small ) );
+		CHECK( matches( f, small ) );
+		CHECK( f.encodedSize() == e.encodedSize() );
+	}
+}
+
+int main() {
+	initRandom2( 3371, 1187 );
+	strides();
+	lastWriteWins();
+	fingerprints();
+	storage();
+
+	return failures > 0;
+}
@@ -0,0 +1,130 @@
+/*
+ *  TestUtil.h
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#ifndef TESTS_TEST_UTIL_
+#define TESTS_TEST_UTIL_
+
+#include <Model/Sequence/Operation.h>
+#include <Operation/OperationHeap.h>
+#include <Util/Random.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <vector>
+
+/* Each test is a program that prints its failed checks and returns non-zero if there were any */
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " << #cond << std::endl; \
+		failures++; \
+	} \
+} while (0)
+
+namespace GPPG {
+	namespace Tests {
+
+		/** Returns a random root sequence of \param length.
+		 */
+		inline Model::SequenceRoot* sequenceRoot(int length) {
+			Model::SequenceRootFactory factory( length, std::vector<double>(4, 0.25) );
+			return factory.random();
+		}
+
+		/** Returns a point change of the first \param n sites of \param parent (its cost is \param n).
+		 */
+		inline Model::OpSequence* pointChange(Model::OpSequence& parent, int n) {
+			std::vector<int> locs(n);
+			std::vector<Model::STYPE> dest(n, 1), prev(n, 0);
+			for (int i=0; i<n; i++) locs[i] = i;
+			return new Model::SequencePointChange( parent, &locs[0], n, &dest[0], &prev[0] );
+		}
+
+		/** Returns an insertion of \param n sites before \param loc of \param parent.
+		 */
+		inline Model::OpSequence* insertion(Model::OpSequence& parent, int loc, int n) {
+			Model::SequenceData* span = new Model::SequenceData( n );
+			for (int i=0; i<n; i++) span->set( i, (Model::STYPE)((loc+i) % 4) );
+			return new Model::SequenceInsertion( parent, loc, span );
+		}
+
+		/** Draws \param n random point changes, indels and crossovers onto \param ops, which holds at least
+		 * a root; each picks its parents among the operations already in \param ops, and a crossover that
+		 * draws the same parent twice is left out.
+		 */
+		inline void growLineages(std::vector<Model::OpSequence*>& ops, int n) {
+			for (int k=0; k<n; k++) {
+				Model::OpSequence* parent = ops[ (int)(random01()*ops.size()) ];
+				int length = parent->length();
+				int kind = (int)(random01()*4);
+				if (kind == 0) {
+					// Sites may repeat; the last character listed wins
+					int sites = 1 + (int)(random01()*8);
+					std::vector<int> locs(sites);
+					std::vector<Model::STYPE> dest(sites), prev(sites, 0);
+					for (int i=0; i<sites; i++) {
+						locs[i] = (int)(random01()*length);
+						dest[i] = (Model::STYPE)(random01()*4);
+					}
+					ops.push_back( new Model::SequencePointChange( *parent, &locs[0], sites, &dest[0], &prev[0] ) );
+				} else if (kind == 1) {
+					int span = 1 + (int)(random01()*20);
+					ops.push_back( new Model::SequenceDeletion( *parent, (int)(random01()*(length-span)), span ) );
+				} else if (kind == 2) {
+					ops.push_back( insertion( *parent, (int)(random01()*(length+1)), 1 + (int)(random01()*20) ) );
+				} else {
+					Model::OpSequence* other = ops[ (int)(random01()*ops.size()) ];
+					if (other == parent) continue;
+					int shortest = (other->length() < length) ? other->length() : length;
+					std::vector<int> locs( 1 + (int)(random01()*3) );
+					for (int i=0; i<(int)locs.size(); i++) locs[i] = 1 + (int)(random01()*(shortest-10));
+					std::sort( locs.begin(), locs.end() );
+					ops.push_back( new Model::SequenceCrossover( *parent, *other, locs ) );
+				}
+			}
+		}
+
+		/** True if \param a and \param b hold the same sequence.
+		 */
+		inline bool sameSequence(const Model::SequenceData& a, const Model::SequenceData& b) {
+			if (a.length() != b.length()) return false;
+			return memcmp( a.sequence(), b.sequence(), sizeof(Model::STYPE)*a.length() ) == 0;
+		}
+
+		/** Adds \param op to \param graph, and activates it (as the simulator would) if \param active:
+		 * living genotypes hold an index in the population, which keeps the graph from collecting them.
+		 */
+		inline void addGenotype(OperationGraph& graph, IOperation* op, bool active) {
+			static int keys = 0;
+			op->setKey( keys++ );
+			graph.addOperation( op );
+			if (!active) return;
+			op->setIndex( op->key() );
+			op->setFrequency( 0.1 );
+			graph.genotypeActivated( op );
+		}
+
+		/** Evaluates \param op \param n times, counting the reads as the simulator's would be.
+		 */
+		inline void read(Model::OpSequence* op, int n) {
+			for (int i=0; i<n; i++) delete op->evaluate();
+		}
+
+		/** Passes the end of a generation with the active genotypes \param active to \param graph.
+		 */
+		inline void finishGeneration(OperationGraph& graph, const std::vector<IOperation*>& active) {
+			std::set<IGenotype*> genos;
+			for (int i=0; i<(int)active.size(); i++) genos.insert( active[i] );
+			graph.generationFinished( genos );
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ *  ThreadPoolTest.cpp
+ *  GPPG
+ *
+ *  Copyright 2012 Rice University. All rights reserved.
+ *
+ */
+
+#include "TestUtil.h"
+#include <Util/Thread.h>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+using namespace GPPG;
+
+#define ITEMS 4000
+
+/* Counts the items it runs, and throws at item \param fail (if not -1) */
+class Counter : public ParallelTask {
+public:
+	Counter(int fail, int kind) : _fail(fail), _kind(kind), _items(0) {}
+
+	void run(int begin, int end, int) {
+		for (int i=begin; i<end; i++) {
+			if (i == _fail) {
+				if (_kind == 0) throw "Counter: failed";
+				if (_kind == 1) throw std::bad_alloc();
+				throw std::out_of_range( "Counter: out of range" );
+			}
+			atomicAdd( &_items, 1 );
+		}
+	}
+
+	int items() { return atomicAdd( &_items, 0 ); }
+
+private:
+	int _fail, _kind, _items;
+};
+
+/* Runs an inner loop over the items of each of its own */
+class Nested : public ParallelTask {
+public:
+	Nested() : _items(0) {}
+
+	void run(int begin, int end, int) {
+		for (int i=begin; i<end; i++) {
+			Counter inner( -1, 0 );
+			ThreadPool::instance().parallelFor( 100, inner );
+			atomicAdd( &_items, inner.items() );
+		}
+	}
+
+	int items() { return atomicAdd( &_items, 0 ); }
+
+private:
+	int _items;
+};
+
+/** Errors thrown by a task come back to the caller, whichever thread threw them, and the pool can be
+ * used again afterwards.
+ */
+static void errors() {
+	for (int at=0; at<ITEMS; at+=ITEMS/7) {
+		Counter message( at, 0 ), memory( at, 1 ), other( at, 2 );
+		bool caught = false;
+		try {
+			ThreadPool::instance().parallelFor( ITEMS, message );
+		} catch (const char* e) {
+			caught = strcmp( e, "Counter: failed" ) == 0;
+		}
+		CHECK( caught );
+		CHECK( message.items() < ITEMS );
+
+		caught = false;
+		try {
+			ThreadPool::instance().parallelFor( ITEMS, memory );
+		} catch (const std::bad_alloc&) {
+			caught = true;
+		}
+		CHECK( caught );
+
+		caught = false;
+		try {
+			ThreadPool::instance().parallelFor( ITEMS, other );
+		} catch (const std::runtime_error& e) {
+			caught = strcmp( e.what(), "Counter: out of range" ) == 0;
+		}
+		CHECK( caught );
+
+		Counter all( -1, 0 );
+		ThreadPool::instance().parallelFor( ITEMS, all );
+		CHECK( all.items() == ITEMS );
+	}
+}
+
+/** A loop started from a task runs on the task's thread.
+ */
+static void nested() {
+	Nested outer;
+	ThreadPool::instance().parallelFor( 64, outer );
+	CHECK( outer.items() == 64*100 );
+}
+
+int main() {
+	ThreadPool::instance().setThreads( 4 );
+	errors();
+	nested();
+	ThreadPool::instance().setThreads( 1 );
+
+	return failures > 0;
+}